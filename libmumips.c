@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "libmumips.h"
+
+struct mumips_ctx {
+	int loaded;
+};
+
+static mumips_ctx *ACTIVE_CTX;
+
+/* indexed by the bit number of the STALL_* cause */
+static const char *STALL_NAMES[NUM_STALL_CAUSES] = { "ex_mem", "mem_wb", "store", "fp", "tlb", "sb_full" };
+
+/***************************************************************/
+/* Create the simulator context with memory allocated and tracing off   */
+/***************************************************************/
+mumips_ctx *mumips_create(void)
+{
+	mumips_ctx *ctx;
+
+	if (ACTIVE_CTX != NULL) {
+		return NULL;
+	}
+	ctx = calloc(1, sizeof(mumips_ctx));
+	if (ctx == NULL) {
+		return NULL;
+	}
+	initialize();
+	ENABLE_TRACE = FALSE;
+	ACTIVE_CTX = ctx;
+	return ctx;
+}
+
+/***************************************************************/
+/* Release the context and all simulator memory                                     */
+/***************************************************************/
+void mumips_destroy(mumips_ctx *ctx)
+{
+	if (ctx == NULL || ctx != ACTIVE_CTX) {
+		return;
+	}
+	debug_clear();
+	checkpoint_enable(0);
+	cosim_enable(FALSE);
+	memo_enable(FALSE);
+	mmu_disable();
+	store_buffer_enable(0, 0, SB_DRAIN_EAGER);
+	cache_analysis_enable(0);
+	profile_enable(FALSE);
+	interval_stats_close();
+	monitor_close();
+	host_profile_enable(0);
+	batch_close();
+	free_memory();
+	memset(&CURRENT_STATE, 0, sizeof(CURRENT_STATE));
+	reset_pipeline();
+	CYCLE_HOOKS = 0;
+	set_forwarding(FALSE);
+	prog_file[0] = '\0';
+	ACTIVE_CTX = NULL;
+	free(ctx);
+}
+
+/***************************************************************/
+/* Load a program file of hex words                                                       */
+/***************************************************************/
+int mumips_load_program(mumips_ctx *ctx, const char *path)
+{
+	if (ctx != ACTIVE_CTX || strlen(path) >= sizeof(prog_file)) {
+		return MUMIPS_ERROR;
+	}
+	strcpy(prog_file, path);
+	if (!load_program()) {
+		return MUMIPS_ERROR;
+	}
+	ctx->loaded = TRUE;
+	mumips_reset(ctx);
+	return MUMIPS_OK;
+}
+
+/***************************************************************/
+/* Load a program from words already in host memory                             */
+/***************************************************************/
+int mumips_load_words(mumips_ctx *ctx, const uint32_t *words, uint32_t count)
+{
+	uint32_t *image;
+
+	if (ctx != ACTIVE_CTX || count == 0) {
+		return MUMIPS_ERROR;
+	}
+	image = malloc(count * sizeof(uint32_t));
+	if (image == NULL) {
+		return MUMIPS_ERROR;
+	}
+	memcpy(image, words, count * sizeof(uint32_t));
+	free(PROGRAM_IMAGE);
+	PROGRAM_IMAGE = image;
+	PROGRAM_SIZE = count;
+	prog_file[0] = '\0';
+	ctx->loaded = TRUE;
+	mumips_reset(ctx);
+	return MUMIPS_OK;
+}
+
+void mumips_reset(mumips_ctx *ctx)
+{
+	if (ctx == ACTIVE_CTX) {
+		reset();
+	}
+}
+
+void mumips_set_forwarding(mumips_ctx *ctx, int enable)
+{
+	if (ctx == ACTIVE_CTX) {
+		set_forwarding(enable);
+	}
+}
+
+void mumips_set_trace(mumips_ctx *ctx, int enable)
+{
+	if (ctx == ACTIVE_CTX) {
+		ENABLE_TRACE = enable ? TRUE : FALSE;
+	}
+}
+
+void mumips_set_memo(mumips_ctx *ctx, int enable)
+{
+	if (ctx == ACTIVE_CTX) {
+		memo_enable(enable);
+	}
+}
+
+int mumips_set_mmu(mumips_ctx *ctx, uint32_t entries, uint32_t cost)
+{
+	if (ctx != ACTIVE_CTX) {
+		return MUMIPS_ERROR;
+	}
+	if (entries == 0) {
+		mmu_disable();
+		return MUMIPS_OK;
+	}
+	return mmu_enable(entries, cost) ? MUMIPS_OK : MUMIPS_ERROR;
+}
+
+int mumips_set_store_buffer(mumips_ctx *ctx, uint32_t entries, uint32_t latency, int lazy)
+{
+	if (ctx != ACTIVE_CTX) {
+		return MUMIPS_ERROR;
+	}
+	return store_buffer_enable(entries, latency, lazy ? SB_DRAIN_LAZY : SB_DRAIN_EAGER) ? MUMIPS_OK : MUMIPS_ERROR;
+}
+
+/***************************************************************/
+/* Simulate up to cycles cycles; stops early when the program exits     */
+/***************************************************************/
+uint32_t mumips_step(mumips_ctx *ctx, uint32_t cycles)
+{
+	uint32_t i;
+
+	if (ctx != ACTIVE_CTX || !ctx->loaded) {
+		return 0;
+	}
+	for (i = 0; i < cycles && RUN_FLAG; ) {
+		i += cycle_skip(cycles - i);
+	}
+	return i;
+}
+
+/***************************************************************/
+/* Simulate until the program exits or max_cycles pass                         */
+/***************************************************************/
+uint32_t mumips_run(mumips_ctx *ctx, uint32_t max_cycles)
+{
+	uint32_t i = 0;
+
+	if (ctx != ACTIVE_CTX || !ctx->loaded) {
+		return 0;
+	}
+	while (RUN_FLAG && (max_cycles == 0 || i < max_cycles)) {
+		i += cycle_skip(max_cycles ? max_cycles - i : UINT32_MAX);
+	}
+	return i;
+}
+
+/***************************************************************/
+/* Sampled estimate of the whole run; refused without a word when the  */
+/* settings include a pipeline feature fast-forwarding does not model */
+/***************************************************************/
+int mumips_sample(mumips_ctx *ctx, uint32_t period, uint32_t warmup, uint32_t window)
+{
+	if (ctx != ACTIVE_CTX || !ctx->loaded || engine_unmodelled()) {
+		return MUMIPS_ERROR;
+	}
+	return sample(period, warmup, window) ? MUMIPS_OK : MUMIPS_ERROR;
+}
+
+void mumips_set_checkpoints(mumips_ctx *ctx, uint32_t interval)
+{
+	if (ctx == ACTIVE_CTX) {
+		checkpoint_enable(interval);
+	}
+}
+
+/***************************************************************/
+/* Rewind cycles cycles, replaying from the nearest older checkpoint  */
+/***************************************************************/
+int mumips_back(mumips_ctx *ctx, uint32_t cycles)
+{
+	if (ctx != ACTIVE_CTX || !ctx->loaded) {
+		return MUMIPS_ERROR;
+	}
+	return back(cycles) ? MUMIPS_OK : MUMIPS_ERROR;
+}
+
+uint32_t mumips_get_reg(mumips_ctx *ctx, int reg)
+{
+	if (ctx != ACTIVE_CTX) {
+		return 0;
+	}
+	if (reg >= 0 && reg < MIPS_REGS) {
+		return CURRENT_STATE.REGS[reg];
+	}
+	if (reg >= MUMIPS_REG_F0 && reg < MUMIPS_REG_F0 + MIPS_FP_REGS) {
+		return CURRENT_STATE.FPR[reg - MUMIPS_REG_F0];
+	}
+	switch (reg) {
+		case MUMIPS_REG_HI:
+			return CURRENT_STATE.HI;
+		case MUMIPS_REG_LO:
+			return CURRENT_STATE.LO;
+		case MUMIPS_REG_PC:
+			return CURRENT_STATE.PC;
+		case MUMIPS_REG_FCSR:
+			return CURRENT_STATE.FCSR;
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Set a register in the current state, like "input"                          */
+/***************************************************************/
+int mumips_set_reg(mumips_ctx *ctx, int reg, uint32_t value)
+{
+	if (ctx != ACTIVE_CTX) {
+		return MUMIPS_ERROR;
+	}
+	if (reg >= 0 && reg < MIPS_REGS) {
+		CURRENT_STATE.REGS[reg] = value;
+		return MUMIPS_OK;
+	}
+	if (reg >= MUMIPS_REG_F0 && reg < MUMIPS_REG_F0 + MIPS_FP_REGS) {
+		CURRENT_STATE.FPR[reg - MUMIPS_REG_F0] = value;
+		return MUMIPS_OK;
+	}
+	switch (reg) {
+		case MUMIPS_REG_HI:
+			CURRENT_STATE.HI = value;
+			return MUMIPS_OK;
+		case MUMIPS_REG_LO:
+			CURRENT_STATE.LO = value;
+			return MUMIPS_OK;
+		case MUMIPS_REG_PC:
+			CURRENT_STATE.PC = value;
+			return MUMIPS_OK;
+		case MUMIPS_REG_FCSR:
+			CURRENT_STATE.FCSR = value;
+			return MUMIPS_OK;
+	}
+	return MUMIPS_ERROR;
+}
+
+uint32_t mumips_read_mem(mumips_ctx *ctx, uint32_t address)
+{
+	return ctx == ACTIVE_CTX ? mem_read_32(address) : 0;
+}
+
+void mumips_write_mem(mumips_ctx *ctx, uint32_t address, uint32_t value)
+{
+	if (ctx == ACTIVE_CTX) {
+		mem_write_32(address, value);
+	}
+}
+
+void mumips_get_counters(mumips_ctx *ctx, mumips_counters *counters)
+{
+	if (ctx != ACTIVE_CTX) {
+		memset(counters, 0, sizeof(*counters));
+		return;
+	}
+	counters->cycles = CYCLE_COUNT;
+	counters->instructions = INSTRUCTION_COUNT;
+	counters->pc = CURRENT_STATE.PC;
+	counters->running = RUN_FLAG;
+}
+
+const char *mumips_stall_name(int cause)
+{
+	return cause >= 0 && cause < NUM_STALL_CAUSES ? STALL_NAMES[cause] : NULL;
+}
+
+uint64_t mumips_get_stalls(mumips_ctx *ctx, int cause)
+{
+	if (ctx != ACTIVE_CTX || cause < 0 || cause >= NUM_STALL_CAUSES) {
+		return 0;
+	}
+	return STATS.stalls[cause];
+}
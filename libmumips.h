@@ -0,0 +1,85 @@
+#ifndef LIBMUMIPS_H
+#define LIBMUMIPS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************/
+/* Embedding interface of the MU-MIPS pipeline simulator.                     */
+/* The simulator core keeps its state in globals, so only one context    */
+/* can exist at a time; mumips_create returns NULL while one is alive.   */
+/* Functions returning int give MUMIPS_OK or MUMIPS_ERROR.               */
+/***************************************************************/
+#define MUMIPS_OK 0
+#define MUMIPS_ERROR (-1)
+
+/* register numbers beyond the 32 GPRs; FP register n is MUMIPS_REG_F0 + n */
+#define MUMIPS_REG_HI 32
+#define MUMIPS_REG_LO 33
+#define MUMIPS_REG_PC 34
+#define MUMIPS_REG_FCSR 35
+#define MUMIPS_REG_F0 36
+#define MUMIPS_FP_REGS 32
+
+typedef struct mumips_ctx mumips_ctx;
+
+typedef struct mumips_counters {
+	uint32_t cycles;
+	uint32_t instructions;
+	uint32_t pc;
+	int running;	/* FALSE once the program exited through SYSCALL */
+} mumips_counters;
+
+mumips_ctx *mumips_create(void);
+void mumips_destroy(mumips_ctx *ctx);
+
+/* load a program (file of hex words, or words in memory) and reset */
+int mumips_load_program(mumips_ctx *ctx, const char *path);
+int mumips_load_words(mumips_ctx *ctx, const uint32_t *words, uint32_t count);
+
+/* clear registers, memory and the pipeline, then reload the program */
+void mumips_reset(mumips_ctx *ctx);
+void mumips_set_forwarding(mumips_ctx *ctx, int enable);
+void mumips_set_trace(mumips_ctx *ctx, int enable);
+/* replay ID stall decisions of earlier cycles in the same timing state */
+void mumips_set_memo(mumips_ctx *ctx, int enable);
+/* translate user loads and stores through a TLB of entries entries, */
+/* each waiting cost cycles in ID; 0 entries turns the MMU off         */
+int mumips_set_mmu(mumips_ctx *ctx, uint32_t entries, uint32_t cost);
+/* buffer stores in entries entries, one written every latency cycles, */
+/* always or only when full (lazy); 0 entries turns the buffer off       */
+int mumips_set_store_buffer(mumips_ctx *ctx, uint32_t entries, uint32_t latency, int lazy);
+
+/* simulate; both return the number of cycles executed */
+uint32_t mumips_step(mumips_ctx *ctx, uint32_t cycles);
+uint32_t mumips_run(mumips_ctx *ctx, uint32_t max_cycles); /* 0 = no limit */
+/* estimate the run from a reset pipeline with detailed windows of     */
+/* warmup + window instructions every period instructions, leaving the */
+/* estimate in the counters; MUMIPS_ERROR when sampling does not model  */
+/* the MMU or store buffer settings                                       */
+int mumips_sample(mumips_ctx *ctx, uint32_t period, uint32_t warmup, uint32_t window);
+
+/* take a checkpoint every interval cycles (0 = off) so that mumips_back */
+/* can rewind; MUMIPS_ERROR when no checkpoint is old enough            */
+void mumips_set_checkpoints(mumips_ctx *ctx, uint32_t interval);
+int mumips_back(mumips_ctx *ctx, uint32_t cycles);
+
+uint32_t mumips_get_reg(mumips_ctx *ctx, int reg);
+int mumips_set_reg(mumips_ctx *ctx, int reg, uint32_t value);
+uint32_t mumips_read_mem(mumips_ctx *ctx, uint32_t address);
+void mumips_write_mem(mumips_ctx *ctx, uint32_t address, uint32_t value);
+void mumips_get_counters(mumips_ctx *ctx, mumips_counters *counters);
+
+/* bubbles ID inserted since the reset, by cause: 0, 1, ... up to the */
+/* first cause mumips_stall_name returns NULL for                       */
+const char *mumips_stall_name(int cause);
+uint64_t mumips_get_stalls(mumips_ctx *ctx, int cause);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "mu-mips.h"
+
+/***************************************************************/
+/* Synthetic workloads: straight-line programs with a chosen mix of */
+/* instruction classes, dependency distances, load-use pairs and a    */
+/* data working set, in the simulator's hex format or as raw words   */
+/***************************************************************/
+enum { GEN_ALU, GEN_IMM, GEN_LOAD, GEN_STORE, GEN_MUL, GEN_DIV, GEN_FP, NUM_GEN_CLASSES };
+static const char *CLASS_NAMES[NUM_GEN_CLASSES] = { "alu", "imm", "load", "store", "mul", "div", "fp" };
+
+#define GEN_MAX_DISTANCE 32	/* longest dependency distance tracked */
+#define GEN_FIRST_REG 3	/* registers the body computes with: $3..$24 */
+#define GEN_LAST_REG 24
+#define GEN_ADDRESS_REG 25	/* data base + pointer, the base of every load and store */
+#define GEN_MASK_REG 26	/* keeps the pointer inside the working set */
+#define GEN_POINTER_REG 27
+#define GEN_ONE_REG 28	/* holds 1 for the divide guard */
+#define GEN_BASE_REG 29
+#define GEN_FP_REGS 16	/* $f0..$f15 */
+#define GEN_WINDOW 4096	/* bytes reachable from the address register by immediates */
+#define GEN_BUMP_EVERY 16	/* memory accesses between pointer moves */
+
+typedef struct Gen_Config_Struct {
+	uint32_t count;	/* body instructions */
+	uint32_t seed;
+	uint32_t mix[NUM_GEN_CLASSES];	/* relative weights */
+	uint32_t distance[GEN_MAX_DISTANCE + 1];	/* weights by distance, 0 = no recent producer */
+	uint32_t load_use;	/* percent of loads whose result the next instruction reads */
+	uint32_t working_set;	/* bytes, a power of two */
+	int binary;
+} Gen_Config;
+
+typedef struct Gen_State_Struct {
+	FILE *out;
+	int binary;
+	uint64_t state;	/* xorshift64* */
+	uint32_t written;
+	uint8_t recent[GEN_MAX_DISTANCE + 1];	/* recent[d]: GPR written d instructions ago, 0 = none */
+	uint32_t load_use_reg;	/* the next instruction reads this load result, 0 = none */
+	uint32_t window, accesses;
+	uint64_t classes[NUM_GEN_CLASSES], dependent, distance_sum;
+} Gen_State;
+
+/***************************************************************/
+/* Random numbers                                                                             */
+/***************************************************************/
+static uint32_t gen_random(Gen_State *g) {
+	g->state ^= g->state >> 12;
+	g->state ^= g->state << 25;
+	g->state ^= g->state >> 27;
+	return (uint32_t)((g->state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static uint32_t gen_below(Gen_State *g, uint32_t n) {
+	return n ? gen_random(g) % n : 0;
+}
+
+/* index picked with probability weights[i] / sum of weights */
+static uint32_t gen_pick(Gen_State *g, const uint32_t *weights, uint32_t n) {
+	uint32_t total = 0, i, r;
+
+	for (i = 0; i < n; i++) {
+		total += weights[i];
+	}
+	r = gen_below(g, total);
+	for (i = 0; i < n; i++) {
+		if (r < weights[i]) {
+			return i;
+		}
+		r -= weights[i];
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Instruction encodings                                                                    */
+/***************************************************************/
+static uint32_t enc_r(uint32_t rs, uint32_t rt, uint32_t rd, uint32_t shamt, uint32_t function) {
+	return (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | function;
+}
+
+static uint32_t enc_i(uint32_t opcode, uint32_t rs, uint32_t rt, uint32_t immediate) {
+	return (opcode << 26) | (rs << 21) | (rt << 16) | (immediate & 0xFFFF);
+}
+
+static uint32_t enc_fp(uint32_t function, uint32_t ft, uint32_t fs, uint32_t fd) {
+	return (0x11 << 26) | (0x10 << 21) | (ft << 16) | (fs << 11) | (fd << 6) | function;
+}
+
+/***************************************************************/
+/* Write one word; dst is the GPR it writes, 0 for none                 */
+/***************************************************************/
+static void gen_emit(Gen_State *g, uint32_t word, uint32_t dst) {
+	if (g->binary) {
+		uint8_t bytes[4] = { word & 0xFF, (word >> 8) & 0xFF, (word >> 16) & 0xFF, word >> 24 };
+		fwrite(bytes, 1, 4, g->out);
+	}
+	else {
+		fprintf(g->out, "%08X\n", word);
+	}
+	memmove(&g->recent[2], &g->recent[1], GEN_MAX_DISTANCE - 1);
+	g->recent[1] = dst;
+	g->written++;
+}
+
+static uint32_t gen_register(Gen_State *g) {
+	return GEN_FIRST_REG + gen_below(g, GEN_LAST_REG - GEN_FIRST_REG + 1);
+}
+
+/***************************************************************/
+/* A source register: the result of the instruction the distance      */
+/* distribution picks, or any register                                           */
+/***************************************************************/
+static uint32_t gen_source(Gen_State *g, const Gen_Config *c) {
+	uint32_t distance = gen_pick(g, c->distance, GEN_MAX_DISTANCE + 1);
+
+	if (g->load_use_reg) {
+		distance = g->load_use_reg;
+		g->load_use_reg = 0;
+		g->dependent++;
+		g->distance_sum++;
+		return distance;
+	}
+	if (distance && g->recent[distance]) {
+		g->dependent++;
+		g->distance_sum += distance;
+		return g->recent[distance];
+	}
+	return gen_register(g);
+}
+
+/***************************************************************/
+/* Move the address register to another window of the working set    */
+/***************************************************************/
+static void gen_bump(Gen_State *g) {
+	gen_emit(g, enc_i(0x9, GEN_POINTER_REG, GEN_POINTER_REG, 5 * g->window), 0);
+	gen_emit(g, enc_r(GEN_POINTER_REG, GEN_MASK_REG, GEN_POINTER_REG, 0, 0x24), 0);
+	gen_emit(g, enc_r(GEN_BASE_REG, GEN_POINTER_REG, GEN_ADDRESS_REG, 0, 0x21), 0);
+}
+
+/* an offset in the window aligned to size bytes */
+static uint32_t gen_offset(Gen_State *g, uint32_t size) {
+	return gen_below(g, g->window / size) * size;
+}
+
+/***************************************************************/
+/* One instruction of the body (two for the divide guard and the       */
+/* HI/LO move)                                                                                */
+/***************************************************************/
+static void gen_instruction(Gen_State *g, const Gen_Config *c) {
+	static const uint32_t alu[] = { 0x21, 0x23, 0x24, 0x25, 0x26, 0x27, 0x2A, 0x00, 0x02, 0x03 };
+	static const uint32_t imm[] = { 0x9, 0xC, 0xD, 0xE, 0xA, 0xF };
+	static const uint32_t loads[] = { 0x23, 0x21, 0x20 }, stores[] = { 0x2B, 0x29, 0x28 }, sizes[] = { 4, 2, 1 };
+	static const uint32_t fp[] = { 0x00, 0x01, 0x02, 0x03 };
+	uint32_t kind = gen_pick(g, c->mix, NUM_GEN_CLASSES);
+	uint32_t op, rs, rt, rd, size;
+
+	g->classes[kind]++;
+	switch (kind) {
+		case GEN_ALU:
+			op = alu[gen_below(g, 10)];
+			rs = op <= 0x03 ? 0 : gen_source(g, c);
+			rt = gen_source(g, c);
+			rd = gen_register(g);
+			gen_emit(g, enc_r(rs, rt, rd, op <= 0x03 ? 1 + gen_below(g, 31) : 0, op), rd);
+			break;
+		case GEN_IMM:
+			op = imm[gen_below(g, 6)];
+			rt = gen_register(g);
+			/*immediates stay below 0x8000: ID sign-extends ORI's*/
+			gen_emit(g, enc_i(op, op == 0xF ? 0 : gen_source(g, c), rt, gen_below(g, 0x8000)), rt);
+			break;
+		case GEN_LOAD:
+		case GEN_STORE:
+			if (++g->accesses % GEN_BUMP_EVERY == 0) {
+				gen_bump(g);
+			}
+			op = gen_below(g, 3);
+			size = sizes[op];
+			if (kind == GEN_LOAD) {
+				rt = gen_register(g);
+				gen_emit(g, enc_i(loads[op], GEN_ADDRESS_REG, rt, gen_offset(g, size)), rt);
+				if (gen_below(g, 100) < c->load_use) {
+					g->load_use_reg = rt;
+				}
+			}
+			else {
+				gen_emit(g, enc_i(stores[op], GEN_ADDRESS_REG, gen_source(g, c), gen_offset(g, size)), 0);
+			}
+			break;
+		case GEN_MUL:
+		case GEN_DIV:
+			rs = gen_source(g, c);
+			rt = gen_source(g, c);
+			if (kind == GEN_DIV) {
+				/*an odd divisor is never zero; ID misses rt hazards on*/
+				/*immediate producers, so the guard is R-type*/
+				rd = gen_register(g);
+				gen_emit(g, enc_r(rt, GEN_ONE_REG, rd, 0, 0x25), rd);
+				rt = rd;
+			}
+			gen_emit(g, enc_r(rs, rt, 0, 0, (kind == GEN_MUL ? 0x18 : 0x1A) + gen_below(g, 2)), 0);
+			rd = gen_register(g);
+			gen_emit(g, enc_r(0, 0, rd, 0, gen_below(g, 2) ? 0x10 : 0x12), rd);
+			break;
+		case GEN_FP:
+			gen_emit(g, enc_fp(fp[gen_below(g, 4)], gen_below(g, GEN_FP_REGS), gen_below(g, GEN_FP_REGS), gen_below(g, GEN_FP_REGS)), 0);
+			break;
+	}
+}
+
+/***************************************************************/
+/* Nops for the pipeline to fill, registers and FPRs with values, the  */
+/* body, then exit through SYSCALL behind nops so ID sees $v0 = 10     */
+/***************************************************************/
+static void generate(const Gen_Config *c, FILE *out) {
+	Gen_State g;
+	uint32_t i, mask;
+
+	memset(&g, 0, sizeof(g));
+	g.out = out;
+	g.binary = c->binary;
+	g.state = 0x9E3779B97F4A7C15ULL ^ c->seed;
+	g.window = c->working_set < GEN_WINDOW ? c->working_set : GEN_WINDOW;
+	mask = c->working_set - g.window;
+
+	for (i = 0; i < 4; i++) {
+		gen_emit(&g, 0, 0);
+	}
+	gen_emit(&g, enc_i(0xF, 0, GEN_BASE_REG, MEM_DATA_BEGIN >> 16), 0);
+	if (mask >= 0x8000) {
+		gen_emit(&g, enc_i(0xF, 0, GEN_MASK_REG, c->working_set >> 16), 0);
+		gen_emit(&g, enc_i(0x9, GEN_MASK_REG, GEN_MASK_REG, -g.window), 0);
+	}
+	else {
+		gen_emit(&g, enc_i(0x9, 0, GEN_MASK_REG, mask), 0);
+	}
+	gen_emit(&g, enc_r(GEN_BASE_REG, 0, GEN_ADDRESS_REG, 0, 0x21), 0);
+	gen_emit(&g, enc_i(0x9, 0, GEN_ONE_REG, 1), 0);
+	for (i = GEN_FIRST_REG; i <= GEN_LAST_REG; i++) {
+		gen_emit(&g, enc_i(0x9, 0, i, 1 + gen_below(&g, 0x7FFF)), 0);
+	}
+	for (i = 0; c->mix[GEN_FP] && i < GEN_FP_REGS; i++) {
+		gen_emit(&g, (0x11 << 26) | (0x04 << 21) | ((GEN_FIRST_REG + i) << 16) | (i << 11), 0);
+	}
+	memset(g.recent, 0, sizeof(g.recent));
+
+	for (i = 0; i < c->count; i++) {
+		gen_instruction(&g, c);
+	}
+
+	gen_emit(&g, enc_i(0x9, 0, 2, 0xA), 2);
+	for (i = 0; i < 3; i++) {
+		gen_emit(&g, 0, 0);
+	}
+	gen_emit(&g, 0x0000000C, 0);
+
+	fprintf(stderr, "%u words:", g.written);
+	for (i = 0; i < NUM_GEN_CLASSES; i++) {
+		fprintf(stderr, " %s %llu", CLASS_NAMES[i], (unsigned long long)g.classes[i]);
+	}
+	fprintf(stderr, "\n%llu sources on a recent result, mean distance %.2f\n", (unsigned long long)g.dependent,
+		g.dependent ? (double)g.distance_sum / g.dependent : 0.0);
+}
+
+/***************************************************************/
+/* Parse "name=weight,..." into weights; FALSE on a bad item          */
+/***************************************************************/
+static int parse_mix(const char *text, uint32_t *mix) {
+	char copy[256], *item, *save, *equals;
+	int i;
+
+	snprintf(copy, sizeof(copy), "%s", text);
+	memset(mix, 0, NUM_GEN_CLASSES * sizeof(uint32_t));
+	for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+		equals = strchr(item, '=');
+		if (equals == NULL) {
+			return FALSE;
+		}
+		*equals = '\0';
+		for (i = 0; i < NUM_GEN_CLASSES && strcmp(item, CLASS_NAMES[i]) != 0; i++) {
+		}
+		if (i == NUM_GEN_CLASSES) {
+			return FALSE;
+		}
+		mix[i] = strtoul(equals + 1, NULL, 0);
+	}
+	return TRUE;
+}
+
+/* "distance=weight,..." with distances 0..GEN_MAX_DISTANCE */
+static int parse_distance(const char *text, uint32_t *distance) {
+	char copy[256], *item, *save, *equals;
+	uint32_t d;
+
+	snprintf(copy, sizeof(copy), "%s", text);
+	memset(distance, 0, (GEN_MAX_DISTANCE + 1) * sizeof(uint32_t));
+	for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+		equals = strchr(item, '=');
+		d = strtoul(item, NULL, 0);
+		if (equals == NULL || d > GEN_MAX_DISTANCE) {
+			return FALSE;
+		}
+		distance[d] = strtoul(equals + 1, NULL, 0);
+	}
+	return TRUE;
+}
+
+static void usage(const char *name) {
+	printf("Usage: %s [options] [output file]\n", name);
+	printf("  -n <count>\tbody instructions (default 10000)\n");
+	printf("  -m <mix>\tclass weights, e.g. alu=40,imm=20,load=20,store=15,mul=5,div=0,fp=0\n");
+	printf("  -d <dist>\tdependency distance weights, e.g. 1=30,2=20,3=15,4=10,0=25; 0 = any register\n");
+	printf("  -l <percent>\tloads whose result the next instruction reads (default 20)\n");
+	printf("  -w <bytes>\tdata working set, rounded up to a power of two (default 4096)\n");
+	printf("  -s <seed>\trandom seed (default 1)\n");
+	printf("  -b\t\twrite little-endian binary words instead of hex lines\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	Gen_Config c;
+	FILE *out = stdout;
+	uint32_t ws = 4096;
+	int opt;
+
+	memset(&c, 0, sizeof(c));
+	c.count = 10000;
+	c.seed = 1;
+	c.load_use = 20;
+	parse_mix("alu=40,imm=20,load=20,store=15,mul=5", c.mix);
+	parse_distance("1=30,2=20,3=15,4=10,0=25", c.distance);
+
+	while ((opt = getopt(argc, argv, "n:m:d:l:w:s:bh")) != -1) {
+		switch (opt) {
+			case 'n':
+				c.count = strtoul(optarg, NULL, 0);
+				break;
+			case 'm':
+				if (!parse_mix(optarg, c.mix)) {
+					printf("Error: bad mix %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'd':
+				if (!parse_distance(optarg, c.distance)) {
+					printf("Error: bad distances %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'l':
+				c.load_use = strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				ws = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				c.seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'b':
+				c.binary = TRUE;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	/*at least a word, at most 16 MB of the data segment*/
+	for (c.working_set = 4; c.working_set < ws && c.working_set < (1u << 24); c.working_set <<= 1) {
+	}
+	if (optind < argc) {
+		out = fopen(argv[optind], c.binary ? "wb" : "w");
+		if (out == NULL) {
+			printf("Error: Can't open %s\n", argv[optind]);
+			exit(1);
+		}
+	}
+	generate(&c, out);
+	if (out != stdout) {
+		fclose(out);
+	}
+	return 0;
+}
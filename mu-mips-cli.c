@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+void help();
+void handle_command();
+void debug_command(const char *kind, const char *what);
+
+/***************************************************************/
+/* Print out a list of commands available                                                                  */
+/***************************************************************/
+void help() {        
+	printf("------------------------------------------------------------------\n\n");
+	printf("\t**********MU-MIPS Help MENU**********\n\n");
+	printf("sim\t-- simulate program to completion \n");
+	printf("run <n>\t-- simulate program for <n> instructions\n");
+	printf("rdump\t-- dump register values\n");
+	printf("rdiff\t-- dump registers changed since the last dump or mark\n");
+	printf("reset\t-- clears all registers/memory and re-loads the program\n");
+	printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
+	printf("mdump <start> <stop>\t-- dump memory from <start> to <stop> address\n");
+	printf("mdiff <start> <stop>\t-- dump memory pages written since the last dump or mark\n");
+	printf("bdiff <start> <stop> <file>\t-- write changed registers and memory pages to <file> in binary\n");
+	printf("mark\t-- forget changes so far; following diffs start from here\n");
+	printf("high <val>\t-- set the HI register to <val>\n");
+	printf("low <val>\t-- set the LO register to <val>\n");
+	printf("print\t-- print the program loaded into memory\n");
+	printf("show\t-- print the current content of the pipeline registers\n");
+	printf("f x\t -- Turn forwarding flag ON: x = 1, Turn forwarding flag OFF: x = 0\n");
+	printf("fpu <unit> <cycles>\t-- set the latency of the FP add, mul, div or sqrt unit\n");
+	printf("break pc <addr> | cycle <n> | stall | list\t-- stop the simulation at a PC, cycle or pipeline stall\n");
+	printf("watch reg <reg> <val> | mem <addr>\t-- stop when <reg> becomes <val> or the word at <addr> is written\n");
+	printf("delete\t-- remove all breakpoints and watchpoints\n");
+	printf("checkpoint <n>\t-- take a checkpoint every <n> cycles so that back works, 0 = off\n");
+	printf("back <n>\t-- step the simulation back by <n> cycles\n");
+	printf("batch <k> <reg> <first> <step> | show <reg> | off\t-- run the program in <k> lanes, lane i starting with <reg> = <first> + i * <step> (32 = HI, 33 = LO)\n");
+	printf("barrel <t> [rr | stall]\t-- run to completion on a core interleaving <t> hardware threads, thread i with $a0 = i; fetch round-robin or skipping threads about to stall\n");
+	printf("decouple [file]\t-- run to completion with execution and timing on separate threads; save the instruction trace to [file]\n");
+	printf("replay <file> [config ...]\t-- time a saved trace under each config at once, e.g. f0 f1,mul=3,div=12; default: the current settings\n");
+	printf("sample <period> <warm-up> <window>\t-- estimate CPI from a detailed window every <period> instructions\n");
+	printf("stats <k> <file> <x> | off\t-- write IPC, stalls by cause, forwards and memory accesses every <k> cycles as CSV (JSON for .json); x = 1 writes on a background thread\n");
+	printf("profile on | off | report\t-- charge cycles and ID stalls to instructions; print an annotated listing by basic block\n");
+	printf("cache <line> | report | off\t-- record LRU stack distances of <line>-byte lines; report miss rates for all cache shapes\n");
+	printf("hostprof <n> | off | report\t-- time the pipeline stages on the host every <n>th cycle\n");
+	printf("monitor <name> <k> | off\t-- publish counters to shared memory <name> every <k> cycles for mumips-top\n");
+	printf("memo x\t-- replay the ID stall decision of an earlier cycle in the same timing state: x = 1 ON, x = 0 OFF; prints hits and misses\n");
+	printf("skip x\t-- jump over cycles frozen on the FP scoreboard: x = 1 ON (default), x = 0 OFF; prints jumps and cycles skipped\n");
+	printf("mmu <entries> [cost] | off | report\t-- translate user loads and stores through a TLB of 1-%d entries refilled from ktext, each waiting [cost] cycles in ID\n", TLB_MAX_ENTRIES);
+	printf("sb <entries> [latency] [lazy] | off | report\t-- buffer stores in up to %d entries written to memory every [latency] cycles, always or only when full; loads read buffered bytes\n", STORE_BUFFER_MAX);
+	printf("cosim x\t-- check the pipeline against the reference model: x = 1 ON, x = 0 OFF\n");
+	printf("?\t-- display help menu\n");
+	printf("quit\t-- exit the simulator\n\n");
+	printf("------------------------------------------------------------------\n\n");
+}
+
+/***************************************************************/
+/* Parse the arguments of a break/watch command                                      */
+/***************************************************************/
+void debug_command(const char *kind, const char *what) {
+	uint32_t a, b;
+
+	if (strcmp(kind, "break") == 0 && strcmp(what, "list") == 0) {
+		debug_list();
+	}
+	else if (strcmp(kind, "break") == 0 && strcmp(what, "stall") == 0) {
+		debug_break_stall();
+	}
+	else if (strcmp(kind, "break") == 0 && strcmp(what, "pc") == 0 && scanf("%x", &a) == 1) {
+		debug_break_pc(a);
+	}
+	else if (strcmp(kind, "break") == 0 && strcmp(what, "cycle") == 0 && scanf("%u", &a) == 1) {
+		debug_break_cycle(a);
+	}
+	else if (strcmp(kind, "watch") == 0 && strcmp(what, "reg") == 0 && scanf("%u %i", &a, &b) == 2 && a < MIPS_REGS) {
+		debug_watch_reg(a, b);
+	}
+	else if (strcmp(kind, "watch") == 0 && strcmp(what, "mem") == 0 && scanf("%x", &a) == 1 && debug_watch_mem(a)) {
+	}
+	else {
+		printf("Invalid %s command.\n", kind);
+	}
+}
+
+/***************************************************************/
+/* Read a command from standard input.                                                               */  
+/***************************************************************/
+void handle_command() {                         
+	char buffer[20];
+	char file[256];
+	uint32_t start, stop, cycles;
+	uint32_t register_no;
+	int register_value;
+	int hi_reg_value, lo_reg_value;
+
+	printf("MU-MIPS SIM:> ");
+
+	if (scanf("%s", buffer) == EOF){
+		exit(0);
+	}
+
+	switch(buffer[0]) {
+		case 'S':
+		case 's':
+			if (buffer[1] == 'h' || buffer[1] == 'H'){
+				show_pipeline();
+			}else if (buffer[1] == 't' || buffer[1] == 'T'){
+				if (scanf("%19s", file) != 1) {
+					break;
+				}
+				if (strcmp(file, "off") == 0) {
+					interval_stats_close();
+				}
+				else if (sscanf(file, "%u", &cycles) == 1 && scanf("%255s %d", file, &register_value) == 2) {
+					if (interval_stats_open(cycles, file, register_value)) {
+						printf("Writing statistics every %u cycles to %s\n", cycles, file);
+					}
+				}
+				else {
+					printf("Invalid stats command.\n");
+				}
+			}else if (buffer[1] == 'k' || buffer[1] == 'K'){
+				if (scanf("%d", &register_value) == 1) {
+					printf("Idle-cycle skipping: %llu jumps over %llu cycles\n", (unsigned long long)EVENTS.skips, (unsigned long long)EVENTS.skipped);
+					event_skip_enable(register_value);
+					EVENTS.enabled == 0 ? printf("Idle-cycle skipping OFF\n") : printf("Idle-cycle skipping ON\n");
+				}
+			}else if (buffer[1] == 'a' || buffer[1] == 'A'){
+				if (scanf("%u %u %u", &start, &stop, &cycles) == 3) {
+					sample(start, stop, cycles);
+				}
+			}else if (buffer[1] == 'b' || buffer[1] == 'B'){
+				if (scanf("%255s", file) != 1) {
+					break;
+				}
+				if (strcmp(file, "report") == 0) {
+					store_buffer_report();
+				}
+				else if (strcmp(file, "off") == 0) {
+					store_buffer_enable(0, 0, SB_DRAIN_EAGER);
+					printf("Store buffer OFF\n");
+				}
+				else if (COSIM_FLAG) {
+					printf("The reference model does not buffer stores; turn co-simulation off first\n");
+				}
+				else {
+					register_no = strtoul(file, NULL, 0);
+					if (scanf("%255[^\n]", file) != 1) {
+						file[0] = '\0';
+					}
+					if (sscanf(file, "%u", &cycles) != 1) {
+						cycles = 1;
+					}
+					if (register_no && store_buffer_enable(register_no, cycles, strstr(file, "lazy") ? SB_DRAIN_LAZY : SB_DRAIN_EAGER)) {
+						printf("Store buffer ON: %u entries, %u cycle%s per write, %s drain\n", STORE_BUFFER.size, STORE_BUFFER.latency,
+							STORE_BUFFER.latency == 1 ? "" : "s", STORE_BUFFER.policy == SB_DRAIN_LAZY ? "lazy" : "eager");
+					}
+					else {
+						printf("Invalid sb command.\n");
+					}
+				}
+			}else {
+				runAll(); 
+			}
+			break;
+		case 'M':
+		case 'm':
+			if (buffer[1] == 'm' || buffer[1] == 'M'){
+				if (scanf("%255s", file) != 1) {
+					break;
+				}
+				if (strcmp(file, "report") == 0) {
+					mmu_report();
+				}
+				else if (strcmp(file, "off") == 0) {
+					mmu_disable();
+					printf("MMU OFF\n");
+				}
+				else if (COSIM_FLAG) {
+					printf("The reference model does not translate; turn co-simulation off first\n");
+				}
+				else {
+					register_no = strtoul(file, NULL, 0);
+					if (scanf("%255[^\n]", file) != 1) {
+						file[0] = '\0';
+					}
+					if (mmu_enable(register_no, strtoul(file, NULL, 0))) {
+						printf("MMU ON: %u-entry TLB, %u cycle%s per user load or store\n", MMU.entries, MMU.cost, MMU.cost == 1 ? "" : "s");
+					}
+					else {
+						printf("Invalid mmu command.\n");
+					}
+				}
+				break;
+			}
+			if (buffer[1] == 'e' || buffer[1] == 'E'){
+				if (scanf("%d", &register_value) == 1) {
+					printf("ID memo: %llu hits, %llu misses\n", (unsigned long long)CYCLE_MEMO.hits, (unsigned long long)CYCLE_MEMO.misses);
+					memo_enable(register_value);
+					CYCLE_MEMO.enabled == 0 ? printf("ID memo OFF\n") : printf("ID memo ON\n");
+				}
+				break;
+			}
+			if (buffer[1] == 'a' || buffer[1] == 'A'){
+				dump_mark();
+				break;
+			}
+			if (buffer[1] == 'o' || buffer[1] == 'O'){
+				if (scanf("%255s", file) != 1) {
+					break;
+				}
+				if (strcmp(file, "off") == 0) {
+					monitor_close();
+				}
+				else if (scanf("%u", &cycles) == 1 && monitor_open(file, cycles)) {
+					printf("Publishing metrics to %s every %u cycles\n", MONITOR.name, cycles);
+				}
+				break;
+			}
+			if (scanf("%x %x", &start, &stop) != 2){
+				break;
+			}
+			if (buffer[2] == 'i' || buffer[2] == 'I'){
+				mdiff(start, stop);
+			}else {
+				mdump(start, stop);
+			}
+			break;
+		case 'B':
+		case 'b':
+			if ((buffer[1] == 'a' || buffer[1] == 'A') && (buffer[2] == 't' || buffer[2] == 'T')){
+				if (scanf("%255s", file) != 1) {
+					break;
+				}
+				if (strcmp(file, "off") == 0) {
+					batch_close();
+				}
+				else if (strcmp(file, "show") == 0) {
+					if (scanf("%u", &register_no) == 1) {
+						batch_show(register_no);
+					}
+				}
+				else if (scanf("%u %i %i", &register_no, &start, &stop) == 3 && batch_open(strtoul(file, NULL, 0))) {
+					for (cycles = 0; cycles < BATCH.lanes; cycles++) {
+						batch_set_reg(cycles, register_no, start + cycles * stop);
+					}
+					batch_run();
+					batch_report();
+				}
+				break;
+			}
+			if ((buffer[1] == 'a' || buffer[1] == 'A') && (buffer[2] == 'r' || buffer[2] == 'R')){
+				if (scanf("%u", &cycles) == 1) {
+					if (scanf("%255[^\n]", file) != 1) {
+						file[0] = '\0';
+					}
+					barrel_run(cycles, strstr(file, "stall") ? BARREL_STALL_AWARE : BARREL_ROUND_ROBIN);
+				}
+				break;
+			}
+			if (buffer[1] == 'a' || buffer[1] == 'A'){
+				if (scanf("%u", &cycles) == 1) {
+					back(cycles);
+				}
+				break;
+			}
+			if (buffer[1] == 'r' || buffer[1] == 'R'){
+				if (scanf("%19s", file) == 1) {
+					debug_command("break", file);
+				}
+				break;
+			}
+			if (scanf("%x %x %255s", &start, &stop, file) != 3){
+				break;
+			}
+			bdiff(start, stop, file);
+			break;
+		case '?':
+			help();
+			break;
+		case 'Q':
+		case 'q':
+			printf("**************************\n");
+			printf("Exiting MU-MIPS! Good Bye...\n");
+			printf("**************************\n");
+			exit(0);
+		case 'R':
+		case 'r':
+			if ((buffer[1] == 'd' || buffer[1] == 'D') && (buffer[2] == 'i' || buffer[2] == 'I')){
+				rdiff();
+			}else if (buffer[1] == 'd' || buffer[1] == 'D'){
+				rdump();
+			}else if((buffer[1] == 'e' || buffer[1] == 'E') && (buffer[2] == 'p' || buffer[2] == 'P')){
+				if (scanf("%255s", file) == 1) {
+					char configs[256];
+
+					if (scanf("%255[^\n]", configs) != 1) {
+						configs[0] = '\0';
+					}
+					trace_replay(file, configs);
+				}
+			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
+				reset();
+			}
+			else {
+				if (scanf("%d", &cycles) != 1) {
+					break;
+				}
+				run(cycles);
+			}
+			break;
+		case 'I':
+		case 'i':
+			if (scanf("%u %i", &register_no, &register_value) != 2){
+				break;
+			}
+			CURRENT_STATE.REGS[register_no] = register_value;
+			break;
+		case 'H':
+		case 'h':
+			if (buffer[1] == 'o' || buffer[1] == 'O'){
+				if (scanf("%255s", file) != 1) {
+					break;
+				}
+				if (strcmp(file, "report") == 0) {
+					host_profile_report();
+				}
+				else if (strcmp(file, "off") == 0) {
+					host_profile_enable(0);
+				}
+				else if (sscanf(file, "%u", &cycles) == 1) {
+					host_profile_enable(cycles);
+					printf("Host profile timing 1 in %u cycles\n", cycles);
+				}
+				break;
+			}
+			if (scanf("%i", &hi_reg_value) != 1){
+				break;
+			}
+			CURRENT_STATE.HI = hi_reg_value; 
+			break;
+		case 'L':
+		case 'l':
+			if (scanf("%i", &lo_reg_value) != 1){
+				break;
+			}
+			CURRENT_STATE.LO = lo_reg_value;
+			break;
+		case 'P':
+		case 'p':
+			if (buffer[1] == 'r' || buffer[1] == 'R'){
+				if (buffer[2] == 'o' || buffer[2] == 'O'){
+					if (scanf("%19s", file) != 1) {
+						break;
+					}
+					if (strcmp(file, "report") == 0) {
+						profile_report();
+					}
+					else if (strcmp(file, "on") == 0 || strcmp(file, "off") == 0) {
+						profile_enable(strcmp(file, "on") == 0);
+						PROFILE.enabled == 0 ? printf("Profiler OFF\n") : printf("Profiler ON\n");
+					}
+					else {
+						printf("Invalid profile command.\n");
+					}
+					break;
+				}
+			}
+			print_program(); 
+			break;
+		case 'W':
+		case 'w':
+			if (scanf("%19s", file) == 1) {
+				debug_command("watch", file);
+			}
+			break;
+		case 'D':
+		case 'd':
+			if ((buffer[1] == 'e' || buffer[1] == 'E') && (buffer[2] == 'c' || buffer[2] == 'C')){
+				/*an optional file name follows on the same line*/
+				if (scanf("%255[^\n]", file) != 1) {
+					file[0] = '\0';
+				}
+				decoupled_run(strtok(file, " \t"));
+				break;
+			}
+			if (strcasecmp(buffer, "delete") != 0) {
+				printf("Invalid Command.\n");
+				break;
+			}
+			debug_clear();
+			printf("All breakpoints and watchpoints deleted\n");
+			break;
+		case 'C':
+		case 'c':
+			if (buffer[1] == 'h' || buffer[1] == 'H'){
+				if (scanf("%u", &cycles) == 1) {
+					checkpoint_enable(cycles);
+				}
+				break;
+			}
+			if (buffer[1] == 'a' || buffer[1] == 'A'){
+				if (scanf("%19s", file) != 1) {
+					break;
+				}
+				if (strcmp(file, "report") == 0) {
+					cache_analysis_report();
+				}
+				else if (strcmp(file, "off") == 0) {
+					cache_analysis_enable(0);
+				}
+				else if (sscanf(file, "%u", &cycles) == 1 && cycles >= 4 && (cycles & (cycles - 1)) == 0) {
+					cache_analysis_enable(cycles);
+					printf("Recording %u-byte cache lines\n", cycles);
+				}
+				else {
+					printf("Invalid cache command.\n");
+				}
+				break;
+			}
+			if (scanf("%d", &register_value) != 1) {
+				break;
+			}
+			if (register_value && MMU.enabled) {
+				printf("The reference model does not translate; turn the MMU off first\n");
+				break;
+			}
+			if (register_value && STORE_BUFFER.enabled) {
+				printf("The reference model does not buffer stores; turn the store buffer off first\n");
+				break;
+			}
+			cosim_enable(register_value);
+			COSIM_FLAG == 0 ? printf("Co-simulation OFF\n") : printf("Co-simulation ON\n");
+			break;
+		case 'F':
+		case 'f':
+			if (buffer[1] == 'p' || buffer[1] == 'P'){
+				if (scanf("%19s %u", file, &cycles) != 2) {
+					break;
+				}
+				if (fp_set_latency(file, cycles)) {
+					printf("FP %s latency %u cycles\n", file, cycles);
+				}
+				else {
+					printf("Unknown FP unit %s; use add, mul, div or sqrt.\n", file);
+				}
+				break;
+			}
+			if (scanf("%d", &register_value) != 1) 
+			{	
+				break;
+			}
+			set_forwarding(register_value);
+			ENABLE_FORWARDING == 0 ? printf("Forwarding OFF\n") : printf("Forwarding ON\n");
+			break;
+		default:
+			printf("Invalid Command.\n");
+			break;
+	}
+}
+
+/***************************************************************/
+/* main                                                                                                                                   */
+/***************************************************************/
+int main(int argc, char *argv[]) {                              
+	printf("\n**************************\n");
+	printf("Welcome to MU-MIPS SIM...\n");
+	printf("**************************\n\n");
+	
+	if (argc < 2) {
+		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
+		exit(1);
+	}
+
+	snprintf(prog_file, sizeof(prog_file), "%s", argv[1]);
+	initialize();
+	if (!load_program()) {
+		exit(-1);
+	}
+	help();
+	while (1){
+		handle_command();
+	}
+	return 0;
+}
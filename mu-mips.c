@@ -3,35 +3,130 @@
 #include <string.h>
 #include <stdint.h>
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #include "mu-mips.h"
 
+/* memory will be dynamically allocated at initialization */
+mem_region_t MEM_REGIONS[] = {
+	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL, NULL },
+	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL, NULL },
+	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL, NULL },
+	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL, NULL }
+};
+
+uint32_t *TOUCHED_PAGES;
+uint32_t NUM_TOUCHED_PAGES;
+static uint32_t TOUCHED_CAPACITY;
+
+/***************************************************************/
+/* CPU State info.                                                                                                               */
+/***************************************************************/
+CPU_State CURRENT_STATE;
+MMU_State MMU;
+Store_Buffer STORE_BUFFER;
+Pending_Write PENDING;
+Event_Wheel EVENTS = { TRUE };
+Cycle_Memo CYCLE_MEMO;
+Cache_Analysis CACHE_ANALYSIS;
+Profile PROFILE;
+Pipeline_Stats STATS;
+FP_Scoreboard FP_SCOREBOARD;
+uint32_t FP_LATENCY[NUM_FP_UNITS] = { 4, 7, 23, 54 };
+Interval_Stats INTERVAL;
+Monitor_State MONITOR;
+Host_Profile HOST_PROFILE;
+Batch_State BATCH;
+CPU_State DUMP_STATE;
+int RUN_FLAG;
+int ENABLE_FORWARDING;
+int ForwardA;
+int ForwardB;
+uint32_t INSTRUCTION_COUNT;
+uint32_t CYCLE_COUNT;
+uint32_t PROGRAM_SIZE;
+
+CPU_Pipeline_Reg ID_IF;
+CPU_Pipeline_Reg EX_ID;
+CPU_Pipeline_Reg MEM_EX;
+CPU_Pipeline_Reg WB_MEM;
+static uint32_t IF_REDIRECT;	/* taken BC1 target, fetched after the delay slot */
+
+char prog_file[256];
+uint32_t *PROGRAM_IMAGE;
+
+uint32_t CYCLE_HOOKS;
+Debug_State DEBUG;
+Time_Travel_State TIME_TRAVEL;
+int ENABLE_TRACE;
+
+int COSIM_FLAG;
+int COSIM_SYNC;
+uint32_t COSIM_CHECKED;
+CPU_State REF_STATE;
+Mem_Store_Record PIPE_STORE;
+
+/***************************************************************/
+/* Host time stamps for the self-profile: the TSC where there is one     */
+/***************************************************************/
+static inline uint64_t host_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+static double host_seconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* time a region only while a sampled cycle is running */
+static inline uint64_t host_time_begin()
+{
+	return __builtin_expect(HOST_PROFILE.sampling, 0) ? host_ticks() : 0;
+}
+
+static inline void host_time_end(uint64_t *total, uint64_t start)
+{
+	if (__builtin_expect(HOST_PROFILE.sampling, 0)) {
+		*total += host_ticks() - start;
+	}
+}
+
 /***************************************************************/
-/* Print out a list of commands available                                                                  */
+/* Find the memory region holding an address                                          */
 /***************************************************************/
-void help() {        
-	printf("------------------------------------------------------------------\n\n");
-	printf("\t**********MU-MIPS Help MENU**********\n\n");
-	printf("sim\t-- simulate program to completion \n");
-	printf("run <n>\t-- simulate program for <n> instructions\n");
-	printf("rdump\t-- dump register values\n");
-	printf("reset\t-- clears all registers/memory and re-loads the program\n");
-	printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
-	printf("mdump <start> <stop>\t-- dump memory from <start> to <stop> address\n");
-	printf("high <val>\t-- set the HI register to <val>\n");
-	printf("low <val>\t-- set the LO register to <val>\n");
-	printf("print\t-- print the program loaded into memory\n");
-	printf("show\t-- print the current content of the pipeline registers\n");
-	printf("f x\t -- Turn forwarding flag ON: x = 1, Turn forwarding flag OFF: x = 0");
-	printf("?\t-- display help menu\n");
-	printf("quit\t-- exit the simulator\n\n");
-	printf("------------------------------------------------------------------\n\n");
+mem_region_t *mem_region(uint32_t address)
+{
+	int i;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
+			return &MEM_REGIONS[i];
+		}
+	}
+	return NULL;
 }
 
 /***************************************************************/
 /* Read a 32-bit word from memory                                                                            */
 /***************************************************************/
-uint32_t mem_read_32(uint32_t address)
+static uint32_t mem_read_word(uint32_t address)
 {
 	int i;
 	for (i = 0; i < NUM_MEM_REGION; i++) {
@@ -46,10 +141,36 @@ uint32_t mem_read_32(uint32_t address)
 	return 0;
 }
 
+static void mem_write_word(uint32_t address, uint32_t value);
+
+/***************************************************************/
+/* Same accessors charging their host time to the profile; installed  */
+/* only for the cycles handle_pipeline_timed samples                         */
+/***************************************************************/
+static uint32_t mem_read_timed(uint32_t address)
+{
+	uint64_t start = host_ticks();
+	uint32_t value = mem_read_word(address);
+
+	HOST_PROFILE.memory += host_ticks() - start;
+	return value;
+}
+
+static void mem_write_timed(uint32_t address, uint32_t value)
+{
+	uint64_t start = host_ticks();
+
+	mem_write_word(address, value);
+	HOST_PROFILE.memory += host_ticks() - start;
+}
+
+uint32_t (*mem_read_32)(uint32_t address) = mem_read_word;
+void (*mem_write_32)(uint32_t address, uint32_t value) = mem_write_word;
+
 /***************************************************************/
 /* Write a 32-bit word to memory                                                                                */
 /***************************************************************/
-void mem_write_32(uint32_t address, uint32_t value)
+static void mem_write_word(uint32_t address, uint32_t value)
 {
 	int i;
 	uint32_t offset;
@@ -57,21 +178,213 @@ void mem_write_32(uint32_t address, uint32_t value)
 		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
 			offset = address - MEM_REGIONS[i].begin;
 
+			if (TIME_TRAVEL.logging) {
+				checkpoint_log(address, (MEM_REGIONS[i].mem[offset+3] << 24) |
+						(MEM_REGIONS[i].mem[offset+2] << 16) |
+						(MEM_REGIONS[i].mem[offset+1] <<  8) |
+						(MEM_REGIONS[i].mem[offset+0] <<  0));
+			}
 			MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
 			MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
 			MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
 			MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
+
+			if (MEM_REGIONS[i].page_flags[offset >> MEM_PAGE_SHIFT] & PAGE_WATCHED) {
+				debug_mem_write(address);
+			}
+			if (!(MEM_REGIONS[i].page_flags[offset >> MEM_PAGE_SHIFT] & PAGE_TOUCHED)) {
+				mem_touch_page(i, offset >> MEM_PAGE_SHIFT);
+			}
+			if (!(MEM_REGIONS[i].page_flags[(offset+3) >> MEM_PAGE_SHIFT] & PAGE_TOUCHED)) {
+				mem_touch_page(i, (offset+3) >> MEM_PAGE_SHIFT);
+			}
+			MEM_REGIONS[i].page_flags[offset >> MEM_PAGE_SHIFT] |= PAGE_DIRTY;
+			MEM_REGIONS[i].page_flags[(offset+3) >> MEM_PAGE_SHIFT] |= PAGE_DIRTY;
 		}
 	}
 }
 
+/***************************************************************/
+/* Remember the first write to a page since the last reset                 */
+/***************************************************************/
+void mem_touch_page(int region, uint32_t page)
+{
+	if (NUM_TOUCHED_PAGES == TOUCHED_CAPACITY) {
+		TOUCHED_CAPACITY = TOUCHED_CAPACITY ? TOUCHED_CAPACITY * 2 : 256;
+		TOUCHED_PAGES = realloc(TOUCHED_PAGES, TOUCHED_CAPACITY * sizeof(uint32_t));
+	}
+	TOUCHED_PAGES[NUM_TOUCHED_PAGES++] = ((uint32_t)region << 24) | page;
+	MEM_REGIONS[region].page_flags[page] |= PAGE_TOUCHED;
+}
+
+/***************************************************************/
+/* Store a word from the MEM stage, recording it for co-simulation             */
+/***************************************************************/
+void mem_store(uint32_t address, uint32_t value)
+{
+	if (COSIM_FLAG) {
+		PIPE_STORE.valid = TRUE;
+		PIPE_STORE.address = address;
+		PIPE_STORE.old_value = mem_read_32(address);
+		PIPE_STORE.new_value = value;
+	}
+	mem_write_32(address, value);
+}
+
+/***************************************************************/
+/* Queue a writeback; visible in CURRENT_STATE from next cycle        */
+/***************************************************************/
+static inline void wb_write_reg(uint32_t reg, uint32_t value) {
+	PENDING.flags |= PENDING_REG;
+	PENDING.reg = reg;
+	PENDING.value = value;
+}
+
+static inline void wb_write_hi(uint32_t value) {
+	PENDING.flags |= PENDING_HI;
+	PENDING.hi = value;
+}
+
+static inline void wb_write_lo(uint32_t value) {
+	PENDING.flags |= PENDING_LO;
+	PENDING.lo = value;
+}
+
+static inline void wb_write_fpr(uint32_t fpr, uint64_t value, int pair) {
+	PENDING.flags |= pair ? PENDING_FPR_PAIR : PENDING_FPR;
+	PENDING.fpr = fpr;
+	PENDING.fvalue = value;
+}
+
+static inline void wb_write_fcsr(uint32_t value) {
+	PENDING.flags |= PENDING_FCSR;
+	PENDING.fcsr = value;
+}
+
+/***************************************************************/
+/* Register file as it will be after this cycle's writeback         */
+/***************************************************************/
+static inline uint32_t next_reg(uint32_t reg) {
+	return ((PENDING.flags & PENDING_REG) && PENDING.reg == reg) ? PENDING.value : CURRENT_STATE.REGS[reg];
+}
+
+static inline uint32_t next_hi() {
+	return (PENDING.flags & PENDING_HI) ? PENDING.hi : CURRENT_STATE.HI;
+}
+
+static inline uint32_t next_lo() {
+	return (PENDING.flags & PENDING_LO) ? PENDING.lo : CURRENT_STATE.LO;
+}
+
+static inline uint32_t next_fpr(uint32_t fpr) {
+	if ((PENDING.flags & PENDING_FPR) && PENDING.fpr == fpr) {
+		return (uint32_t)PENDING.fvalue;
+	}
+	if ((PENDING.flags & PENDING_FPR_PAIR) && PENDING.fpr == (fpr & ~1)) {
+		return (uint32_t)(PENDING.fvalue >> (fpr & 1 ? 32 : 0));
+	}
+	return CURRENT_STATE.FPR[fpr];
+}
+
+static inline uint64_t next_fp_operand(uint32_t fpr, int pair) {
+	return pair ? ((uint64_t)next_fpr((fpr & 0x1E) + 1) << 32) | next_fpr(fpr & 0x1E) : next_fpr(fpr);
+}
+
+static inline uint32_t next_fcsr() {
+	return (PENDING.flags & PENDING_FCSR) ? PENDING.fcsr : CURRENT_STATE.FCSR;
+}
+
+/***************************************************************/
+/* Commit this cycle's writeback to the register file                             */
+/***************************************************************/
+void pending_apply() {
+	if (PENDING.flags & PENDING_REG) {
+		CURRENT_STATE.REGS[PENDING.reg] = PENDING.value;
+	}
+	if (PENDING.flags & PENDING_HI) {
+		CURRENT_STATE.HI = PENDING.hi;
+	}
+	if (PENDING.flags & PENDING_LO) {
+		CURRENT_STATE.LO = PENDING.lo;
+	}
+	if (PENDING.flags & PENDING_FPR) {
+		CURRENT_STATE.FPR[PENDING.fpr] = (uint32_t)PENDING.fvalue;
+	}
+	if (PENDING.flags & PENDING_FPR_PAIR) {
+		CURRENT_STATE.FPR[PENDING.fpr] = (uint32_t)PENDING.fvalue;
+		CURRENT_STATE.FPR[PENDING.fpr + 1] = (uint32_t)(PENDING.fvalue >> 32);
+	}
+	if (PENDING.flags & PENDING_FCSR) {
+		CURRENT_STATE.FCSR = PENDING.fcsr;
+	}
+	PENDING.flags = 0;
+}
+
 /***************************************************************/
 /* Execute one cycle                                                                                                              */
 /***************************************************************/
 void cycle() {                                                
 	handle_pipeline();
-	CURRENT_STATE = NEXT_STATE;
+	if (PENDING.flags) {
+		pending_apply();
+	}
 	CYCLE_COUNT++;
+	if (__builtin_expect(CYCLE_HOOKS != 0, 0)) {
+		cycle_hooks();
+	}
+}
+
+/***************************************************************/
+/* Execute one cycle, then jump over the cycles the pipeline would      */
+/* spend frozen on the FP scoreboard, up to limit cycles in all; returns */
+/* the cycles simulated                                                                  */
+/***************************************************************/
+uint32_t cycle_skip(uint32_t limit) {
+	uint32_t next, skip, i;
+
+	EVENTS.frozen = FALSE;
+	cycle();
+	if (__builtin_expect(!EVENTS.frozen, 1) || limit <= 1 || CYCLE_HOOKS != 0 || HOST_PROFILE.enabled) {
+		return 1;
+	}
+	next = event_next(CYCLE_COUNT);
+	if (next <= CYCLE_COUNT) {
+		return 1;
+	}
+	skip = next - CYCLE_COUNT < limit - 1 ? next - CYCLE_COUNT : limit - 1;
+
+	/*every skipped cycle is the stall the last one was*/
+	CYCLE_COUNT += skip;
+	STATS.stalls[__builtin_ctz(STALL_FP)] += skip;
+	for (i = 0; __builtin_expect(ENABLE_TRACE || PROFILE.enabled, 0) && i < skip; i++) {
+		if (ENABLE_TRACE) {
+			printf("STALL\n");
+		}
+		if (PROFILE.enabled) {
+			profile_stall(ID_IF.PC);
+		}
+	}
+	EVENTS.skips++;
+	EVENTS.skipped += skip;
+	return 1 + skip;
+}
+
+/***************************************************************/
+/* Run the per-cycle observers that are armed                                         */
+/***************************************************************/
+void cycle_hooks() {
+	if (CYCLE_HOOKS & HOOK_DEBUG) {
+		debug_check();
+	}
+	if ((CYCLE_HOOKS & HOOK_CHECKPOINT) && CYCLE_COUNT >= TIME_TRAVEL.next_cycle) {
+		checkpoint_take();
+	}
+	if ((CYCLE_HOOKS & HOOK_INTERVAL) && (CYCLE_COUNT >= INTERVAL.next_cycle || RUN_FLAG == FALSE)) {
+		interval_stats_emit();
+	}
+	if ((CYCLE_HOOKS & HOOK_MONITOR) && (CYCLE_COUNT >= MONITOR.next_cycle || RUN_FLAG == FALSE)) {
+		monitor_publish();
+	}
 }
 
 /***************************************************************/
@@ -86,12 +399,15 @@ void run(int num_cycles) {
 
 	printf("Running simulator for %d cycles...\n\n", num_cycles);
 	int i;
-	for (i = 0; i < num_cycles; i++) {
+	DEBUG.hit = FALSE;
+	for (i = 0; i < num_cycles; ) {
 		if (RUN_FLAG == FALSE) {
-			printf("Simulation Stopped.\n\n");
 			break;
 		}
-		cycle();
+		i += cycle_skip(num_cycles - i);
+	}
+	if (debug_resume() == FALSE && RUN_FLAG == FALSE) {
+		printf("Simulation Stopped.\n\n");
 	}
 }
 
@@ -105,25 +421,127 @@ void runAll() {
 	}
 
 	printf("Simulation Started...\n\n");
+	DEBUG.hit = FALSE;
 	while (RUN_FLAG){
-		cycle();
+		cycle_skip(UINT32_MAX);
+	}
+	if (debug_resume()) {
+		return;
 	}
 	printf("Simulation Finished.\n\n");
+	if (COSIM_FLAG) {
+		printf("Co-simulation: %u retired instructions matched the reference model.\n\n", COSIM_CHECKED);
+	}
+}
+
+/***************************************************************/
+/* Format helpers for bulk dumps                                                                     */
+/***************************************************************/
+#define DUMP_BUFFER_SIZE 65536
+#define DUMP_LINE_MAX 64
+
+static char *fmt_hex32(char *p, uint32_t value)
+{
+	static const char digits[] = "0123456789abcdef";
+	int shift;
+	for (shift = 28; shift >= 0; shift -= 4) {
+		*p++ = digits[(value >> shift) & 0xF];
+	}
+	return p;
+}
+
+static char *fmt_dec32(char *p, int32_t value)
+{
+	char tmp[12];
+	int64_t v = value;
+	int n = 0;
+	if (v < 0) {
+		*p++ = '-';
+		v = -v;
+	}
+	do {
+		tmp[n++] = '0' + (v % 10);
+		v /= 10;
+	} while (v != 0);
+	while (n > 0) {
+		*p++ = tmp[--n];
+	}
+	return p;
+}
+
+/***************************************************************/
+/* Format words of [start, stop] into one buffer, optionally only the         */
+/* words on dirty pages, and clear the dirty flag of fully dumped pages   */
+/***************************************************************/
+static void dump_words(uint32_t start, uint32_t stop, int dirty_only)
+{
+	char buffer[DUMP_BUFFER_SIZE];
+	char *p = buffer;
+	uint32_t address, next, offset;
+	mem_region_t *region;
+
+	for (address = start; address <= stop && address >= start; address += 4) {
+		region = mem_region(address);
+		if (dirty_only && (region == NULL || !(region->page_flags[(address - region->begin) >> MEM_PAGE_SHIFT] & PAGE_DIRTY))) {
+			/*skip the rest of the page, staying word aligned with start*/
+			next = ((address >> MEM_PAGE_SHIFT) + 1) << MEM_PAGE_SHIFT;
+			if (next == 0) {
+				break;
+			}
+			address += ((next - address + 3) & ~3) - 4;
+			continue;
+		}
+		*p++ = '\t'; *p++ = '0'; *p++ = 'x';
+		p = fmt_hex32(p, address);
+		*p++ = ' '; *p++ = '(';
+		p = fmt_dec32(p, (int32_t)address);
+		memcpy(p, ") :\t0x", 6);
+		p = fmt_hex32(p + 6, mem_read_32(address));
+		*p++ = '\n';
+		if (p > buffer + DUMP_BUFFER_SIZE - DUMP_LINE_MAX) {
+			fwrite(buffer, 1, p - buffer, stdout);
+			p = buffer;
+		}
+	}
+	fwrite(buffer, 1, p - buffer, stdout);
+
+	/*forget the changes of every page completely covered by the dump*/
+	for (address = start; address <= stop && address >= start; address = next) {
+		next = ((address >> MEM_PAGE_SHIFT) + 1) << MEM_PAGE_SHIFT;
+		region = mem_region(address);
+		if (region != NULL && (address & (MEM_PAGE_SIZE - 1)) < 4 && (next == 0 || next - 1 <= stop + 3)) {
+			offset = address - region->begin;
+			region->page_flags[offset >> MEM_PAGE_SHIFT] &= ~PAGE_DIRTY;
+		}
+		if (next == 0) {
+			break;
+		}
+	}
 }
 
 /***************************************************************/ 
 /* Dump a word-aligned region of memory to the terminal                              */
 /***************************************************************/
 void mdump(uint32_t start, uint32_t stop) {          
-	uint32_t address;
-
 	printf("-------------------------------------------------------------\n");
 	printf("Memory content [0x%08x..0x%08x] :\n", start, stop);
 	printf("-------------------------------------------------------------\n");
 	printf("\t[Address in Hex (Dec) ]\t[Value]\n");
-	for (address = start; address <= stop; address += 4){
-		printf("\t0x%08x (%d) :\t0x%08x\n", address, address, mem_read_32(address));
-	}
+	fflush(stdout);
+	dump_words(start, stop, FALSE);
+	printf("\n");
+}
+
+/***************************************************************/ 
+/* Dump the words of pages written since the last dump or mark           */
+/***************************************************************/
+void mdiff(uint32_t start, uint32_t stop) {          
+	printf("-------------------------------------------------------------\n");
+	printf("Memory changes [0x%08x..0x%08x] :\n", start, stop);
+	printf("-------------------------------------------------------------\n");
+	printf("\t[Address in Hex (Dec) ]\t[Value]\n");
+	fflush(stdout);
+	dump_words(start, stop, TRUE);
 	printf("\n");
 }
 
@@ -148,103 +566,156 @@ void rdump() {
 	printf("[HI]\t: 0x%08x\n", CURRENT_STATE.HI);
 	printf("[LO]\t: 0x%08x\n", CURRENT_STATE.LO);
 	printf("-------------------------------------\n");
+	/*COP1 registers only once the program has used them*/
+	for (i = 0; i < MIPS_FP_REGS && CURRENT_STATE.FPR[i] == 0; i++);
+	if (i < MIPS_FP_REGS || CURRENT_STATE.FCSR != 0) {
+		for (i = 0; i < MIPS_FP_REGS; i++){
+			printf("[F%d]\t: 0x%08x\n", i, CURRENT_STATE.FPR[i]);
+		}
+		printf("[FCSR]\t: 0x%08x\n", CURRENT_STATE.FCSR);
+		printf("-------------------------------------\n");
+	}
+	DUMP_STATE = CURRENT_STATE;
 }
 
 /***************************************************************/
-/* Read a command from standard input.                                                               */  
+/* Dump registers changed since the last dump or mark                            */   
 /***************************************************************/
-void handle_command() {                         
-	char buffer[20];
-	uint32_t start, stop, cycles;
-	uint32_t register_no;
-	int register_value;
-	int hi_reg_value, lo_reg_value;
-
-	printf("MU-MIPS SIM:> ");
-
-	if (scanf("%s", buffer) == EOF){
-		exit(0);
-	}
-
-	switch(buffer[0]) {
-		case 'S':
-		case 's':
-			if (buffer[1] == 'h' || buffer[1] == 'H'){
-				show_pipeline();
-			}else {
-				runAll(); 
-			}
-			break;
-		case 'M':
-		case 'm':
-			if (scanf("%x %x", &start, &stop) != 2){
-				break;
-			}
-			mdump(start, stop);
-			break;
-		case '?':
-			help();
-			break;
-		case 'Q':
-		case 'q':
-			printf("**************************\n");
-			printf("Exiting MU-MIPS! Good Bye...\n");
-			printf("**************************\n");
-			exit(0);
-		case 'R':
-		case 'r':
-			if (buffer[1] == 'd' || buffer[1] == 'D'){
-				rdump();
-			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
-				reset();
-			}
-			else {
-				if (scanf("%d", &cycles) != 1) {
-					break;
+void rdiff() {                               
+	int i; 
+	printf("-------------------------------------\n");
+	printf("Dumping Register Changes\n");
+	printf("-------------------------------------\n");
+	printf("# Instructions Executed\t: %u\n", INSTRUCTION_COUNT);
+	printf("# Cycles Executed\t: %u\n", CYCLE_COUNT - 1);
+	printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
+	printf("-------------------------------------\n");
+	printf("[Register]\t[Value]\n");
+	printf("-------------------------------------\n");
+	for (i = 0; i < MIPS_REGS; i++){
+		if (CURRENT_STATE.REGS[i] != DUMP_STATE.REGS[i]) {
+			printf("[R%d]\t: 0x%08x\n", i, CURRENT_STATE.REGS[i]);
+		}
+	}
+	if (CURRENT_STATE.HI != DUMP_STATE.HI) {
+		printf("[HI]\t: 0x%08x\n", CURRENT_STATE.HI);
+	}
+	if (CURRENT_STATE.LO != DUMP_STATE.LO) {
+		printf("[LO]\t: 0x%08x\n", CURRENT_STATE.LO);
+	}
+	for (i = 0; i < MIPS_FP_REGS; i++){
+		if (CURRENT_STATE.FPR[i] != DUMP_STATE.FPR[i]) {
+			printf("[F%d]\t: 0x%08x\n", i, CURRENT_STATE.FPR[i]);
+		}
+	}
+	if (CURRENT_STATE.FCSR != DUMP_STATE.FCSR) {
+		printf("[FCSR]\t: 0x%08x\n", CURRENT_STATE.FCSR);
+	}
+	printf("-------------------------------------\n");
+	DUMP_STATE = CURRENT_STATE;
+}
+
+/***************************************************************/
+/* Write changed registers and memory pages to a file in binary:        */
+/* "MUDF", version, cycles, instructions, PC, a 96-bit register mask */
+/* in three words (bit 32 = HI, bit 33 = LO, bits 34-65 = F0-F31,     */
+/* bit 66 = FCSR) followed by the changed values, then runs of          */
+/* <address, word count, words> ended by a zero count                      */
+/***************************************************************/
+void bdiff(uint32_t start, uint32_t stop, const char *file) {
+	FILE *fp;
+	uint32_t header[4];
+	uint32_t mask[3] = {0, 0, 0};
+	uint32_t values[MIPS_REGS + 2 + MIPS_FP_REGS + 1];
+	uint32_t run[2];
+	uint32_t words[MEM_PAGE_SIZE / 4];
+	uint32_t address, next, offset;
+	mem_region_t *region;
+	int i, n = 0;
+
+	fp = fopen(file, "wb");
+	if (fp == NULL) {
+		printf("Error: Can't open dump file %s\n", file);
+		return;
+	}
+
+	header[0] = 2;
+	header[1] = CYCLE_COUNT;
+	header[2] = INSTRUCTION_COUNT;
+	header[3] = CURRENT_STATE.PC;
+	for (i = 0; i < MIPS_REGS; i++) {
+		if (CURRENT_STATE.REGS[i] != DUMP_STATE.REGS[i]) {
+			mask[i >> 5] |= 1u << (i & 31);
+			values[n++] = CURRENT_STATE.REGS[i];
+		}
+	}
+	if (CURRENT_STATE.HI != DUMP_STATE.HI) {
+		mask[MIPS_REGS >> 5] |= 1u << (MIPS_REGS & 31);
+		values[n++] = CURRENT_STATE.HI;
+	}
+	if (CURRENT_STATE.LO != DUMP_STATE.LO) {
+		mask[(MIPS_REGS + 1) >> 5] |= 1u << ((MIPS_REGS + 1) & 31);
+		values[n++] = CURRENT_STATE.LO;
+	}
+	for (i = 0; i < MIPS_FP_REGS; i++) {
+		if (CURRENT_STATE.FPR[i] != DUMP_STATE.FPR[i]) {
+			mask[(MIPS_REGS + 2 + i) >> 5] |= 1u << ((MIPS_REGS + 2 + i) & 31);
+			values[n++] = CURRENT_STATE.FPR[i];
+		}
+	}
+	if (CURRENT_STATE.FCSR != DUMP_STATE.FCSR) {
+		mask[(MIPS_REGS + 2 + MIPS_FP_REGS) >> 5] |= 1u << ((MIPS_REGS + 2 + MIPS_FP_REGS) & 31);
+		values[n++] = CURRENT_STATE.FCSR;
+	}
+	fwrite("MUDF", 1, 4, fp);
+	fwrite(header, sizeof(uint32_t), 4, fp);
+	fwrite(mask, sizeof(uint32_t), 3, fp);
+	fwrite(values, sizeof(uint32_t), n, fp);
+	DUMP_STATE = CURRENT_STATE;
+
+	for (address = start & ~3; address <= stop && address >= (start & ~3); address = next) {
+		next = ((address >> MEM_PAGE_SHIFT) + 1) << MEM_PAGE_SHIFT;
+		region = mem_region(address);
+		if (region != NULL) {
+			offset = address - region->begin;
+			if (region->page_flags[offset >> MEM_PAGE_SHIFT] & PAGE_DIRTY) {
+				run[0] = address;
+				run[1] = 0;
+				while ((next == 0 || address + run[1] * 4 < next) && address + run[1] * 4 <= stop && address + run[1] * 4 >= address) {
+					words[run[1]] = mem_read_32(address + run[1] * 4);
+					run[1]++;
+				}
+				fwrite(run, sizeof(uint32_t), 2, fp);
+				fwrite(words, sizeof(uint32_t), run[1], fp);
+				if ((address & (MEM_PAGE_SIZE - 1)) < 4 && (next == 0 || next - 1 <= stop + 3)) {
+					region->page_flags[offset >> MEM_PAGE_SHIFT] &= ~PAGE_DIRTY;
 				}
-				run(cycles);
-			}
-			break;
-		case 'I':
-		case 'i':
-			if (scanf("%u %i", &register_no, &register_value) != 2){
-				break;
-			}
-			CURRENT_STATE.REGS[register_no] = register_value;
-			NEXT_STATE.REGS[register_no] = register_value;
-			break;
-		case 'H':
-		case 'h':
-			if (scanf("%i", &hi_reg_value) != 1){
-				break;
-			}
-			CURRENT_STATE.HI = hi_reg_value; 
-			NEXT_STATE.HI = hi_reg_value; 
-			break;
-		case 'L':
-		case 'l':
-			if (scanf("%i", &lo_reg_value) != 1){
-				break;
-			}
-			CURRENT_STATE.LO = lo_reg_value;
-			NEXT_STATE.LO = lo_reg_value;
-			break;
-		case 'P':
-		case 'p':
-			print_program(); 
-			break;
-		case 'F':
-		case 'f':
-			if (scanf("%d", &ENABLE_FORWARDING) != 1) 
-			{	
-				break;
 			}
-			ENABLE_FORWARDING == 0 ? printf("Forwarding OFF\n") : printf("Forwarding ON\n");
-			break;
-		default:
-			printf("Invalid Command.\n");
+		}
+		if (next == 0) {
 			break;
+		}
 	}
+	run[0] = 0;
+	run[1] = 0;
+	fwrite(run, sizeof(uint32_t), 2, fp);
+	fclose(fp);
+}
+
+/***************************************************************/
+/* Forget all changes so far                                                                         */   
+/***************************************************************/
+void dump_mark() {
+	int i;
+	uint32_t pages;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		pages = ((MEM_REGIONS[i].end - MEM_REGIONS[i].begin) >> MEM_PAGE_SHIFT) + 1;
+		uint32_t page;
+		for (page = 0; page < pages; page++) {
+			MEM_REGIONS[i].page_flags[page] &= ~PAGE_DIRTY;
+		}
+	}
+	DUMP_STATE = CURRENT_STATE;
 }
 
 /***************************************************************/
@@ -258,20 +729,63 @@ void reset() {
 	}
 	CURRENT_STATE.HI = 0;
 	CURRENT_STATE.LO = 0;
+	memset(CURRENT_STATE.FPR, 0, sizeof(CURRENT_STATE.FPR));
+	CURRENT_STATE.FCSR = 0;
+	CURRENT_STATE.BRANCH_TARGET = 0;
+	store_buffer_reset();
 	
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+	/*only pages written since the last reset need clearing*/
+	for (i = 0; i < NUM_TOUCHED_PAGES; i++) {
+		mem_region_t *region = &MEM_REGIONS[TOUCHED_PAGES[i] >> 24];
+		uint32_t page = TOUCHED_PAGES[i] & 0xFFFFFF;
+		uint32_t length = region->end - region->begin + 1 - (page << MEM_PAGE_SHIFT);
+		memset(region->mem + (page << MEM_PAGE_SHIFT), 0, length < MEM_PAGE_SIZE ? length : MEM_PAGE_SIZE);
+		region->page_flags[page] &= PAGE_WATCHED;
 	}
+	NUM_TOUCHED_PAGES = 0;
+	DUMP_STATE = CURRENT_STATE;
 	
 	/*load program*/
-	load_program();
+	load_image();
+	mmu_reset();
 	
 	/*reset PC*/
-	INSTRUCTION_COUNT = 0;
+	reset_pipeline();
 	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
-	NEXT_STATE = CURRENT_STATE;
 	RUN_FLAG = TRUE;
+	if (COSIM_FLAG) {
+		cosim_enable(TRUE);
+	}
+	/*memory was rewritten behind the undo log*/
+	if (TIME_TRAVEL.interval) {
+		checkpoint_enable(TIME_TRAVEL.interval);
+	}
+}
+
+/***************************************************************/
+/* Empty the pipeline and clear the counters                                             */
+/***************************************************************/
+void reset_pipeline() {
+	memset(&ID_IF, 0, sizeof(ID_IF));
+	memset(&EX_ID, 0, sizeof(EX_ID));
+	memset(&MEM_EX, 0, sizeof(MEM_EX));
+	memset(&WB_MEM, 0, sizeof(WB_MEM));
+	ForwardA = FWD_NONE;
+	ForwardB = FWD_NONE;
+	PENDING.flags = 0;
+	memset(&FP_SCOREBOARD, 0, sizeof(FP_SCOREBOARD));
+	IF_REDIRECT = 0;
+	EVENTS.occupied = 0;
+	EVENTS.far = 0;
+	EVENTS.frozen = FALSE;
+	MMU.waited = 0;
+	MMU.delay_slot = 0;
+	MMU.restart = FALSE;
+	STORE_BUFFER.busy = 0;
+	STORE_BUFFER.waiting = FALSE;
+	memset(&STATS, 0, sizeof(STATS));
+	INSTRUCTION_COUNT = 0;
+	CYCLE_COUNT = 0;
 }
 
 /***************************************************************/
@@ -283,995 +797,4893 @@ void init_memory() {
 		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
 		MEM_REGIONS[i].mem = malloc(region_size);
 		memset(MEM_REGIONS[i].mem, 0, region_size);
+		MEM_REGIONS[i].page_flags = calloc(((region_size - 1) >> MEM_PAGE_SHIFT) + 1, 1);
+	}
+}
+
+/***************************************************************/
+/* Release memory allocated by init_memory                                              */
+/***************************************************************/
+void free_memory() {                                           
+	int i;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		free(MEM_REGIONS[i].mem);
+		free(MEM_REGIONS[i].page_flags);
+		MEM_REGIONS[i].mem = NULL;
+		MEM_REGIONS[i].page_flags = NULL;
 	}
+	free(PROGRAM_IMAGE);
+	PROGRAM_IMAGE = NULL;
+	PROGRAM_SIZE = 0;
+	free(TOUCHED_PAGES);
+	TOUCHED_PAGES = NULL;
+	NUM_TOUCHED_PAGES = 0;
+	TOUCHED_CAPACITY = 0;
 }
 
 /**************************************************************/
-/* load program into memory                                                                                      */
+/* read the program file and load it into memory                                               */
 /**************************************************************/
-void load_program() {                   
+int load_program() {                   
 	FILE * fp;
-	int i, word;
-	uint32_t address;
+	uint32_t word, size = 0, capacity = 0;
+	uint32_t *image = NULL;
 
 	/* Open program file. */
 	fp = fopen(prog_file, "r");
 	if (fp == NULL) {
 		printf("Error: Can't open program file %s\n", prog_file);
-		exit(-1);
+		return FALSE;
 	}
 
 	/* Read in the program. */
-
-	i = 0;
-	while( fscanf(fp, "%x\n", &word) != EOF ) {
-		address = MEM_TEXT_BEGIN + i;
-		mem_write_32(address, word);
-		printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
-		i += 4;
+	while( fscanf(fp, "%x\n", &word) == 1 ) {
+		if (size == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			image = realloc(image, capacity * sizeof(uint32_t));
+		}
+		image[size++] = word;
 	}
-	PROGRAM_SIZE = i/4;
-	printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
 	fclose(fp);
+
+	free(PROGRAM_IMAGE);
+	PROGRAM_IMAGE = image;
+	PROGRAM_SIZE = size;
+	load_image();
+	return TRUE;
+}
+
+/**************************************************************/
+/* write the program image into text memory                                                */
+/**************************************************************/
+void load_image() {                   
+	uint32_t i, address;
+
+	for (i = 0; i < PROGRAM_SIZE; i++) {
+		address = MEM_TEXT_BEGIN + i * 4;
+		mem_write_32(address, PROGRAM_IMAGE[i]);
+		if (ENABLE_TRACE) {
+			printf("writing 0x%08x into address 0x%08x (%d)\n", PROGRAM_IMAGE[i], address, address);
+		}
+	}
+	if (ENABLE_TRACE) {
+		printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
+	}
+}
+
+/************************************************************/
+/* Decode tables generated from MIPS_ISA                                    */
+/************************************************************/
+#define ISA_INFO(name, table, key, mnemonic, format, flags, unit) [OP_##name] = { mnemonic, format, flags, unit },
+const ISA_Info ISA[NUM_OPS] = {
+	[OP_UNKNOWN] = { "", FMT_NONE, 0, FP_UNIT_NONE },
+	MIPS_ISA(ISA_INFO)
+};
+#undef ISA_INFO
+
+#define ISA_SLOT(name, table, key, mnemonic, format, flags, unit) [table][key] = OP_##name,
+static const uint8_t ISA_DECODE[DECODE_TABLES][64] = {
+	MIPS_ISA(ISA_SLOT)
+};
+#undef ISA_SLOT
+
+/************************************************************/
+/* The OP_* number of an instruction word                                  */
+/************************************************************/
+static inline uint32_t isa_op(uint32_t instruction)
+{
+	uint32_t opcode = instruction >> 26;
+	uint32_t rs = (0x3E00000 & instruction) >> 21;
+
+	switch (opcode) {
+		case 0x00:
+			return ISA_DECODE[DECODE_SPECIAL][instruction & 0x3F];
+		case 0x01:
+			return ISA_DECODE[DECODE_REGIMM][(0x1F0000 & instruction) >> 16];
+		case 0x10:
+			if (rs == 0x10) {
+				return ISA_DECODE[DECODE_COP0_CO][instruction & 0x3F];
+			}
+			return ISA_DECODE[DECODE_COP0][rs];
+		case 0x11:
+			if (rs == 0x08) {
+				return ISA_DECODE[DECODE_COP1_BC][(instruction >> 16) & 1];
+			}
+			if (rs == 0x10 || rs == 0x11 || rs == 0x14) {
+				return ISA_DECODE[DECODE_COP1_FN][instruction & 0x3F];
+			}
+			return ISA_DECODE[DECODE_COP1][rs];
+	}
+	return ISA_DECODE[DECODE_PRIMARY][opcode];
+}
+
+static inline uint32_t isa_flags(uint32_t instruction)
+{
+	return ISA[isa_op(instruction)].flags;
+}
+
+/************************************************************/
+/* Which FPRs, condition bit and FP unit a COP1 instruction uses        */
+/************************************************************/
+static void fp_decode(uint32_t instruction, FP_Op *op)
+{
+	uint32_t code = isa_op(instruction);
+	uint32_t fmt = (0x3E00000 & instruction) >> 21;
+	uint32_t ft = (0x1F0000 & instruction) >> 16;
+	uint32_t fs = (0xF800 & instruction) >> 11;
+	uint32_t fd = (0x7C0 & instruction) >> 6;
+
+	memset(op, 0, sizeof(*op));
+	op->unit = FP_UNIT_NONE;
+	switch (code) {
+		case OP_LWC1:
+			op->writes = 1u << ft;
+			return;
+		case OP_SWC1:
+			op->reads = 1u << ft;
+			return;
+		case OP_MFC1:
+			op->reads = 1u << fs;
+			return;
+		case OP_MTC1:
+			op->writes = 1u << fs;
+			return;
+		case OP_BC1F:
+		case OP_BC1T:
+			op->reads_cond = TRUE;
+			return;
+	}
+
+	/*words are only converted, never computed on*/
+	if (ISA[code].unit == FP_UNIT_NONE || (fmt == 0x14 && code != OP_CVT_S && code != OP_CVT_D)) {
+		return;
+	}
+	op->pair_source = (fmt == 0x11);
+	op->pair_result = op->pair_source;
+	op->unit = ISA[code].unit;
+	op->reads = op->pair_source ? 3u << (fs & 0x1E) : 1u << fs;
+	if (ISA[code].format != FMT_FP2) {
+		op->reads |= op->pair_source ? 3u << (ft & 0x1E) : 1u << ft;
+	}
+	if (ISA[code].format == FMT_FP_CMP) {
+		op->writes_cond = TRUE;
+		return;
+	}
+	if (code == OP_CVT_S || code == OP_CVT_W) {
+		op->pair_result = FALSE;
+	}
+	else if (code == OP_CVT_D) {
+		op->pair_result = TRUE;
+	}
+	op->writes = op->pair_result ? 3u << (fd & 0x1E) : 1u << fd;
+}
+
+/************************************************************/
+/* An FP operand from a register file, a double from its pair            */
+/************************************************************/
+static inline uint64_t fp_read(const uint32_t *fpr, uint32_t reg, int pair)
+{
+	return pair ? ((uint64_t)fpr[(reg & 0x1E) + 1] << 32) | fpr[reg & 0x1E] : fpr[reg];
+}
+
+static inline double fp_double(uint64_t bits)
+{
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static inline uint64_t fp_double_bits(double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static inline float fp_single(uint32_t bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static inline uint32_t fp_single_bits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+/************************************************************/
+/* Result of a COP1 arithmetic instruction, or 1/0 for C.cond. Singles */
+/* are computed in double and rounded once, which is exact for these ops */
+/************************************************************/
+static uint64_t fp_compute(uint32_t instruction, uint64_t fs, uint64_t ft)
+{
+	uint32_t fmt = (0x3E00000 & instruction) >> 21;
+	uint32_t function = (0x3F & instruction);
+	uint64_t sign = fmt == 0x11 ? 1ull << 63 : 0x80000000u;
+	double a, b, result;
+	int unordered;
+
+	if (fmt == 0x11) {
+		a = fp_double(fs);
+		b = fp_double(ft);
+	}
+	else if (fmt == 0x14) {
+		a = (int32_t)fs;
+		b = 0;
+	}
+	else {
+		a = fp_single((uint32_t)fs);
+		b = fp_single((uint32_t)ft);
+	}
+
+	switch (isa_op(instruction)) {
+		case OP_ADD_FP:
+			result = a + b;
+			break;
+		case OP_SUB_FP:
+			result = a - b;
+			break;
+		case OP_MUL_FP:
+			result = a * b;
+			break;
+		case OP_DIV_FP:
+			result = a / b;
+			break;
+		case OP_SQRT_FP:
+			result = sqrt(a);
+			break;
+		case OP_ABS_FP:
+			return fs & ~sign;
+		case OP_MOV_FP:
+			return fs;
+		case OP_NEG_FP:
+			return fs ^ sign;
+		case OP_CVT_S:
+			return fp_single_bits((float)a);
+		case OP_CVT_D:
+			return fp_double_bits(a);
+		case OP_CVT_W: //out of range and NaN give the MIPS default 2^31-1
+			if (!(a > -2147483649.0 && a < 2147483648.0)) {
+				return 0x7FFFFFFF;
+			}
+			return (uint32_t)(int32_t)rint(a);
+		default: //C.cond: bit 0 unordered, bit 1 equal, bit 2 less than
+			unordered = isnan(a) || isnan(b);
+			return ((function & 0x1) && unordered) || ((function & 0x2) && a == b) || ((function & 0x4) && a < b);
+	}
+	return fmt == 0x11 ? fp_double_bits(result) : fp_single_bits((float)result);
+}
+
+/************************************************************/
+/* Cycles from leaving ID until a reader of the result may follow, from */
+/* a table of unit latencies like FP_LATENCY                                     */
+/************************************************************/
+static inline uint32_t fp_latency(const uint32_t *latency, const FP_Op *op)
+{
+	if (op->unit == FP_UNIT_NONE || latency[op->unit] < FP_MIN_LATENCY) {
+		return FP_MIN_LATENCY;
+	}
+	return latency[op->unit];
+}
+
+/************************************************************/
+/* STALL_FP while an operand, the divider or an older write to the same  */
+/* register is still in flight at cycle on the given scoreboard               */
+/************************************************************/
+static inline int fp_hazard(const FP_Scoreboard *board, const uint32_t *latencies, uint32_t cycle, const FP_Op *op)
+{
+	uint32_t latency = fp_latency(latencies, op);
+	uint32_t pending, reg;
+
+	for (pending = op->reads; pending; pending &= pending - 1) {
+		if (board->ready[__builtin_ctz(pending)] > cycle) {
+			return STALL_FP;
+		}
+	}
+	for (pending = op->writes; pending; pending &= pending - 1) {
+		reg = __builtin_ctz(pending);
+		if (board->ready[reg] > cycle + latency) {
+			return STALL_FP;
+		}
+	}
+	if (op->reads_cond && board->cond_ready > cycle) {
+		return STALL_FP;
+	}
+	if ((op->unit == FP_UNIT_DIV || op->unit == FP_UNIT_SQRT) && board->divider_free > cycle) {
+		return STALL_FP;
+	}
+	return 0;
+}
+
+/************************************************************/
+/* Book the results and the divider of an instruction leaving ID          */
+/************************************************************/
+static inline void fp_issue(FP_Scoreboard *board, const uint32_t *latencies, uint32_t cycle, const FP_Op *op)
+{
+	uint32_t ready = cycle + fp_latency(latencies, op);
+	uint32_t pending;
+
+	for (pending = op->writes; pending; pending &= pending - 1) {
+		board->ready[__builtin_ctz(pending)] = ready;
+	}
+	if (op->writes_cond) {
+		board->cond_ready = ready;
+	}
+	if (op->unit == FP_UNIT_DIV || op->unit == FP_UNIT_SQRT) {
+		board->divider_free = ready;
+	}
+}
+
+/************************************************************/
+/* First cycle at which fp_hazard lets the instruction leave ID            */
+/************************************************************/
+static inline uint32_t fp_wakeup(const FP_Scoreboard *board, const uint32_t *latencies, const FP_Op *op)
+{
+	uint32_t latency = fp_latency(latencies, op);
+	uint32_t pending, reg, wake = 0;
+
+	for (pending = op->reads; pending; pending &= pending - 1) {
+		reg = __builtin_ctz(pending);
+		wake = board->ready[reg] > wake ? board->ready[reg] : wake;
+	}
+	for (pending = op->writes; pending; pending &= pending - 1) {
+		reg = __builtin_ctz(pending);
+		wake = board->ready[reg] > wake + latency ? board->ready[reg] - latency : wake;
+	}
+	if (op->reads_cond && board->cond_ready > wake) {
+		wake = board->cond_ready;
+	}
+	if ((op->unit == FP_UNIT_DIV || op->unit == FP_UNIT_SQRT) && board->divider_free > wake) {
+		wake = board->divider_free;
+	}
+	return wake;
+}
+
+/************************************************************/
+/* FP_UNIT_* of a unit name, FP_UNIT_NONE if there is no such unit     */
+/************************************************************/
+static int fp_unit(const char *unit)
+{
+	static const char *names[NUM_FP_UNITS] = { "add", "mul", "div", "sqrt" };
+	int i;
+
+	for (i = 0; i < NUM_FP_UNITS; i++) {
+		if (strcmp(unit, names[i]) == 0) {
+			return i;
+		}
+	}
+	return FP_UNIT_NONE;
+}
+
+/************************************************************/
+/* Set the latency of an FP unit by name; FALSE for an unknown unit      */
+/************************************************************/
+int fp_set_latency(const char *unit, uint32_t cycles)
+{
+	int i = fp_unit(unit);
+
+	if (i == FP_UNIT_NONE) {
+		return FALSE;
+	}
+	FP_LATENCY[i] = cycles;
+	return TRUE;
+}
+
+static inline void mmu_micro_flush()
+{
+	memset(MMU.micro, 0, sizeof(MMU.micro));
+}
+
+/* the TLB entry TLBWR replaces and Random reads: counts down every cycle */
+static inline uint32_t mmu_random()
+{
+	return MMU.entries ? MMU.entries - 1 - CYCLE_COUNT % MMU.entries : 0;
+}
+
+/************************************************************/
+/* The TLB entry matching an EntryHi value, -1 if there is none        */
+/************************************************************/
+static int mmu_lookup(uint32_t hi)
+{
+	uint32_t i;
+
+	for (i = 0; i < MMU.entries; i++) {
+		if ((MMU.tlb[i].hi >> MMU_PAGE_SHIFT) == (hi >> MMU_PAGE_SHIFT)
+			&& ((MMU.tlb[i].lo & ENTRYLO_G) || (MMU.tlb[i].hi & ENTRYHI_ASID) == (hi & ENTRYHI_ASID))) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/************************************************************/
+/* Translate a kuseg address in place through the micro-TLB, then the   */
+/* TLB; FALSE on a miss, which the refill handler has to fix up        */
+/************************************************************/
+static inline int mmu_translate(uint32_t *address)
+{
+	uint32_t vpn = *address >> MMU_PAGE_SHIFT;
+	uint32_t key = (vpn << 8 | (MMU.cp0[CP0_ENTRYHI] & ENTRYHI_ASID)) + 1;
+	Micro_TLB_Entry *micro = &MMU.micro[vpn & (MICRO_TLB_SIZE - 1)];
+	int i;
+
+	MMU.translations++;
+	if (micro->key != key) {
+		i = mmu_lookup(vpn << MMU_PAGE_SHIFT | (MMU.cp0[CP0_ENTRYHI] & ENTRYHI_ASID));
+		if (i < 0) {
+			return FALSE;
+		}
+		micro->key = key;
+		micro->frame = MMU.tlb[i].lo & ~((1u << MMU_PAGE_SHIFT) - 1);
+	}
+	else {
+		MMU.micro_hits++;
+	}
+	*address = micro->frame | (*address & ((1u << MMU_PAGE_SHIFT) - 1));
+	return TRUE;
+}
+
+/************************************************************/
+/* TLB refill exception for the access in MEM: record the fault in      */
+/* COP0, flush it and everything younger, and fetch the refill vector  */
+/************************************************************/
+static void mmu_refill(uint32_t address, uint32_t pc, int store)
+{
+	uint32_t *cp0 = MMU.cp0;
+
+	MMU.refills++;
+	if (ENABLE_TRACE) {
+		printf("TLB REFILL 0x%08x\n", address);
+	}
+	cp0[CP0_BADVADDR] = address;
+	cp0[CP0_ENTRYHI] = (address & ~((1u << MMU_PAGE_SHIFT) - 1)) | (cp0[CP0_ENTRYHI] & ENTRYHI_ASID);
+	cp0[CP0_CONTEXT] = (cp0[CP0_CONTEXT] & 0xFFE00000) | ((address & 0x7FFFF000) >> 10);
+	CURRENT_STATE.PC = MMU_REFILL_VECTOR;
+	if (cp0[CP0_STATUS] & STATUS_EXL) {
+		/*a miss inside a handler goes to the general vector, EPC kept*/
+		cp0[CP0_CAUSE] = (store ? CAUSE_TLBS : CAUSE_TLBL) << 2;
+		CURRENT_STATE.PC = MMU_GENERAL_VECTOR;
+	}
+	else if (pc == MMU.delay_slot) {
+		/*restart a delay slot from its branch, which is only a BC1*/
+		cp0[CP0_CAUSE] = CAUSE_BD | (store ? CAUSE_TLBS : CAUSE_TLBL) << 2;
+		cp0[CP0_EPC] = pc - 4;
+	}
+	else {
+		cp0[CP0_CAUSE] = (store ? CAUSE_TLBS : CAUSE_TLBL) << 2;
+		cp0[CP0_EPC] = pc;
+	}
+	cp0[CP0_STATUS] |= STATUS_EXL;
+
+	memset(&ID_IF, 0, sizeof(ID_IF));
+	memset(&EX_ID, 0, sizeof(EX_ID));
+	memset(&MEM_EX, 0, sizeof(MEM_EX));
+	memset(&WB_MEM, 0, sizeof(WB_MEM));
+	ForwardA = FWD_NONE;
+	ForwardB = FWD_NONE;
+	IF_REDIRECT = 0;
+	EVENTS.frozen = FALSE;
+	MMU.waited = 0;
+	MMU.delay_slot = 0;
+	MMU.restart = TRUE;
+}
+
+/************************************************************/
+/* COP0 register reads (MFC0) and writes (MTC0), both in WB           */
+/************************************************************/
+static uint32_t mmu_read_cp0(uint32_t reg)
+{
+	if (reg == CP0_RANDOM) {
+		return mmu_random();
+	}
+	if (reg == CP0_COUNT) {
+		return CYCLE_COUNT;
+	}
+	return MMU.cp0[reg];
+}
+
+static void mmu_write_cp0(uint32_t reg, uint32_t value)
+{
+	switch (reg) {
+		case CP0_RANDOM:
+		case CP0_BADVADDR:
+		case CP0_COUNT:
+			break;
+		case CP0_CONTEXT:
+			MMU.cp0[reg] = (value & 0xFFE00000) | (MMU.cp0[reg] & 0x1FFFFF);
+			break;
+		case CP0_ENTRYHI:
+			/*a new ASID changes what the cached translations mean*/
+			MMU.cp0[reg] = value;
+			mmu_micro_flush();
+			break;
+		default:
+			MMU.cp0[reg] = value;
+			break;
+	}
+}
+
+/************************************************************/
+/* TLBR, TLBWI, TLBWR and TLBP, in WB                                        */
+/************************************************************/
+static void mmu_tlb_op(uint32_t code)
+{
+	uint32_t *cp0 = MMU.cp0;
+	uint32_t index;
+	int i;
+
+	if (MMU.entries == 0) {
+		return;
+	}
+	index = cp0[CP0_INDEX] % MMU.entries;
+	switch (code) {
+		case OP_TLBR:
+			cp0[CP0_ENTRYHI] = MMU.tlb[index].hi;
+			cp0[CP0_ENTRYLO] = MMU.tlb[index].lo;
+			break;
+		case OP_TLBWI:
+			MMU.tlb[index].hi = cp0[CP0_ENTRYHI];
+			MMU.tlb[index].lo = cp0[CP0_ENTRYLO];
+			break;
+		case OP_TLBWR:
+			index = mmu_random();
+			MMU.tlb[index].hi = cp0[CP0_ENTRYHI];
+			MMU.tlb[index].lo = cp0[CP0_ENTRYLO];
+			break;
+		case OP_TLBP:
+			i = mmu_lookup(cp0[CP0_ENTRYHI]);
+			cp0[CP0_INDEX] = i < 0 ? INDEX_PROBE_FAIL : (uint32_t)i;
+			return;
+		default:
+			return;
+	}
+	mmu_micro_flush();
+}
+
+/************************************************************/
+/* Write the default refill handler at the refill vector: map the       */
+/* faulting page onto the same physical page and return. The general   */
+/* vector gets the same code, so a miss inside a handler maps its own  */
+/* page and returns to EPC, which retries the first fault               */
+/************************************************************/
+static void mmu_install_handler()
+{
+	static const uint32_t handler[] = {
+		0x401A4000,	/* mfc0 $k0, BadVAddr */
+		0x001AD302,	/* srl $k0, $k0, 12 */
+		0x001AD300,	/* sll $k0, $k0, 12 */
+		0x375A0600,	/* ori $k0, $k0, D | V */
+		0x409A1000,	/* mtc0 $k0, EntryLo */
+		0x42000006,	/* tlbwr */
+		MIPS_ERET	/* eret */
+	};
+	uint32_t i;
+
+	for (i = 0; i < sizeof(handler) / sizeof(handler[0]); i++) {
+		mem_write_32(MMU_REFILL_VECTOR + i * 4, handler[i]);
+		mem_write_32(MMU_GENERAL_VECTOR + i * 4, handler[i]);
+	}
+}
+
+/************************************************************/
+/* Empty the TLB and COP0; entries start on distinct kseg pages, which  */
+/* are never translated, so none of them matches                         */
+/************************************************************/
+void mmu_reset()
+{
+	uint32_t i;
+
+	memset(MMU.cp0, 0, sizeof(MMU.cp0));
+	for (i = 0; i < TLB_MAX_ENTRIES; i++) {
+		MMU.tlb[i].hi = MMU_KSEG_BEGIN + (i << MMU_PAGE_SHIFT);
+		MMU.tlb[i].lo = 0;
+	}
+	mmu_micro_flush();
+	MMU.waited = 0;
+	MMU.delay_slot = 0;
+	MMU.restart = FALSE;
+	MMU.translations = 0;
+	MMU.micro_hits = 0;
+	MMU.refills = 0;
+	if (MMU.enabled) {
+		mmu_install_handler();
+	}
+}
+
+/************************************************************/
+/* Translate user loads and stores through a TLB of entries entries,   */
+/* each costing cost cycles in ID; FALSE for a bad size                 */
+/************************************************************/
+int mmu_enable(uint32_t entries, uint32_t cost)
+{
+	if (entries == 0 || entries > TLB_MAX_ENTRIES) {
+		return FALSE;
+	}
+	MMU.enabled = TRUE;
+	MMU.entries = entries;
+	MMU.cost = cost;
+	mmu_reset();
+	return TRUE;
+}
+
+void mmu_disable()
+{
+	MMU.enabled = FALSE;
+	mmu_reset();
+}
+
+/************************************************************/
+/* Print translations, micro-TLB hits and refills                         */
+/************************************************************/
+void mmu_report()
+{
+	if (!MMU.enabled) {
+		printf("MMU is off; turn it on with mmu <entries> [cost]\n");
+		return;
+	}
+	printf("MMU: %u-entry TLB, %u cycle%s per user access, %s mode\n", MMU.entries, MMU.cost, MMU.cost == 1 ? "" : "s",
+		MMU.cp0[CP0_STATUS] & STATUS_EXL ? "kernel" : "user");
+	printf("translations:\t%llu\n", (unsigned long long)MMU.translations);
+	printf("micro-TLB hits:\t%llu (%.2f%%)\n", (unsigned long long)MMU.micro_hits,
+		MMU.translations ? 100.0 * MMU.micro_hits / MMU.translations : 0.0);
+	printf("TLB refills:\t%llu\n", (unsigned long long)MMU.refills);
+	printf("TLB stalls:\t%llu\n", (unsigned long long)STATS.stalls[__builtin_ctz(STALL_TLB)]);
+}
+
+/************************************************************/
+/* Write the oldest store buffer entry to memory                           */
+/************************************************************/
+static void sb_retire()
+{
+	Store_Buffer_Entry *entry = &STORE_BUFFER.entry[STORE_BUFFER.head];
+
+	if (entry->mask == 0xFFFFFFFF) {
+		mem_write_32(entry->address, entry->value);
+	}
+	else {
+		mem_write_32(entry->address, (mem_read_32(entry->address) & ~entry->mask) | (entry->value & entry->mask));
+	}
+	STORE_BUFFER.head = (STORE_BUFFER.head + 1) % STORE_BUFFER_MAX;
+	STORE_BUFFER.count--;
+	STORE_BUFFER.busy = 0;
+	STORE_BUFFER.drained++;
+}
+
+/************************************************************/
+/* The entry for the word at address, NULL if there is none; entries  */
+/* partly overlapping it are drained first, oldest first                 */
+/************************************************************/
+static Store_Buffer_Entry *sb_match(uint32_t address)
+{
+	Store_Buffer_Entry *entry;
+	uint32_t i, drain = 0;
+
+	for (i = 0; i < STORE_BUFFER.count; i++) {
+		entry = &STORE_BUFFER.entry[(STORE_BUFFER.head + i) % STORE_BUFFER_MAX];
+		if (entry->address == address) {
+			return entry;
+		}
+		if (entry->address - address + 3 <= 6) {
+			drain = i + 1;
+		}
+	}
+	if (drain) {
+		STORE_BUFFER.conflicts++;
+		while (drain--) {
+			sb_retire();
+		}
+	}
+	return NULL;
+}
+
+/************************************************************/
+/* Buffer the bytes of value under mask for the word at address        */
+/************************************************************/
+static void sb_store(uint32_t address, uint32_t value, uint32_t mask)
+{
+	Store_Buffer_Entry *entry = sb_match(address);
+
+	STORE_BUFFER.stores++;
+	if (entry) {
+		entry->value = (entry->value & ~mask) | (value & mask);
+		entry->mask |= mask;
+		STORE_BUFFER.merged++;
+		return;
+	}
+	/*ID holds stores back while the buffer is full; this is a fallback*/
+	if (STORE_BUFFER.count == STORE_BUFFER.size) {
+		sb_retire();
+	}
+	entry = &STORE_BUFFER.entry[(STORE_BUFFER.head + STORE_BUFFER.count) % STORE_BUFFER_MAX];
+	entry->address = address;
+	entry->value = value & mask;
+	entry->mask = mask;
+	STORE_BUFFER.count++;
+}
+
+/************************************************************/
+/* The word at address as a load sees it: memory under any buffered   */
+/* bytes; need is the bytes the load uses                                     */
+/************************************************************/
+static uint32_t sb_load(uint32_t address, uint32_t need)
+{
+	Store_Buffer_Entry *entry = sb_match(address);
+	uint32_t value;
+
+	if (entry == NULL) {
+		return mem_read_32(address);
+	}
+	STORE_BUFFER.load_hits++;
+	if ((entry->mask & need) == need) {
+		STORE_BUFFER.forwards++;
+		return entry->value;
+	}
+	value = mem_read_32(address);
+	return (value & ~entry->mask) | (entry->value & entry->mask);
+}
+
+/************************************************************/
+/* Loads and stores of MEM, through the store buffer when it is on      */
+/************************************************************/
+static inline uint32_t mem_load(uint32_t address, uint32_t need)
+{
+	if (__builtin_expect(STORE_BUFFER.count != 0, 0)) {
+		return sb_load(address, need);
+	}
+	return mem_read_32(address);
+}
+
+static inline void mem_store_bytes(uint32_t address, uint32_t value, uint32_t mask)
+{
+	if (__builtin_expect(STORE_BUFFER.enabled, 0)) {
+		sb_store(address, value, mask);
+	}
+	else if (mask == 0xFFFFFFFF) {
+		mem_store(address, value);
+	}
+	else {
+		mem_store(address, (value & mask) | (mem_read_32(address) & ~mask));
+	}
+}
+
+/************************************************************/
+/* One cycle of draining, run by MEM while anything is buffered        */
+/************************************************************/
+static void sb_cycle()
+{
+	STORE_BUFFER.occupancy += STORE_BUFFER.count;
+	if (STORE_BUFFER.policy == SB_DRAIN_LAZY && !STORE_BUFFER.waiting) {
+		return;
+	}
+	if (++STORE_BUFFER.busy >= STORE_BUFFER.latency) {
+		sb_retire();
+	}
+}
+
+/************************************************************/
+/* Write everything buffered to memory at once                             */
+/************************************************************/
+void store_buffer_drain()
+{
+	while (STORE_BUFFER.count) {
+		sb_retire();
+	}
+}
+
+/************************************************************/
+/* Drop buffered stores and clear the counters                               */
+/************************************************************/
+void store_buffer_reset()
+{
+	STORE_BUFFER.head = 0;
+	STORE_BUFFER.count = 0;
+	STORE_BUFFER.busy = 0;
+	STORE_BUFFER.waiting = FALSE;
+	STORE_BUFFER.stores = 0;
+	STORE_BUFFER.merged = 0;
+	STORE_BUFFER.load_hits = 0;
+	STORE_BUFFER.forwards = 0;
+	STORE_BUFFER.conflicts = 0;
+	STORE_BUFFER.full_stalls = 0;
+	STORE_BUFFER.drained = 0;
+	STORE_BUFFER.occupancy = 0;
+}
+
+/************************************************************/
+/* Buffer stores in entries entries, each taking latency cycles to      */
+/* write, under an SB_DRAIN_* policy; 0 entries drains and turns it off */
+/************************************************************/
+int store_buffer_enable(uint32_t entries, uint32_t latency, int policy)
+{
+	if (entries > STORE_BUFFER_MAX || (entries && latency == 0)) {
+		return FALSE;
+	}
+	store_buffer_drain();
+	store_buffer_reset();
+	STORE_BUFFER.enabled = entries != 0;
+	STORE_BUFFER.size = entries;
+	STORE_BUFFER.latency = latency;
+	STORE_BUFFER.policy = policy;
+	return TRUE;
+}
+
+/************************************************************/
+/* Print store, forwarding and drain counts                                  */
+/************************************************************/
+void store_buffer_report()
+{
+	if (!STORE_BUFFER.enabled) {
+		printf("Store buffer is off; turn it on with sb <entries> [latency] [lazy]\n");
+		return;
+	}
+	printf("Store buffer: %u entries, %u cycle%s per write, %s drain, %u buffered now\n", STORE_BUFFER.size, STORE_BUFFER.latency,
+		STORE_BUFFER.latency == 1 ? "" : "s", STORE_BUFFER.policy == SB_DRAIN_LAZY ? "lazy" : "eager", STORE_BUFFER.count);
+	printf("stores:\t\t%llu (%llu merged into an entry)\n", (unsigned long long)STORE_BUFFER.stores, (unsigned long long)STORE_BUFFER.merged);
+	printf("load hits:\t%llu (%llu fully forwarded)\n", (unsigned long long)STORE_BUFFER.load_hits, (unsigned long long)STORE_BUFFER.forwards);
+	printf("overlap drains:\t%llu\n", (unsigned long long)STORE_BUFFER.conflicts);
+	printf("full stalls:\t%llu\n", (unsigned long long)STORE_BUFFER.full_stalls);
+	printf("written:\t%llu\n", (unsigned long long)STORE_BUFFER.drained);
+	printf("occupancy:\t%.2f entries on average\n", CYCLE_COUNT ? (double)STORE_BUFFER.occupancy / CYCLE_COUNT : 0.0);
+}
+
+/************************************************************/
+/* Stage bodies shared by the specialized pipelines below; the */
+/* forwarding mode is a constant at every inlined call site      */
+/************************************************************/
+static inline __attribute__((always_inline)) void MEM_stage(const int forwarding);
+static inline __attribute__((always_inline)) void EX_stage(const int forwarding);
+static inline __attribute__((always_inline)) void ID_stage(const int forwarding);
+
+/************************************************************/
+/* maintain the pipeline                                                                                           */ 
+/************************************************************/
+static void handle_pipeline_stall()
+{
+	/*INSTRUCTION_COUNT should be incremented when instruction is done*/
+	/*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
+	
+	WB();
+	MEM_stage(FALSE);
+	EX_stage(FALSE);
+	ID_stage(FALSE);
+	IF();
+}
+
+static void handle_pipeline_forward()
+{
+	WB();
+	MEM_stage(TRUE);
+	EX_stage(TRUE);
+	ID_stage(TRUE);
+	IF();
+}
+
+/************************************************************/
+/* Same pipeline with every Nth cycle timed stage by stage              */
+/************************************************************/
+static inline __attribute__((always_inline)) void handle_pipeline_timed(const int forwarding)
+{
+	uint64_t t0, t1, t2, t3, t4, t5;
+
+	if (--HOST_PROFILE.countdown) {
+		forwarding ? handle_pipeline_forward() : handle_pipeline_stall();
+		return;
+	}
+	HOST_PROFILE.countdown = HOST_PROFILE.period;
+	HOST_PROFILE.sampling = TRUE;
+	mem_read_32 = mem_read_timed;
+	mem_write_32 = mem_write_timed;
+	t0 = host_ticks();
+	WB();
+	t1 = host_ticks();
+	MEM_stage(forwarding);
+	t2 = host_ticks();
+	EX_stage(forwarding);
+	t3 = host_ticks();
+	ID_stage(forwarding);
+	t4 = host_ticks();
+	IF();
+	t5 = host_ticks();
+	HOST_PROFILE.sampling = FALSE;
+	mem_read_32 = mem_read_word;
+	mem_write_32 = mem_write_word;
+	HOST_PROFILE.stage[0] += t1 - t0;
+	HOST_PROFILE.stage[1] += t2 - t1;
+	HOST_PROFILE.stage[2] += t3 - t2;
+	HOST_PROFILE.stage[3] += t4 - t3;
+	HOST_PROFILE.stage[4] += t5 - t4;
+	HOST_PROFILE.samples++;
+}
+
+static void handle_pipeline_timed_stall()
+{
+	handle_pipeline_timed(FALSE);
+}
+
+static void handle_pipeline_timed_forward()
+{
+	handle_pipeline_timed(TRUE);
+}
+
+void (*handle_pipeline)() = handle_pipeline_stall;
+
+/************************************************************/
+/* Select the pipeline specialized for the forwarding mode        */
+/************************************************************/
+void set_forwarding(int enable)
+{
+	ENABLE_FORWARDING = enable ? TRUE : FALSE;
+	if (HOST_PROFILE.enabled) {
+		handle_pipeline = ENABLE_FORWARDING ? handle_pipeline_timed_forward : handle_pipeline_timed_stall;
+	}
+	else {
+		handle_pipeline = ENABLE_FORWARDING ? handle_pipeline_forward : handle_pipeline_stall;
+	}
+}
+
+/************************************************************/
+/* writeback (WB) pipeline stage:                                                                          */ 
+/************************************************************/
+void WB()
+{
+	if(CYCLE_COUNT < 5)
+	{
+		return;
+	}
+	
+	if(WB_MEM.IR == 0 && WB_MEM.PC == 0 && WB_MEM.SYSCALL == 0)
+	{
+		if (ENABLE_TRACE) {
+			printf("STALL\n");
+		}
+		return;
+	}
+
+	if (ENABLE_TRACE) {
+		uint64_t start = host_time_begin();
+		print_instruction(WB_MEM.PC);
+		host_time_end(&HOST_PROFILE.print, start);
+	}
+	uint32_t code = isa_op(WB_MEM.IR);
+	uint32_t flags = ISA[code].flags;
+	uint32_t rd = (0xF800 & WB_MEM.IR) >> 11;
+	uint32_t rt = (0x1F0000 & WB_MEM.IR) >> 16;
+	FP_Op fp_op;
+	
+	INSTRUCTION_COUNT++;
+	if (__builtin_expect(PROFILE.enabled, 0)) {
+		profile_retire(WB_MEM.PC);
+	}
+	if (__builtin_expect(INTERVAL.enabled, 0)) {
+		INTERVAL.pc_min = WB_MEM.PC < INTERVAL.pc_min ? WB_MEM.PC : INTERVAL.pc_min;
+		INTERVAL.pc_max = WB_MEM.PC > INTERVAL.pc_max ? WB_MEM.PC : INTERVAL.pc_max;
+	}
+	
+	/*the table says which register an instruction writes; loads write*/
+	/*what MEM read, MULT and DIV put their second result in LO*/
+	if (flags & ISA_WRITES_RD) {
+		wb_write_reg(rd, WB_MEM.ALUOutput);
+	}
+	else if (flags & ISA_WRITES_RT) {
+		wb_write_reg(rt, code == OP_MFC0 ? mmu_read_cp0(rd) : flags & ISA_LOAD ? WB_MEM.LMD : WB_MEM.ALUOutput);
+	}
+	if (flags & ISA_WRITES_HI) {
+		wb_write_hi(WB_MEM.ALUOutput);
+	}
+	if (flags & ISA_WRITES_LO) {
+		wb_write_lo(flags & ISA_WRITES_HI ? WB_MEM.ALUOutput2 : WB_MEM.ALUOutput);
+	}
+
+	switch (code) {
+		case OP_SYSCALL:
+			if(WB_MEM.SYSCALL == 0xA)
+			{
+				RUN_FLAG = FALSE;
+				/*the program's stores all reach memory before it exits*/
+				store_buffer_drain();
+			} 
+			break;
+		case OP_MTC0:
+			mmu_write_cp0(rd, WB_MEM.ALUOutput);
+			break;
+		case OP_TLBR:
+		case OP_TLBWI:
+		case OP_TLBWR:
+		case OP_TLBP://ERET took effect in ID
+			mmu_tlb_op(code);
+			break;
+		case OP_LWC1:
+			wb_write_fpr(rt, WB_MEM.FPOutput, FALSE);
+			break;
+		default:
+			if ((flags & (ISA_FP | ISA_WRITES_RT)) == ISA_FP) {
+				fp_decode(WB_MEM.IR, &fp_op);
+				if (fp_op.writes_cond) {
+					wb_write_fcsr((CURRENT_STATE.FCSR & ~FCSR_COND) | (WB_MEM.ALUOutput ? FCSR_COND : 0));
+				}
+				else if (fp_op.writes) {
+					wb_write_fpr(__builtin_ctz(fp_op.writes), WB_MEM.FPOutput, fp_op.pair_result);
+				}
+			}
+			break;
+	}
+
+	if (COSIM_FLAG) {
+		cosim_check();
+	}
+}	
+
+/************************************************************/
+/* memory access (MEM) pipeline stage:                                                          */ 
+/************************************************************/
+void MEM()
+{
+	MEM_stage(ENABLE_FORWARDING);
+}
+
+static inline __attribute__((always_inline)) void MEM_stage(const int forwarding)
+{
+	if(CYCLE_COUNT < 4 || WB_MEM.SYSCALL == 0xA)
+	{
+		return;
+	}
+	if (__builtin_expect(STORE_BUFFER.count != 0, 0)) {
+		sb_cycle();
+	}
+	
+	WB_MEM.IR = MEM_EX.IR;
+	WB_MEM.PC = MEM_EX.PC;
+	WB_MEM.SYSCALL = MEM_EX.SYSCALL;
+
+	uint32_t code = isa_op(MEM_EX.IR);
+	uint32_t flags = ISA[code].flags;
+	/*user addresses become physical here; a TLB miss flushes the access*/
+	if (__builtin_expect(MMU.enabled, 0) && (flags & (ISA_LOAD | ISA_STORE)) && MEM_EX.ALUOutput < MMU_KSEG_BEGIN
+		&& !mmu_translate(&MEM_EX.ALUOutput))
+	{
+		mmu_refill(MEM_EX.ALUOutput, MEM_EX.PC, (flags & ISA_STORE) != 0);
+		return;
+	}
+	uint32_t WB_RD = (0xF800 & WB_MEM.IR) >> 11;
+	uint32_t MEM_RD = (0xF800 & MEM_EX.IR) >> 11;
+	uint32_t EX_RS = (0x3E00000 & EX_ID.IR) >> 21;
+	uint32_t EX_RT = (0x1F0000 & EX_ID.IR) >> 16;
+
+	if(forwarding)
+	{
+		/*stores write no register; COP0 and COP1 results are never forwarded*/
+		if(!(flags & (ISA_STORE | ISA_COP)))
+		{
+			if((WB_RD != 0) && !((MEM_RD != 0) && (MEM_RD == EX_RS)) && (WB_RD == EX_RS))
+			{
+				ForwardA = FWD_MEM_WB;
+			}
+			
+			if((WB_RD != 0) && !((MEM_RD != 0) && (MEM_RD == EX_RT)) && (WB_RD == EX_RT))
+			{
+				ForwardB = FWD_MEM_WB;
+			}
+		}
+	}
+	if (__builtin_expect(CACHE_ANALYSIS.enabled, 0) && (flags & (ISA_LOAD | ISA_STORE))) {
+		cache_access(SD_DSIDE, MEM_EX.ALUOutput);
+	}
+	switch (code) {
+		case OP_LB:
+			WB_MEM.LMD = mem_load(MEM_EX.ALUOutput, 0xFF000000) >> 24;
+			STATS.loads++;
+			MEM_EX.ALUOutput = WB_MEM.LMD;
+			break;
+		case OP_LH:
+			WB_MEM.LMD = mem_load(MEM_EX.ALUOutput, 0xFFFF0000) >> 16;
+			STATS.loads++;
+			MEM_EX.ALUOutput = WB_MEM.LMD;
+			break;
+		case OP_LW:
+			WB_MEM.LMD = mem_load(MEM_EX.ALUOutput, 0xFFFFFFFF);
+			STATS.loads++;
+			MEM_EX.ALUOutput = WB_MEM.LMD;
+			break;
+		case OP_SH:
+			mem_store_bytes(MEM_EX.ALUOutput, MEM_EX.B << 16, 0xFFFF0000);
+			STATS.stores++;
+			break;
+		case OP_SB:
+			mem_store_bytes(MEM_EX.ALUOutput, MEM_EX.B << 24, 0xFF000000);
+			STATS.stores++;
+			break;
+		case OP_SW:
+			mem_store_bytes(MEM_EX.ALUOutput, MEM_EX.B, 0xFFFFFFFF);
+			STATS.stores++;
+			break;
+		case OP_LWC1:
+			WB_MEM.FPOutput = mem_load(MEM_EX.ALUOutput, 0xFFFFFFFF);
+			STATS.loads++;
+			break;
+		case OP_SWC1:
+			mem_store_bytes(MEM_EX.ALUOutput, (uint32_t)MEM_EX.FT, 0xFFFFFFFF);
+			STATS.stores++;
+			break;
+		default:
+			WB_MEM.ALUOutput = MEM_EX.ALUOutput;
+			WB_MEM.ALUOutput2 = MEM_EX.ALUOutput2;
+			WB_MEM.FPOutput = MEM_EX.FPOutput;
+			break;
+	}
+}
+
+/************************************************************/
+/* execution (EX) pipeline stage:                                                                          */ 
+/************************************************************/
+void EX()
+{
+	EX_stage(ENABLE_FORWARDING);
+}
+
+static inline __attribute__((always_inline)) void EX_stage(const int forwarding)
+{
+	
+	if(CYCLE_COUNT < 3 || MEM_EX.SYSCALL == 0xA)
+	{
+		return;
+	}
+	MEM_EX.IR = EX_ID.IR;
+	MEM_EX.PC = EX_ID.PC;
+	MEM_EX.SYSCALL = EX_ID.SYSCALL;
+
+	if(EX_ID.IR == 0 && EX_ID.PC == 0 && EX_ID.SYSCALL == 0)
+	{
+		//printf("Skipping EX()\n");
+		return;
+	}
+
+	
+	uint32_t code = isa_op(EX_ID.IR);
+	uint32_t flags = ISA[code].flags;
+	uint32_t shamt = (0x7C0 & EX_ID.IR) >> 6;
+	uint32_t MEM_RD = (0xF800 & MEM_EX.IR) >> 11;
+	uint32_t EX_RS = (0x3E00000 & EX_ID.IR) >> 21;
+	uint32_t EX_RT = (0x1F0000 & EX_ID.IR) >> 16;
+
+	uint64_t product;
+
+	if(forwarding)
+	{
+		
+		if (ForwardA == FWD_EX_MEM)
+		{
+			
+			EX_ID.A = MEM_EX.ALUOutput;
+			ForwardA = FWD_NONE;
+			STATS.forwards++;
+		}
+		else if (ForwardA == FWD_MEM_WB)
+		{
+			EX_ID.A = WB_MEM.ALUOutput;
+			ForwardA = FWD_NONE;
+			STATS.forwards++;
+		}
+		if (ForwardB == FWD_EX_MEM)
+		{
+			EX_ID.B = MEM_EX.ALUOutput;
+			ForwardB = FWD_NONE;
+			STATS.forwards++;
+		}
+		else if (ForwardB == FWD_MEM_WB)
+		{
+			EX_ID.B = WB_MEM.ALUOutput;
+			ForwardB = FWD_NONE;
+			STATS.forwards++;
+		}
+	}
+
+	if(forwarding)
+	{
+		EX_ID.IR = ID_IF.IR;
+		EX_ID.PC = ID_IF.PC;
+		EX_ID.SYSCALL = ID_IF.SYSCALL;
+		MEM_RD = (0xF800 & MEM_EX.IR) >> 11;
+		EX_RS = (0x3E00000 & EX_ID.IR) >> 21;
+		EX_RT = (0x1F0000 & EX_ID.IR) >> 16;
+		/*COP0 and COP1 results are never forwarded*/
+		if(!(flags & ISA_COP))
+		{
+			if(!(flags & ISA_WRITES_RD))
+			{
+				MEM_RD = flags & ISA_WRITES_RT ? (0x1F0000 & MEM_EX.IR) >> 16 : 0;
+			}
+
+			if((MEM_RD != 0) && (MEM_RD == EX_RS))
+			{
+				ForwardA = FWD_EX_MEM;
+			}
+
+			if((MEM_RD != 0) && (MEM_RD == EX_RT))
+			{
+				ForwardB = FWD_EX_MEM;
+			}
+		}
+	}
+
+	switch (code) {
+		case OP_SLL:
+			MEM_EX.ALUOutput = EX_ID.B << shamt;
+			break;
+		case OP_SRL:
+			MEM_EX.ALUOutput = EX_ID.B >> shamt;
+			break;
+		case OP_SRA:
+			MEM_EX.ALUOutput = EX_ID.B >> shamt;
+			break;
+		case OP_SYSCALL:
+			if(EX_ID.SYSCALL == 0xA)
+			{
+				MEM_EX.ALUOutput = 0xA;
+			} 
+			break;
+		case OP_MFHI:
+			MEM_EX.ALUOutput = EX_ID.HI;
+			break;
+		case OP_MTHI:
+		case OP_MTLO:
+			MEM_EX.ALUOutput = EX_ID.A;
+			break;
+		case OP_MFLO:
+			MEM_EX.ALUOutput = EX_ID.LO;
+			break;
+		case OP_MULT:
+		case OP_MULTU:
+			product = EX_ID.A * EX_ID.B;
+			MEM_EX.ALUOutput = product >> 32;
+			MEM_EX.ALUOutput2 = product & 0xFFFFFFFF;
+			break;
+		case OP_DIV:
+		case OP_DIVU:
+			MEM_EX.ALUOutput = EX_ID.A / EX_ID.B;
+			MEM_EX.ALUOutput2 = EX_ID.A % EX_ID.B;
+			break;
+		case OP_ADD:
+		case OP_ADDU:
+			MEM_EX.ALUOutput = EX_ID.A + EX_ID.B;
+			break;
+		case OP_SUB:
+		case OP_SUBU:
+			MEM_EX.ALUOutput = EX_ID.A - EX_ID.B;
+			break;
+		case OP_AND:
+			MEM_EX.ALUOutput = EX_ID.A & EX_ID.B;
+			break;
+		case OP_OR:
+			MEM_EX.ALUOutput = EX_ID.A | EX_ID.B;
+			break;
+		case OP_XOR:
+			MEM_EX.ALUOutput = EX_ID.A ^ EX_ID.B;
+			break;
+		case OP_NOR:
+			MEM_EX.ALUOutput = ~(EX_ID.A | EX_ID.B);
+			break;
+		case OP_SLT:
+			MEM_EX.ALUOutput = EX_ID.A < EX_ID.B ? 0x00000001 : 0x00000000;
+			break;
+		case OP_ADDI:
+		case OP_ADDIU:
+			MEM_EX.ALUOutput = EX_ID.A + EX_ID.imm;
+			break;
+		case OP_ANDI:
+			MEM_EX.ALUOutput = EX_ID.imm & EX_ID.A & 0xFFFF;
+			break;
+		case OP_XORI:
+			MEM_EX.ALUOutput = EX_ID.A ^ EX_ID.imm;
+			break;
+		case OP_ORI:
+			MEM_EX.ALUOutput = EX_ID.A | EX_ID.imm;
+			break;
+		case OP_SLTI:
+			MEM_EX.ALUOutput = EX_ID.A < EX_ID.imm ? 0x00000001 : 0x00000000;
+			break;
+		case OP_LUI:
+			MEM_EX.ALUOutput = (EX_ID.imm << 16);
+			break;
+		case OP_LB:
+		case OP_LH:
+		case OP_LW:
+		case OP_SB:
+		case OP_SH:
+		case OP_SW:
+			MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
+			MEM_EX.B = EX_ID.B;
+			break;
+		case OP_LWC1:
+			MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
+			break;
+		case OP_SWC1:
+			MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
+			MEM_EX.FT = EX_ID.FT;
+			break;
+		case OP_MTC0: //written to COP0 in WB; MFC0 reads COP0 there
+			MEM_EX.ALUOutput = EX_ID.B;
+			break;
+		case OP_MFC1:
+			MEM_EX.ALUOutput = (uint32_t)EX_ID.FS;
+			break;
+		case OP_MTC1:
+			MEM_EX.FPOutput = EX_ID.B;
+			break;
+		case OP_BC1F:
+		case OP_BC1T: //the target ID redirected IF to, 0 if not taken
+			MEM_EX.ALUOutput = EX_ID.ALUOutput;
+			break;
+		default:
+			if (ISA[code].unit != FP_UNIT_NONE)
+			{
+				MEM_EX.FPOutput = fp_compute(MEM_EX.IR, EX_ID.FS, EX_ID.FT);
+				MEM_EX.ALUOutput = (uint32_t)MEM_EX.FPOutput;
+			}
+			break;
+	}
+}
+
+/************************************************************/
+/* Does the instruction in ID read what a later one produces? R-type */
+/* results in rd are checked against rs and rt, immediate results in */
+/* rt against rs only; a GPR store is held as a producer of its rt   */
+/************************************************************/
+static inline __attribute__((always_inline)) int ID_producer(uint32_t flags, uint32_t IR, uint32_t EX_RS, uint32_t EX_RT)
+{
+	uint32_t rd = (0xF800 & IR) >> 11;
+	uint32_t rt = (0x1F0000 & IR) >> 16;
+
+	if (flags & ISA_WRITES_RD)
+	{
+		return rd != 0 && (rd == EX_RS || rd == EX_RT);
+	}
+	if ((flags & (ISA_WRITES_RT | ISA_LATE)) == ISA_WRITES_RT)
+	{
+		return rt != 0 && rt == EX_RS;
+	}
+	if ((flags & (ISA_STORE | ISA_FP)) == ISA_STORE)
+	{
+		return rt != 0 && (rt == EX_RS || rt == EX_RT);
+	}
+	return FALSE;
+}
+
+/************************************************************/
+/* Must the instruction leaving ID wait a cycle? Returns the STALL_*   */
+/* causes, 0 to issue; the answer only depends on the instruction words */
+/* in ID, EX/MEM and MEM/WB                                                      */
+/************************************************************/
+static inline __attribute__((always_inline)) int ID_hazard(const int forwarding, uint32_t ID_IR, uint32_t MEM_IR, uint32_t WB_IR)
+{
+	int stall = 0;
+	uint32_t code = isa_op(ID_IR);
+	uint32_t MEM_code = isa_op(MEM_IR);
+	uint32_t WB_code = isa_op(WB_IR);
+	uint32_t flags = ISA[code].flags;
+	uint32_t MEM_flags = ISA[MEM_code].flags;
+	uint32_t WB_flags = ISA[WB_code].flags;
+	uint32_t EX_RS = (0x3E00000 & ID_IR) >> 21;
+	uint32_t EX_RT = (0x1F0000 & ID_IR) >> 16;
+
+	if (__builtin_expect((flags | MEM_flags | WB_flags) & ISA_COP, 0))
+	{
+		/*coprocessor fields name their own registers; only the GPRs the*/
+		/*table lists are checked*/
+		if (flags & ISA_COP)
+		{
+			EX_RS = flags & ISA_READS_RS ? EX_RS : 0;
+			EX_RT = flags & ISA_READS_RT ? EX_RT : 0;
+		}
+		/*MTC0's rt is checked as rs, the only operand immediate producers*/
+		/*are compared against*/
+		if (code == OP_MTC0)
+		{
+			EX_RS = EX_RT;
+			EX_RT = 0;
+		}
+		/*ERET reads EPC and Status in ID, behind any MTC0 still in flight*/
+		if (code == OP_ERET && MEM_code == OP_MTC0)
+		{
+			stall |= STALL_EX_MEM;
+		}
+		if (code == OP_ERET && WB_code == OP_MTC0)
+		{
+			stall |= STALL_MEM_WB;
+		}
+
+		/*MFC1 and MFC0 write rt late and are never forwarded*/
+		uint32_t MEM_MFC1 = MEM_flags & ISA_LATE ? (0x1F0000 & MEM_IR) >> 16 : 0;
+		uint32_t WB_MFC1 = WB_flags & ISA_LATE ? (0x1F0000 & WB_IR) >> 16 : 0;
+		if((MEM_MFC1 != 0) && (MEM_MFC1 == EX_RS || MEM_MFC1 == EX_RT))
+		{
+			stall |= STALL_EX_MEM;
+		}
+		if((WB_MFC1 != 0) && (WB_MFC1 == EX_RS || WB_MFC1 == EX_RT))
+		{
+			stall |= STALL_MEM_WB;
+		}
+	}
+
+	/*without forwarding every producer is waited for; with it, loads*/
+	/*from EX/MEM and LUI from MEM/WB still are*/
+	if((!forwarding) || (MEM_flags & ISA_LOAD))
+	{
+		if (ID_producer(MEM_flags, MEM_IR, EX_RS, EX_RT))
+		{
+			stall |= STALL_EX_MEM;
+		}
+	}
+	if((!forwarding) || WB_code == OP_LUI)
+	{
+		if (ID_producer(WB_flags, WB_IR, EX_RS, EX_RT))
+		{
+			stall |= STALL_MEM_WB;
+		}
+	}
+
+	/*without forwarding a store also waits for whatever names its*/
+	/*registers in rt*/
+	if((!forwarding) && (flags & (ISA_STORE | ISA_FP)) == ISA_STORE)
+	{
+		uint32_t MEM_RT = (0x1F0000 & MEM_IR) >> 16;
+		uint32_t WB_RT = (0x1F0000 & WB_IR) >> 16;
+		if((MEM_RT != 0) && (MEM_RT == EX_RS || MEM_RT == EX_RT))
+		{
+			stall |= STALL_STORE;
+		}
+		if((WB_RT != 0) && (WB_RT == EX_RS || WB_RT == EX_RT))
+		{
+			stall |= STALL_STORE;
+		}
+	}
+
+	return stall;
+}
+
+/************************************************************/
+/* ID_hazard and fp_hazard through the memo: a hit replays the causes */
+/* recorded for the same timing state, a miss works them out and        */
+/* records them; fp_op is NULL for a non-FP instruction                    */
+/************************************************************/
+static int ID_hazard_memo(const int forwarding, const FP_Op *fp_op)
+{
+	Memo_Entry key, *entry;
+	uint32_t slack = 0, wake, hash;
+
+	if (fp_op) {
+		wake = fp_wakeup(&FP_SCOREBOARD, FP_LATENCY, fp_op);
+		slack = wake > CYCLE_COUNT ? wake - CYCLE_COUNT : 0;
+		slack = slack < 0xFFFF ? slack : 0xFFFF;
+	}
+	key.pc = ID_IF.PC;
+	key.ir = EX_ID.IR;
+	key.mem_ir = MEM_EX.IR;
+	key.wb_ir = WB_MEM.IR;
+	key.state = MEMO_VALID | (forwarding ? MEMO_FORWARDING : 0) | slack << MEMO_SLACK_SHIFT;
+
+	hash = key.pc * 0x9E3779B1u;
+	hash = (hash ^ key.ir) * 0x85EBCA77u;
+	hash = (hash ^ key.mem_ir) * 0xC2B2AE3Du;
+	hash = (hash ^ key.wb_ir ^ key.state) * 0x27D4EB2Fu;
+	entry = &CYCLE_MEMO.entry[hash >> (32 - MEMO_BITS)];
+	if (entry->state == key.state && entry->pc == key.pc && entry->ir == key.ir
+		&& entry->mem_ir == key.mem_ir && entry->wb_ir == key.wb_ir)
+	{
+		CYCLE_MEMO.hits++;
+		return entry->stall;
+	}
+
+	CYCLE_MEMO.misses++;
+	key.stall = ID_hazard(forwarding, key.ir, key.mem_ir, key.wb_ir);
+	if (fp_op) {
+		key.stall |= fp_hazard(&FP_SCOREBOARD, FP_LATENCY, CYCLE_COUNT, fp_op);
+	}
+	*entry = key;
+	return key.stall;
+}
+
+/************************************************************/
+/* Turn the ID memo on or off, emptying it; results are the same     */
+/* either way                                                                      */
+/************************************************************/
+void memo_enable(int enable)
+{
+	CYCLE_MEMO.enabled = enable ? TRUE : FALSE;
+	memset(CYCLE_MEMO.entry, 0, sizeof(CYCLE_MEMO.entry));
+	CYCLE_MEMO.hits = 0;
+	CYCLE_MEMO.misses = 0;
+}
+
+/************************************************************/
+/* instruction decode (ID) pipeline stage:                                                         */ 
+/************************************************************/
+void ID()
+{
+	ID_stage(ENABLE_FORWARDING);
+}
+
+static inline __attribute__((always_inline)) void ID_stage(const int forwarding)
+{
+	if(CYCLE_COUNT < 2 || EX_ID.SYSCALL == 0xA)
+	{
+		return;
+	}
+
+	int stallFlag = 0;
+	if(EX_ID.IR == 0 && EX_ID.PC == 0 && EX_ID.SYSCALL == 0)
+	{
+		stallFlag = 1;
+	}
+
+	EX_ID.IR = ID_IF.IR;
+	EX_ID.PC = ID_IF.PC;
+	EX_ID.SYSCALL = ID_IF.SYSCALL;
+	uint32_t rs = (0x3E00000 & ID_IF.IR) >> 21;
+	uint32_t rt = (0x1F0000 & ID_IF.IR) >> 16;
+	uint32_t immediate = (0xFFFF & ID_IF.IR);
+	EX_ID.A = CURRENT_STATE.REGS[rs];
+	EX_ID.B = CURRENT_STATE.REGS[rt];
+	EX_ID.HI = CURRENT_STATE.HI;
+	EX_ID.LO = CURRENT_STATE.LO;
+	EX_ID.imm = (uint32_t)((int16_t)immediate);
+	uint32_t code = isa_op(EX_ID.IR);
+	uint32_t flags = ISA[code].flags;
+	int fp = __builtin_expect((flags & ISA_FP) != 0, 0);
+	FP_Op fp_op;
+
+	if (fp)
+	{
+		fp_decode(EX_ID.IR, &fp_op);
+		EX_ID.FS = next_fp_operand((0xF800 & ID_IF.IR) >> 11, fp_op.pair_source);
+		EX_ID.FT = next_fp_operand(rt, fp_op.pair_source);
+	}
+
+
+	if (stallFlag == 1 || (forwarding && (flags & (ISA_STORE | ISA_FP)) == ISA_STORE))
+	{
+		EX_ID.A = next_reg(rs);
+		EX_ID.B = next_reg(rt);
+	}
+
+
+	int stall;
+
+	if (__builtin_expect(CYCLE_MEMO.enabled, 0))
+	{
+		stall = ID_hazard_memo(forwarding, fp ? &fp_op : NULL);
+	}
+	else
+	{
+		stall = ID_hazard(forwarding, EX_ID.IR, MEM_EX.IR, WB_MEM.IR);
+		if (fp)
+		{
+			stall |= fp_hazard(&FP_SCOREBOARD, FP_LATENCY, CYCLE_COUNT, &fp_op);
+		}
+	}
+	/*a user load or store waits here while its page is looked up, in*/
+	/*the shadow of any operand stall*/
+	if (__builtin_expect(MMU.enabled, 0) && (flags & (ISA_LOAD | ISA_STORE)) && !(MMU.cp0[CP0_STATUS] & STATUS_EXL))
+	{
+		if (MMU.waited < MMU.cost)
+		{
+			MMU.waited++;
+			stall |= STALL_TLB;
+		}
+		else if (!stall)
+		{
+			MMU.waited = 0;
+		}
+	}
+	/*a store needs a free store buffer entry, counting one still in EX/MEM*/
+	if (__builtin_expect(STORE_BUFFER.enabled, 0) && (flags & ISA_STORE))
+	{
+		uint32_t ahead = (isa_flags(MEM_EX.IR) & ISA_STORE) != 0;
+		STORE_BUFFER.waiting = STORE_BUFFER.count + ahead >= STORE_BUFFER.size;
+		if (STORE_BUFFER.waiting)
+		{
+			STORE_BUFFER.full_stalls++;
+			stall |= STALL_SB_FULL;
+		}
+	}
+	if (stall)
+	{
+		EX_ID.IR = 0;
+		EX_ID.PC = 0;
+		EX_ID.SYSCALL = 0;
+		/*charged to the nearest producer when several are in the way*/
+		STATS.stalls[__builtin_ctz(stall)]++;
+		if (__builtin_expect(PROFILE.enabled, 0)) {
+			profile_stall(ID_IF.PC);
+		}
+		/*behind empty latches with nothing retiring, every cycle is this one*/
+		/*until the scoreboard frees up; let cycle_skip jump there*/
+		if (stall == STALL_FP && stallFlag && EVENTS.enabled && CYCLE_COUNT >= 5 && PENDING.flags == 0
+			&& WB_MEM.IR == 0 && WB_MEM.PC == 0 && WB_MEM.SYSCALL == 0 && STORE_BUFFER.count == 0)
+		{
+			event_schedule(fp_wakeup(&FP_SCOREBOARD, FP_LATENCY, &fp_op));
+			EVENTS.frozen = TRUE;
+		}
+	}
+	else if (fp)
+	{
+		fp_issue(&FP_SCOREBOARD, FP_LATENCY, CYCLE_COUNT, &fp_op);
+		/*BC1T/BC1F resolve here: IF fetches the delay slot this cycle, then the target*/
+		if (flags & ISA_BRANCH)
+		{
+			EX_ID.ALUOutput = ((next_fcsr() & FCSR_COND) != 0) == (rt & 1) ? ID_IF.PC + 4 + (EX_ID.imm << 2) : 0;
+			IF_REDIRECT = EX_ID.ALUOutput;
+		}
+	}
+	else if (__builtin_expect(code == OP_ERET, 0))
+	{
+		/*no delay slot: IF fetches the return address this cycle*/
+		CURRENT_STATE.PC = MMU.cp0[CP0_EPC];
+		MMU.cp0[CP0_STATUS] &= ~STATUS_EXL;
+	}
+
+	if (code == OP_SYSCALL)
+	{
+		EX_ID.SYSCALL = CURRENT_STATE.REGS[2];
+	}
+}
+
+/************************************************************/
+/* instruction fetch (IF) pipeline stage:                                                              */ 
+/************************************************************/
+void IF()
+{
+	if(CYCLE_COUNT < 1 || ID_IF.SYSCALL == 0xA || ((EX_ID.IR == 0 && EX_ID.PC == 0 && EX_ID.SYSCALL == 0) && CYCLE_COUNT > 4 && !MMU.restart))
+	{
+		return;
+	}
+	MMU.restart = FALSE;
+	
+	uint32_t code = isa_op(ID_IF.IR);
+	
+	ID_IF.IR = mem_read_32(CURRENT_STATE.PC);
+	if (__builtin_expect(CACHE_ANALYSIS.enabled, 0)) {
+		cache_access(SD_ISIDE, CURRENT_STATE.PC);
+	}
+	ID_IF.PC = CURRENT_STATE.PC;
+	CURRENT_STATE.PC = CURRENT_STATE.PC + 4;
+	if (__builtin_expect(IF_REDIRECT != 0, 0)) {
+		CURRENT_STATE.PC = IF_REDIRECT;
+		IF_REDIRECT = 0;
+		MMU.delay_slot = ID_IF.PC;
+	}
+	
+	
+	if (code == OP_SYSCALL)
+		ID_IF.SYSCALL = 0xA;
+}
+
+
+/************************************************************/
+/* Initialize Memory                                                                                                    */ 
+/************************************************************/
+void initialize() { 
+	init_memory();
+	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
+	RUN_FLAG = TRUE;
+	ENABLE_TRACE = TRUE;
+}
+
+/************************************************************/
+/* Print the program loaded into memory (in MIPS assembly format)    */ 
+/************************************************************/
+void print_program(){
+	int i;
+	uint32_t addr;
+	
+	for(i=0; i<PROGRAM_SIZE; i++){
+		addr = MEM_TEXT_BEGIN + (i*4);
+		printf("[0x%x]\t", addr);
+		print_instruction(addr);
+	}
+}
+
+void print_instruction(uint32_t addr){
+	uint32_t instruction = mem_read_32(addr);
+	uint32_t code = isa_op(instruction);
+	const char *name = ISA[code].mnemonic;
+	uint32_t rs = (0x3E00000 & instruction) >> 21;
+	uint32_t rt = (0x1F0000 & instruction) >> 16;
+	uint32_t immediate = (0xFFFF & instruction);
+	uint32_t rd = (0xF800 & instruction) >> 11;
+	uint32_t shamt = (0x7C0 & instruction) >> 6;
+	uint32_t offset = (0x3FFFFFF & instruction);
+	uint32_t fd = (0x7C0 & instruction) >> 6;
+	const char *fmt = rs == 0x10 ? "S" : rs == 0x11 ? "D" : "W";
+
+	switch (ISA[code].format) {
+		case FMT_NONE:
+			if (code != OP_UNKNOWN) {
+				printf("%s\n", name);
+			}
+			break;
+		case FMT_R3:
+			printf("%s $%d, $%d, $%d\n", name, rd, rs, rt);
+			break;
+		case FMT_SHIFT:
+			printf("%s $%d, $%d, 0x%x\n", name, rd, rt, shamt);
+			break;
+		case FMT_RS:
+			printf("%s $%d\n", name, rs);
+			break;
+		case FMT_RD:
+			printf("%s $%d\n", name, rd);
+			break;
+		case FMT_RS_RD:
+		case FMT_RS_RT:
+			printf("%s $%d, $%d\n", name, rs, ISA[code].format == FMT_RS_RD ? rd : rt);
+			break;
+		case FMT_IMM:
+			printf("%s $%d, $%d, 0x%x\n", name, rt, rs, immediate);
+			break;
+		case FMT_LUI:
+			printf("%s $%d, 0x%x\n", name, rt, immediate);
+			break;
+		case FMT_BRANCH:
+			printf("%s $%d, $%d, 0x%x\n", name, rs, rt, (uint32_t)(immediate * 4));
+			break;
+		case FMT_BRANCH_Z:
+			printf("%s $%d, 0x%x\n", name, rs, (uint32_t)(immediate * 4));
+			break;
+		case FMT_JUMP:
+			printf("%s 0x%x\n", name, offset);
+			break;
+		case FMT_MEM:
+			printf("%s $%d, 0x%x($%d)\n", name, rt, immediate, rs);
+			break;
+		case FMT_FP_MEM:
+			printf("%s $f%d, 0x%x($%d)\n", name, rt, immediate, rs);
+			break;
+		case FMT_COP0_MOVE:
+			printf("%s $%d, $%d\n", name, rt, rd);
+			break;
+		case FMT_COP1_MOVE:
+			printf("%s $%d, $f%d\n", name, rt, rd);
+			break;
+		case FMT_FP_BRANCH:
+			printf("%s 0x%x\n", name, (uint32_t)(immediate * 4));
+			break;
+		case FMT_FP3:
+			printf("%s.%s $f%d, $f%d, $f%d\n", name, fmt, fd, rd, rt);
+			break;
+		case FMT_FP2:
+			printf("%s.%s $f%d, $f%d\n", name, fmt, fd, rd);
+			break;
+		case FMT_FP_CMP:
+			printf("%s.%s $f%d, $f%d\n", name, fmt, rd, rt);
+			break;
+	}
+}
+
+/************************************************************/
+/* Print the current pipeline                                                                                    */ 
+/************************************************************/
+void show_pipeline(){
+	printf("Current PC:\t\t%X\n", CURRENT_STATE.PC);
+	printf("IF/ID.IR\t\t%X  ", ID_IF.IR);
+	print_instruction(ID_IF.PC);
+	printf("IF/ID.PC\t\t%X\n", ID_IF.PC);
+	printf("\n");
+	printf("ID/EX.IR\t\t%X  ", EX_ID.IR);
+	print_instruction(EX_ID.PC);
+	printf("ID/EX.A\t\t%X\n", EX_ID.A);
+	printf("ID/EX.B\t\t%X\n", EX_ID.B);
+	printf("ID/EX.imm\t\t%X\n", EX_ID.imm);
+	printf("\n");
+	printf("EX/MEM.IR\t\t%X ", MEM_EX.IR);
+	print_instruction(MEM_EX.PC);
+	printf("EX/MEM.A\t\t%X\n", MEM_EX.A);
+	printf("EX/MEM.B\t\t%X\n", MEM_EX.B);
+	printf("EX/MEM.ALUOutput\t\t%X\n", MEM_EX.ALUOutput);
+	printf("EX/MEM.ALUOutput2\t\t%X\n", MEM_EX.ALUOutput2);
+	printf("\n");
+	printf("MEM/WEB.IR\t\t%X", WB_MEM.IR);
+	print_instruction(WB_MEM.PC);
+	printf("MEM/WEB.A\t\t%X\n", WB_MEM.IR);
+	printf("MEM/WEB.LMD\t\t%X\n", WB_MEM.IR);
+}
+
+/************************************************************/
+/* Check armed breakpoints and watchpoints after a cycle                */ 
+/************************************************************/
+void debug_check()
+{
+	int i, hit = DEBUG.hit;
+
+	for (i = 0; i < DEBUG.num_pc; i++) {
+		if (CURRENT_STATE.PC == DEBUG.pc[i] && DEBUG.last_pc != DEBUG.pc[i]) {
+			printf("Breakpoint: PC 0x%08x reached at cycle %u\n", DEBUG.pc[i], CYCLE_COUNT);
+			hit = TRUE;
+		}
+	}
+	DEBUG.last_pc = CURRENT_STATE.PC;
+
+	for (i = 0; i < DEBUG.num_cycle; i++) {
+		if (CYCLE_COUNT == DEBUG.cycle[i]) {
+			printf("Breakpoint: cycle %u reached\n", CYCLE_COUNT);
+			hit = TRUE;
+		}
+	}
+
+	for (i = 0; i < DEBUG.num_reg; i++) {
+		uint32_t value = CURRENT_STATE.REGS[DEBUG.reg[i]];
+		if (value == DEBUG.reg_value[i] && DEBUG.reg_last[i] != value) {
+			printf("Watchpoint: R%u became 0x%08x at cycle %u\n", DEBUG.reg[i], value, CYCLE_COUNT);
+			hit = TRUE;
+		}
+		DEBUG.reg_last[i] = value;
+	}
+
+	if (DEBUG.on_stall && CYCLE_COUNT > 3 && EX_ID.IR == 0 && EX_ID.PC == 0 && EX_ID.SYSCALL == 0) {
+		printf("Breakpoint: stall inserted before [0x%x] at cycle %u\n", ID_IF.PC, CYCLE_COUNT);
+		hit = TRUE;
+	}
+
+	if (hit) {
+		DEBUG.hit = TRUE;
+		DEBUG.paused = DEBUG.paused || RUN_FLAG;
+		RUN_FLAG = FALSE;
+	}
+}
+
+/************************************************************/
+/* A write landed on a watched page: compare against the watched   */ 
+/* words of that page only                                                          */ 
+/************************************************************/
+void debug_mem_write(uint32_t address)
+{
+	int i;
+	if (!(CYCLE_HOOKS & HOOK_DEBUG)) {
+		return;
+	}
+	for (i = 0; i < DEBUG.num_mem; i++) {
+		if (address + 3 >= DEBUG.mem[i] && address <= DEBUG.mem[i] + 3) {
+			printf("Watchpoint: [0x%08x] written with 0x%08x at cycle %u\n", DEBUG.mem[i], mem_read_32(address), CYCLE_COUNT);
+			DEBUG.hit = TRUE;
+		}
+	}
+}
+
+/************************************************************/
+/* Resume after a breakpoint; returns TRUE if one stopped the run    */ 
+/************************************************************/
+int debug_resume()
+{
+	if (!DEBUG.hit) {
+		return FALSE;
+	}
+	DEBUG.hit = FALSE;
+	if (DEBUG.paused) {
+		RUN_FLAG = TRUE;
+		DEBUG.paused = FALSE;
+		printf("Simulation Paused at cycle %u.\n\n", CYCLE_COUNT);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/************************************************************/
+/* Arm breakpoints and watchpoints                                              */ 
+/************************************************************/
+void debug_break_pc(uint32_t pc)
+{
+	if (DEBUG.num_pc < MAX_BREAKPOINTS) {
+		DEBUG.pc[DEBUG.num_pc++] = pc;
+		DEBUG.last_pc = CURRENT_STATE.PC;
+		CYCLE_HOOKS |= HOOK_DEBUG;
+	}
+}
+
+void debug_break_cycle(uint32_t cycle)
+{
+	if (DEBUG.num_cycle < MAX_BREAKPOINTS) {
+		DEBUG.cycle[DEBUG.num_cycle++] = cycle;
+		CYCLE_HOOKS |= HOOK_DEBUG;
+	}
+}
+
+void debug_break_stall()
+{
+	DEBUG.on_stall = TRUE;
+	CYCLE_HOOKS |= HOOK_DEBUG;
+}
+
+void debug_watch_reg(uint32_t reg, uint32_t value)
+{
+	if (DEBUG.num_reg < MAX_BREAKPOINTS && reg < MIPS_REGS) {
+		DEBUG.reg[DEBUG.num_reg] = reg;
+		DEBUG.reg_value[DEBUG.num_reg] = value;
+		DEBUG.reg_last[DEBUG.num_reg] = CURRENT_STATE.REGS[reg];
+		DEBUG.num_reg++;
+		CYCLE_HOOKS |= HOOK_DEBUG;
+	}
+}
+
+int debug_watch_mem(uint32_t address)
+{
+	mem_region_t *region = mem_region(address);
+	if (DEBUG.num_mem == MAX_BREAKPOINTS || region == NULL) {
+		return FALSE;
+	}
+	DEBUG.mem[DEBUG.num_mem++] = address;
+	region->page_flags[(address - region->begin) >> MEM_PAGE_SHIFT] |= PAGE_WATCHED;
+	CYCLE_HOOKS |= HOOK_DEBUG;
+	return TRUE;
+}
+
+/************************************************************/
+/* List armed breakpoints and watchpoints                                    */ 
+/************************************************************/
+void debug_list()
+{
+	int i;
+	for (i = 0; i < DEBUG.num_pc; i++) {
+		printf("break pc 0x%08x\n", DEBUG.pc[i]);
+	}
+	for (i = 0; i < DEBUG.num_cycle; i++) {
+		printf("break cycle %u\n", DEBUG.cycle[i]);
+	}
+	if (DEBUG.on_stall) {
+		printf("break stall\n");
+	}
+	for (i = 0; i < DEBUG.num_reg; i++) {
+		printf("watch reg %u 0x%08x\n", DEBUG.reg[i], DEBUG.reg_value[i]);
+	}
+	for (i = 0; i < DEBUG.num_mem; i++) {
+		printf("watch mem 0x%08x\n", DEBUG.mem[i]);
+	}
+}
+
+/************************************************************/
+/* Remove all breakpoints and watchpoints                                    */ 
+/************************************************************/
+void debug_clear()
+{
+	int i;
+	mem_region_t *region;
+	for (i = 0; i < DEBUG.num_mem; i++) {
+		region = mem_region(DEBUG.mem[i]);
+		region->page_flags[(DEBUG.mem[i] - region->begin) >> MEM_PAGE_SHIFT] &= ~PAGE_WATCHED;
+	}
+	memset(&DEBUG, 0, sizeof(DEBUG));
+	CYCLE_HOOKS &= ~HOOK_DEBUG;
+}
+
+/************************************************************/
+/* Start taking a checkpoint every interval cycles (0 turns it off)      */ 
+/************************************************************/
+void checkpoint_enable(uint32_t interval)
+{
+	TIME_TRAVEL.interval = interval;
+	TIME_TRAVEL.num_ckpt = 0;
+	TIME_TRAVEL.log_head = 0;
+	TIME_TRAVEL.log_tail = 0;
+	if (interval == 0) {
+		TIME_TRAVEL.logging = FALSE;
+		CYCLE_HOOKS &= ~HOOK_CHECKPOINT;
+		free(TIME_TRAVEL.log);
+		TIME_TRAVEL.log = NULL;
+		return;
+	}
+	if (TIME_TRAVEL.log == NULL) {
+		TIME_TRAVEL.log = malloc(UNDO_LOG_SIZE * sizeof(Mem_Undo_Entry));
+	}
+	TIME_TRAVEL.logging = TRUE;
+	CYCLE_HOOKS |= HOOK_CHECKPOINT;
+	checkpoint_take();
+}
+
+/************************************************************/
+/* Save registers, pipeline latches and the undo log position         */ 
+/************************************************************/
+void checkpoint_take()
+{
+	Checkpoint *ckpt;
+	int i, keep;
+
+	/*when full, keep every other checkpoint (and the newest) and halve the rate*/
+	if (TIME_TRAVEL.num_ckpt == MAX_CHECKPOINTS) {
+		keep = 0;
+		for (i = (MAX_CHECKPOINTS - 1) % 2; i < MAX_CHECKPOINTS; i += 2) {
+			TIME_TRAVEL.ckpt[keep++] = TIME_TRAVEL.ckpt[i];
+		}
+		TIME_TRAVEL.num_ckpt = keep;
+		TIME_TRAVEL.log_tail = TIME_TRAVEL.ckpt[0].log_pos;
+		TIME_TRAVEL.interval *= 2;
+	}
+	if (TIME_TRAVEL.num_ckpt == 0) {
+		TIME_TRAVEL.log_tail = TIME_TRAVEL.log_head;
+	}
+
+	ckpt = &TIME_TRAVEL.ckpt[TIME_TRAVEL.num_ckpt++];
+	ckpt->cycle = CYCLE_COUNT;
+	ckpt->log_pos = TIME_TRAVEL.log_head;
+	ckpt->state = CURRENT_STATE;
+	ckpt->id_if = ID_IF;
+	ckpt->ex_id = EX_ID;
+	ckpt->mem_ex = MEM_EX;
+	ckpt->wb_mem = WB_MEM;
+	ckpt->fp_scoreboard = FP_SCOREBOARD;
+	memcpy(ckpt->cp0, MMU.cp0, sizeof(MMU.cp0));
+	memcpy(ckpt->tlb, MMU.tlb, sizeof(MMU.tlb));
+	ckpt->mmu_waited = MMU.waited;
+	ckpt->mmu_delay_slot = MMU.delay_slot;
+	memcpy(ckpt->sb, STORE_BUFFER.entry, sizeof(STORE_BUFFER.entry));
+	ckpt->sb_head = STORE_BUFFER.head;
+	ckpt->sb_count = STORE_BUFFER.count;
+	ckpt->sb_busy = STORE_BUFFER.busy;
+	ckpt->sb_waiting = STORE_BUFFER.waiting;
+	ckpt->forward_a = ForwardA;
+	ckpt->forward_b = ForwardB;
+	ckpt->run_flag = RUN_FLAG;
+	ckpt->instruction_count = INSTRUCTION_COUNT;
+	ckpt->stats = STATS;
+	TIME_TRAVEL.next_cycle = CYCLE_COUNT + TIME_TRAVEL.interval;
+}
+
+/************************************************************/
+/* Remember the old value of a word about to be written                */ 
+/************************************************************/
+void checkpoint_log(uint32_t address, uint32_t old_value)
+{
+	Mem_Undo_Entry *entry;
+	int drop = 0;
+
+	/*the log is full: forget the checkpoints that need its oldest entries*/
+	if (TIME_TRAVEL.log_head - TIME_TRAVEL.log_tail == UNDO_LOG_SIZE) {
+		while (drop < TIME_TRAVEL.num_ckpt && TIME_TRAVEL.ckpt[drop].log_pos <= TIME_TRAVEL.log_tail) {
+			drop++;
+		}
+		checkpoint_drop(drop);
+		TIME_TRAVEL.log_tail = TIME_TRAVEL.num_ckpt ? TIME_TRAVEL.ckpt[0].log_pos : TIME_TRAVEL.log_head;
+		if (TIME_TRAVEL.num_ckpt == 0) {
+			TIME_TRAVEL.next_cycle = CYCLE_COUNT;
+		}
+	}
+	entry = &TIME_TRAVEL.log[TIME_TRAVEL.log_head % UNDO_LOG_SIZE];
+	entry->address = address;
+	entry->old_value = old_value;
+	TIME_TRAVEL.log_head++;
+}
+
+/************************************************************/
+/* Forget the oldest count checkpoints                                             */ 
+/************************************************************/
+void checkpoint_drop(int count)
+{
+	if (count <= 0) {
+		return;
+	}
+	TIME_TRAVEL.num_ckpt -= count;
+	memmove(&TIME_TRAVEL.ckpt[0], &TIME_TRAVEL.ckpt[count], TIME_TRAVEL.num_ckpt * sizeof(Checkpoint));
+}
+
+/************************************************************/
+/* Step back num_cycles: restore the nearest earlier checkpoint and    */ 
+/* replay forward to the requested cycle without tracing                  */ 
+/* Returns FALSE when no checkpoint is old enough                          */ 
+/************************************************************/
+int back(uint32_t num_cycles)
+{
+	uint32_t target = num_cycles > CYCLE_COUNT ? 0 : CYCLE_COUNT - num_cycles;
+	uint32_t hooks, replayed;
+	Checkpoint *ckpt;
+	Mem_Undo_Entry *entry;
+	int i, trace;
+
+	for (i = TIME_TRAVEL.num_ckpt - 1; i >= 0; i--) {
+		if (TIME_TRAVEL.ckpt[i].cycle <= target) {
+			break;
+		}
+	}
+	if (i < 0) {
+		if (TIME_TRAVEL.num_ckpt == 0) {
+			printf("No checkpoint to go back to; turn them on with checkpoint <n>\n");
+		} else {
+			printf("Cannot go back to cycle %u: the oldest checkpoint is cycle %u\n", target, TIME_TRAVEL.ckpt[0].cycle);
+		}
+		return FALSE;
+	}
+	ckpt = &TIME_TRAVEL.ckpt[i];
+
+	/*undo memory writes newest first, without logging or watching them*/
+	hooks = CYCLE_HOOKS;
+	CYCLE_HOOKS &= ~HOOK_DEBUG;
+	TIME_TRAVEL.logging = FALSE;
+	while (TIME_TRAVEL.log_head > ckpt->log_pos) {
+		TIME_TRAVEL.log_head--;
+		entry = &TIME_TRAVEL.log[TIME_TRAVEL.log_head % UNDO_LOG_SIZE];
+		mem_write_32(entry->address, entry->old_value);
+	}
+	TIME_TRAVEL.logging = TRUE;
+
+	CYCLE_COUNT = ckpt->cycle;
+	CURRENT_STATE = ckpt->state;
+	ID_IF = ckpt->id_if;
+	EX_ID = ckpt->ex_id;
+	MEM_EX = ckpt->mem_ex;
+	WB_MEM = ckpt->wb_mem;
+	FP_SCOREBOARD = ckpt->fp_scoreboard;
+	memcpy(MMU.cp0, ckpt->cp0, sizeof(MMU.cp0));
+	memcpy(MMU.tlb, ckpt->tlb, sizeof(MMU.tlb));
+	MMU.waited = ckpt->mmu_waited;
+	MMU.delay_slot = ckpt->mmu_delay_slot;
+	mmu_micro_flush();
+	memcpy(STORE_BUFFER.entry, ckpt->sb, sizeof(STORE_BUFFER.entry));
+	STORE_BUFFER.head = ckpt->sb_head;
+	STORE_BUFFER.count = ckpt->sb_count;
+	STORE_BUFFER.busy = ckpt->sb_busy;
+	STORE_BUFFER.waiting = ckpt->sb_waiting;
+	ForwardA = ckpt->forward_a;
+	ForwardB = ckpt->forward_b;
+	RUN_FLAG = ckpt->run_flag;
+	INSTRUCTION_COUNT = ckpt->instruction_count;
+	STATS = ckpt->stats;
+	TIME_TRAVEL.num_ckpt = i + 1;
+	TIME_TRAVEL.next_cycle = CYCLE_COUNT + TIME_TRAVEL.interval;
+	if (COSIM_FLAG) {
+		cosim_enable(TRUE);
+	}
+
+	trace = ENABLE_TRACE;
+	ENABLE_TRACE = FALSE;
+	replayed = 0;
+	while (CYCLE_COUNT < target && RUN_FLAG) {
+		replayed += cycle_skip(target - CYCLE_COUNT);
+	}
+	ENABLE_TRACE = trace;
+	CYCLE_HOOKS = hooks;
+	DEBUG.hit = FALSE;
+	DEBUG.last_pc = CURRENT_STATE.PC;
+
+	if (trace) {
+		printf("Back at cycle %u (restored checkpoint of cycle %u, replayed %u cycles)\n", CYCLE_COUNT, TIME_TRAVEL.ckpt[i].cycle, replayed);
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* Execute one instruction on the ISA-level reference model            */ 
+/* Returns FALSE once the program exits through SYSCALL               */ 
+/************************************************************/
+int ref_step(CPU_State *state, Mem_Store_Record *store)
+{
+	uint32_t instruction = mem_read_32(state->PC);
+	uint32_t code = isa_op(instruction);
+	uint32_t rs = (0x3E00000 & instruction) >> 21;
+	uint32_t rt = (0x1F0000 & instruction) >> 16;
+	uint32_t rd = (0xF800 & instruction) >> 11;
+	uint32_t shamt = (0x7C0 & instruction) >> 6;
+	uint32_t immediate = (0xFFFF & instruction);
+	uint32_t simm = (uint32_t)((int16_t)immediate);
+	uint32_t A = state->REGS[rs];
+	uint32_t B = state->REGS[rt];
+	uint32_t address = A + simm;
+	uint32_t target = state->BRANCH_TARGET;
+	int64_t product;
+	uint64_t uproduct;
+	uint64_t result;
+	FP_Op fp_op;
+
+	store->valid = FALSE;
+	state->PC += 4;
+	state->BRANCH_TARGET = 0;
+
+	switch (code) {
+		case OP_SLL:
+			state->REGS[rd] = B << shamt;
+			break;
+		case OP_SRL:
+			state->REGS[rd] = B >> shamt;
+			break;
+		case OP_SRA:
+			state->REGS[rd] = (uint32_t)((int32_t)B >> shamt);
+			break;
+		case OP_SYSCALL:
+			if (state->REGS[2] == 0xA) {
+				return FALSE;
+			}
+			break;
+		case OP_MFHI:
+			state->REGS[rd] = state->HI;
+			break;
+		case OP_MTHI:
+			state->HI = A;
+			break;
+		case OP_MFLO:
+			state->REGS[rd] = state->LO;
+			break;
+		case OP_MTLO:
+			state->LO = A;
+			break;
+		case OP_MULT:
+			product = (int64_t)(int32_t)A * (int64_t)(int32_t)B;
+			state->HI = (uint32_t)((uint64_t)product >> 32);
+			state->LO = (uint32_t)product;
+			break;
+		case OP_MULTU:
+			uproduct = (uint64_t)A * (uint64_t)B;
+			state->HI = (uint32_t)(uproduct >> 32);
+			state->LO = (uint32_t)uproduct;
+			break;
+		case OP_DIV:
+			if (B != 0) {
+				state->LO = (uint32_t)((int32_t)A / (int32_t)B);
+				state->HI = (uint32_t)((int32_t)A % (int32_t)B);
+			}
+			break;
+		case OP_DIVU:
+			if (B != 0) {
+				state->LO = A / B;
+				state->HI = A % B;
+			}
+			break;
+		case OP_ADD:
+		case OP_ADDU:
+			state->REGS[rd] = A + B;
+			break;
+		case OP_SUB:
+		case OP_SUBU:
+			state->REGS[rd] = A - B;
+			break;
+		case OP_AND:
+			state->REGS[rd] = A & B;
+			break;
+		case OP_OR:
+			state->REGS[rd] = A | B;
+			break;
+		case OP_XOR:
+			state->REGS[rd] = A ^ B;
+			break;
+		case OP_NOR:
+			state->REGS[rd] = ~(A | B);
+			break;
+		case OP_SLT:
+			state->REGS[rd] = ((int32_t)A < (int32_t)B) ? 1 : 0;
+			break;
+		case OP_ADDI:
+		case OP_ADDIU:
+			state->REGS[rt] = A + simm;
+			break;
+		case OP_ANDI:
+			state->REGS[rt] = A & immediate;
+			break;
+		case OP_ORI:
+			state->REGS[rt] = A | immediate;
+			break;
+		case OP_XORI:
+			state->REGS[rt] = A ^ immediate;
+			break;
+		case OP_SLTI:
+			state->REGS[rt] = ((int32_t)A < (int32_t)simm) ? 1 : 0;
+			break;
+		case OP_LUI:
+			state->REGS[rt] = immediate << 16;
+			break;
+		case OP_LB:
+			state->REGS[rt] = (uint32_t)((int8_t)(mem_read_32(address) & 0xFF));
+			break;
+		case OP_LH:
+			state->REGS[rt] = (uint32_t)((int16_t)(mem_read_32(address) & 0xFFFF));
+			break;
+		case OP_LW:
+			state->REGS[rt] = mem_read_32(address);
+			break;
+		case OP_SB:
+			store->valid = TRUE;
+			store->address = address;
+			store->mask = 0xFF;
+			store->new_value = B;
+			break;
+		case OP_SH:
+			store->valid = TRUE;
+			store->address = address;
+			store->mask = 0xFFFF;
+			store->new_value = B;
+			break;
+		case OP_SW:
+			store->valid = TRUE;
+			store->address = address;
+			store->mask = 0xFFFFFFFF;
+			store->new_value = B;
+			break;
+		case OP_LWC1:
+			state->FPR[rt] = mem_read_32(address);
+			break;
+		case OP_SWC1:
+			store->valid = TRUE;
+			store->address = address;
+			store->mask = 0xFFFFFFFF;
+			store->new_value = state->FPR[rt];
+			break;
+		case OP_MFC1:
+			state->REGS[rt] = state->FPR[rd];
+			break;
+		case OP_MTC1:
+			state->FPR[rd] = B;
+			break;
+		case OP_BC1F:
+		case OP_BC1T:
+			if (((state->FCSR & FCSR_COND) != 0) == (rt & 1)) {
+				state->BRANCH_TARGET = state->PC + (simm << 2);
+			}
+			break;
+		default:
+			if (ISA[code].unit == FP_UNIT_NONE) {
+				break;
+			}
+			fp_decode(instruction, &fp_op);
+			result = fp_compute(instruction, fp_read(state->FPR, rd, fp_op.pair_source), fp_read(state->FPR, rt, fp_op.pair_source));
+			if (fp_op.writes_cond) {
+				state->FCSR = (state->FCSR & ~FCSR_COND) | (result ? FCSR_COND : 0);
+			}
+			else if (fp_op.writes) {
+				state->FPR[__builtin_ctz(fp_op.writes)] = (uint32_t)result;
+				if (fp_op.pair_result) {
+					state->FPR[__builtin_ctz(fp_op.writes) + 1] = (uint32_t)(result >> 32);
+				}
+			}
+			break;
+	}
+	/*the previous instruction was a taken branch and this its delay slot*/
+	if (target) {
+		state->PC = target;
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* Turn co-simulation on/off; the reference model starts from the    */ 
+/* current architectural state at the next retirement                   */ 
+/************************************************************/
+void cosim_enable(int enable)
+{
+	COSIM_FLAG = enable;
+	if (enable) {
+		REF_STATE = CURRENT_STATE;
+		COSIM_SYNC = TRUE;
+		COSIM_CHECKED = 0;
+		PIPE_STORE.valid = FALSE;
+	}
+}
+
+/************************************************************/
+/* Report the first divergence and stop the simulation                     */ 
+/************************************************************/
+void cosim_divergence(const char *what)
+{
+	printf("\n*** CO-SIMULATION DIVERGENCE at cycle %u, after %u matching instructions ***\n", CYCLE_COUNT, COSIM_CHECKED);
+	printf("Retiring [0x%x]\t", WB_MEM.PC);
+	print_instruction(WB_MEM.PC);
+	printf("%s\n", what);
+	COSIM_FLAG = FALSE;
+	RUN_FLAG = FALSE;
+}
+
+/************************************************************/
+/* Step the reference model past the instruction retiring in WB and    */ 
+/* compare architectural state with the pipeline                            */ 
+/************************************************************/
+void cosim_check()
+{
+	Mem_Store_Record ref_store;
+	char report[128];
+	uint32_t expected;
+	int i, running;
+
+	if (COSIM_SYNC) {
+		REF_STATE.PC = WB_MEM.PC;
+		COSIM_SYNC = FALSE;
+	}
+
+	if (REF_STATE.PC != WB_MEM.PC) {
+		sprintf(report, "PC\t: pipeline 0x%08x reference 0x%08x", WB_MEM.PC, REF_STATE.PC);
+		cosim_divergence(report);
+		return;
+	}
+
+	running = ref_step(&REF_STATE, &ref_store);
+
+	if (ref_store.valid != PIPE_STORE.valid) {
+		sprintf(report, "Store\t: pipeline %s, reference %s", PIPE_STORE.valid ? "stored" : "did not store", ref_store.valid ? "stored" : "did not store");
+		cosim_divergence(report);
+		return;
+	}
+	if (ref_store.valid) {
+		PIPE_STORE.valid = FALSE;
+		expected = (PIPE_STORE.old_value & ~ref_store.mask) | (ref_store.new_value & ref_store.mask);
+		if (PIPE_STORE.address != ref_store.address || PIPE_STORE.new_value != expected) {
+			sprintf(report, "Store\t: pipeline 0x%08x -> [0x%08x] reference 0x%08x -> [0x%08x]", PIPE_STORE.new_value, PIPE_STORE.address, expected, ref_store.address);
+			cosim_divergence(report);
+			return;
+		}
+	}
+
+	for (i = 0; i < MIPS_REGS; i++) {
+		if (next_reg(i) != REF_STATE.REGS[i]) {
+			sprintf(report, "[R%d]\t: pipeline 0x%08x reference 0x%08x", i, next_reg(i), REF_STATE.REGS[i]);
+			cosim_divergence(report);
+			return;
+		}
+	}
+	if (next_hi() != REF_STATE.HI || next_lo() != REF_STATE.LO) {
+		sprintf(report, "[HI/LO]\t: pipeline 0x%08x/0x%08x reference 0x%08x/0x%08x", next_hi(), next_lo(), REF_STATE.HI, REF_STATE.LO);
+		cosim_divergence(report);
+		return;
+	}
+	for (i = 0; i < MIPS_FP_REGS; i++) {
+		if (next_fpr(i) != REF_STATE.FPR[i]) {
+			sprintf(report, "[F%d]\t: pipeline 0x%08x reference 0x%08x", i, next_fpr(i), REF_STATE.FPR[i]);
+			cosim_divergence(report);
+			return;
+		}
+	}
+	if (next_fcsr() != REF_STATE.FCSR) {
+		sprintf(report, "[FCSR]\t: pipeline 0x%08x reference 0x%08x", next_fcsr(), REF_STATE.FCSR);
+		cosim_divergence(report);
+		return;
+	}
+
+	if (running != RUN_FLAG) {
+		sprintf(report, "SYSCALL\t: pipeline %s, reference %s", RUN_FLAG ? "kept running" : "exited", running ? "kept running" : "exited");
+		cosim_divergence(report);
+		return;
+	}
+	COSIM_CHECKED++;
+}
+
+/************************************************************/
+/* Add an event at a future cycle. Within EVENT_WHEEL_SIZE cycles it   */
+/* takes the slot of its cycle; past that only the earliest is kept,   */
+/* which is enough while events only wake a frozen pipeline that      */
+/* schedules its own wake-up again                                              */
+/************************************************************/
+void event_schedule(uint32_t cycle)
+{
+	if (cycle <= CYCLE_COUNT) {
+		return;
+	}
+	if (cycle - CYCLE_COUNT >= EVENT_WHEEL_SIZE) {
+		if (EVENTS.far <= CYCLE_COUNT || cycle < EVENTS.far) {
+			EVENTS.far = cycle;
+		}
+		return;
+	}
+	EVENTS.occupied |= 1ULL << (cycle & (EVENT_WHEEL_SIZE - 1));
+	EVENTS.due[cycle & (EVENT_WHEEL_SIZE - 1)] = cycle;
+}
+
+/************************************************************/
+/* Cycle of the earliest event at or after now, 0 if none; slots that */
+/* have gone by are emptied on the way                                          */
+/************************************************************/
+uint32_t event_next(uint32_t now)
+{
+	uint32_t shift = now & (EVENT_WHEEL_SIZE - 1);
+	uint64_t pending = EVENTS.occupied;
+	uint32_t slot, next = 0;
+
+	/*bit 0 is now's slot, then the following cycles in order*/
+	if (shift) {
+		pending = (pending >> shift) | (pending << (EVENT_WHEEL_SIZE - shift));
+	}
+	for (; pending; pending &= pending - 1) {
+		slot = (__builtin_ctzll(pending) + shift) & (EVENT_WHEEL_SIZE - 1);
+		if (EVENTS.due[slot] >= now) {
+			next = EVENTS.due[slot];
+			break;
+		}
+		EVENTS.occupied &= ~(1ULL << slot);
+	}
+	if (EVENTS.far >= now && (next == 0 || EVENTS.far < next)) {
+		next = EVENTS.far;
+	}
+	return next;
+}
+
+/************************************************************/
+/* Turn idle-cycle skipping on or off; results are the same either way */
+/************************************************************/
+void event_skip_enable(int enable)
+{
+	EVENTS.enabled = enable ? TRUE : FALSE;
+	EVENTS.frozen = FALSE;
+}
+
+/************************************************************/
+/* The pipeline feature that sampling, decoupled, replayed and barrel   */
+/* timing do not model, or NULL when they match the pipeline              */
+/************************************************************/
+const char *engine_unmodelled()
+{
+	if (MMU.enabled) {
+		return "the MMU";
+	}
+	if (STORE_BUFFER.enabled) {
+		return "the store buffer";
+	}
+	return NULL;
+}
+
+/************************************************************/
+/* Run functionally for count instructions; FALSE once the program ends */ 
+/************************************************************/
+static int sample_forward(uint32_t count, uint64_t *executed)
+{
+	Mem_Store_Record store;
+	uint32_t text_end = MEM_TEXT_BEGIN + PROGRAM_SIZE * 4;
+	uint32_t old_value;
+
+	/*never stop between a taken branch and its delay slot*/
+	while (count || CURRENT_STATE.BRANCH_TARGET) {
+		count -= count ? 1 : 0;
+		if (CURRENT_STATE.PC < MEM_TEXT_BEGIN || CURRENT_STATE.PC >= text_end) {
+			return FALSE;
+		}
+		(*executed)++;
+		if (!ref_step(&CURRENT_STATE, &store)) {
+			return FALSE;
+		}
+		if (store.valid) {
+			old_value = mem_read_32(store.address);
+			mem_write_32(store.address, (old_value & ~store.mask) | (store.new_value & store.mask));
+		}
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* Run one detailed window from an empty pipeline; the CPI of the last */
+/* window instructions goes to *cpi, -1 if they never retired            */
+/************************************************************/
+static int sample_window(uint32_t warmup, uint32_t window, uint64_t *executed, double *cpi)
+{
+	uint32_t start_pc = CURRENT_STATE.PC;
+	uint32_t retiring_pc, last_pc = 0, retired = 0, start_cycle = 0;
+	uint32_t retiring_target, branch_target = 0, delay_target = 0;
+	uint32_t limit = SAMPLE_CYCLE_LIMIT * (warmup + window) + 8;
+	int measuring = (warmup == 0);
+
+	reset_pipeline();
+	*cpi = -1;
+	while (RUN_FLAG && INSTRUCTION_COUNT < warmup + window && CYCLE_COUNT < limit) {
+		/*MEM refills WB_MEM within the cycle, so note what WB retires first*/
+		retiring_pc = WB_MEM.PC;
+		retiring_target = isa_flags(WB_MEM.IR) & ISA_BRANCH ? WB_MEM.ALUOutput : 0;
+		cycle();
+		if (INSTRUCTION_COUNT != retired) {
+			retired = INSTRUCTION_COUNT;
+			last_pc = retiring_pc;
+			delay_target = branch_target;
+			branch_target = retiring_target;
+		}
+		if (!measuring && INSTRUCTION_COUNT >= warmup) {
+			measuring = TRUE;
+			start_cycle = CYCLE_COUNT;
+		}
+	}
+	if (INSTRUCTION_COUNT >= warmup + window) {
+		*cpi = (double)(CYCLE_COUNT - start_cycle) / window;
+	}
+	*executed += retired;
+	/*the functional model goes on from memory*/
+	store_buffer_drain();
+
+	/*instructions behind the last retired one are refetched functionally,*/
+	/*through the delay slot of a taken BC1 that retired last*/
+	CURRENT_STATE.PC = retired ? last_pc + 4 : start_pc;
+	if (branch_target) {
+		CURRENT_STATE.BRANCH_TARGET = branch_target;
+	}
+	else if (delay_target) {
+		CURRENT_STATE.PC = delay_target;
+	}
+	return RUN_FLAG;
+}
+
+/************************************************************/
+/* Sampled simulation: detailed windows of warmup + window instructions */
+/* every period instructions, fast-forwarded functionally in between;   */
+/* the counters then hold the estimate. FALSE when it cannot start        */
+/************************************************************/
+int sample(uint32_t period, uint32_t warmup, uint32_t window)
+{
+	uint64_t executed = 0;
+	uint32_t samples = 0, start, hooks = CYCLE_HOOKS;
+	int running, cosim = COSIM_FLAG, trace = ENABLE_TRACE, logging = TIME_TRAVEL.logging;
+	double cpi, delta, mean = 0, m2 = 0, stddev, cv, error;
+
+	if (RUN_FLAG == FALSE) {
+		printf("Simulation Stopped.\n\n");
+		return FALSE;
+	}
+	if (CYCLE_COUNT != 0) {
+		printf("Sampling starts from an empty pipeline; reset the simulator first.\n\n");
+		return FALSE;
+	}
+	if (window == 0 || period < warmup + window) {
+		printf("The sampling period must cover the warm-up and the window.\n\n");
+		return FALSE;
+	}
+	if (engine_unmodelled()) {
+		printf("Fast-forwarding does not model %s; turn it off first.\n\n", engine_unmodelled());
+		return FALSE;
+	}
+
+	/*breakpoints, checkpoints and co-simulation do not follow fast-forwarding*/
+	CYCLE_HOOKS = 0;
+	COSIM_FLAG = FALSE;
+	ENABLE_TRACE = FALSE;
+	TIME_TRAVEL.logging = FALSE;
+
+	printf("Sampling %u + %u instructions every %u...\n\n", warmup, window, period);
+	while (sample_forward(period - warmup - window, &executed)) {
+		start = CURRENT_STATE.PC;
+		running = sample_window(warmup, window, &executed, &cpi);
+		if (cpi >= 0) {
+			/*running mean and variance (Welford)*/
+			samples++;
+			delta = cpi - mean;
+			mean += delta / samples;
+			m2 += delta * (cpi - mean);
+		}
+		else if (running) {
+			printf("Window at 0x%08x did not finish in %u cycles, skipped.\n", start, SAMPLE_CYCLE_LIMIT * (warmup + window) + 8);
+		}
+		if (!running) {
+			break;
+		}
+	}
+	RUN_FLAG = FALSE;
+
+	CYCLE_HOOKS = hooks;
+	COSIM_FLAG = cosim;
+	ENABLE_TRACE = trace;
+	TIME_TRAVEL.logging = logging;
+	if (TIME_TRAVEL.interval) {
+		checkpoint_enable(TIME_TRAVEL.interval);
+	}
+	if (COSIM_FLAG) {
+		cosim_enable(TRUE);
+	}
+
+	/*the counters report the whole run: executed instructions and the*/
+	/*estimated cycles, or no cycles when no window was measured*/
+	INSTRUCTION_COUNT = executed;
+	CYCLE_COUNT = (uint32_t)(mean * executed + 0.5);
+
+	printf("Instructions executed:\t%llu\n", (unsigned long long)executed);
+	printf("Measured windows:\t%u\n", samples);
+	if (samples == 0) {
+		printf("No window was measured; use a shorter period.\n\n");
+		return TRUE;
+	}
+	printf("Estimated CPI:\t\t%.4f\n", mean);
+	printf("Estimated cycles:\t%.0f\n", mean * executed);
+	if (samples < 2) {
+		printf("At least two windows are needed for a confidence interval.\n\n");
+		return TRUE;
+	}
+	stddev = sqrt(m2 / (samples - 1));
+	error = SAMPLE_Z * stddev / sqrt(samples);
+	cv = mean > 0 ? stddev / mean : 0;
+	printf("95%% confidence:\t\t%.4f +/- %.4f (%.2f%%)\n", mean, error, mean > 0 ? 100 * error / mean : 0);
+	printf("Windows for +/-%.0f%%:\t%.0f\n\n", 100 * SAMPLE_ERROR, ceil(pow(SAMPLE_Z * cv / SAMPLE_ERROR, 2)));
+	return TRUE;
+}
+
+/************************************************************/
+/* Fenwick tree over access times; a live time is the latest access */
+/* to some line                                                                        */
+/************************************************************/
+static void sd_fenwick_add(Stack_Distance *sd, uint32_t time, int delta)
+{
+	for (time++; time <= sd->capacity; time += time & -time) {
+		sd->fenwick[time - 1] += delta;
+	}
+}
+
+static uint32_t sd_fenwick_sum(Stack_Distance *sd, uint32_t time)
+{
+	uint32_t sum = 0;
+
+	for (time++; time > 0; time -= time & -time) {
+		sum += sd->fenwick[time - 1];
+	}
+	return sum;
+}
+
+/************************************************************/
+/* Renumber the live times from 0 once the time axis is used up;       */
+/* doubles it when more than half of it is live                                 */
+/************************************************************/
+static void sd_compact(Stack_Distance *sd)
+{
+	uint32_t t, next = 0, child;
+
+	for (t = 0; t < sd->now; t++) {
+		if (sd->live[t]) {
+			sd->live[t] = 0;
+			sd->owner[next] = sd->owner[t];
+			sd->times[sd->owner[next]] = next;
+			sd->live[next++] = 1;
+		}
+	}
+	sd->now = next;
+	if (2 * next > sd->capacity) {
+		sd->capacity *= 2;
+		sd->fenwick = realloc(sd->fenwick, sd->capacity * sizeof(uint32_t));
+		sd->owner = realloc(sd->owner, sd->capacity * sizeof(uint32_t));
+		sd->live = realloc(sd->live, sd->capacity);
+		memset(sd->live + next, 0, sd->capacity - next);
+	}
+	/*linear-time rebuild*/
+	for (t = 0; t < sd->capacity; t++) {
+		sd->fenwick[t] = sd->live[t];
+	}
+	for (t = 1; t <= sd->capacity; t++) {
+		child = t + (t & -t);
+		if (child <= sd->capacity) {
+			sd->fenwick[child - 1] += sd->fenwick[t - 1];
+		}
+	}
+}
+
+/************************************************************/
+/* Hash slot of a line (stored as line + 1, 0 is empty)                       */
+/************************************************************/
+static uint32_t sd_slot(Stack_Distance *sd, uint32_t line)
+{
+	uint32_t slot = (line * 0x9E3779B1u) & (sd->hash_size - 1);
+
+	while (sd->keys[slot] != 0 && sd->keys[slot] != line + 1) {
+		slot = (slot + 1) & (sd->hash_size - 1);
+	}
+	return slot;
+}
+
+static void sd_rehash(Stack_Distance *sd)
+{
+	uint32_t *keys = sd->keys, *times = sd->times;
+	uint32_t i, slot, size = sd->hash_size;
+
+	sd->hash_size = size ? size * 2 : 1024;
+	sd->keys = calloc(sd->hash_size, sizeof(uint32_t));
+	sd->times = malloc(sd->hash_size * sizeof(uint32_t));
+	for (i = 0; i < size; i++) {
+		if (keys[i] != 0) {
+			slot = sd_slot(sd, keys[i] - 1);
+			sd->keys[slot] = keys[i];
+			sd->times[slot] = times[i];
+			sd->owner[times[i]] = slot;
+		}
+	}
+	free(keys);
+	free(times);
+}
+
+/************************************************************/
+/* Move a line to the front of every per-set LRU stack                      */
+/************************************************************/
+static void sd_sets_access(Stack_Distance *sd, uint32_t line)
+{
+	uint32_t level, way, tag = line + 1;
+	uint32_t *set;
+
+	for (level = 0; level < SD_SET_LEVELS; level++) {
+		set = sd->ways[level] + (line & ((1u << level) - 1)) * SD_MAX_WAYS;
+		for (way = 0; way < SD_MAX_WAYS - 1 && set[way] != tag; way++) {
+		}
+		if (set[way] == tag) {
+			sd->way_hits[level][way]++;
+		}
+		memmove(set + 1, set, way * sizeof(uint32_t));
+		set[0] = tag;
+	}
+}
+
+/************************************************************/
+/* Record one access in the I-side or D-side stream                          */
+/************************************************************/
+void cache_access(int side, uint32_t address)
+{
+	Stack_Distance *sd = &CACHE_ANALYSIS.stream[side];
+	uint32_t line = address >> CACHE_ANALYSIS.line_shift;
+	uint32_t slot, distance;
+
+	sd->accesses++;
+	sd_sets_access(sd, line);
+
+	if (sd->now == sd->capacity) {
+		sd_compact(sd);
+	}
+	slot = sd_slot(sd, line);
+	if (sd->keys[slot] == 0) {
+		sd->cold++;
+		if (2 * (sd->hash_used + 1) > sd->hash_size) {
+			sd_rehash(sd);
+			slot = sd_slot(sd, line);
+		}
+		sd->keys[slot] = line + 1;
+		sd->hash_used++;
+		sd->num_live++;
+	}
+	else {
+		/*distinct lines touched since the last access to this one*/
+		distance = sd->num_live - sd_fenwick_sum(sd, sd->times[slot]);
+		sd->distance[distance < SD_MAX_DISTANCE ? distance : SD_MAX_DISTANCE]++;
+		sd->live[sd->times[slot]] = 0;
+		sd_fenwick_add(sd, sd->times[slot], -1);
+	}
+	sd->times[slot] = sd->now;
+	sd->owner[sd->now] = slot;
+	sd->live[sd->now] = 1;
+	sd_fenwick_add(sd, sd->now, 1);
+	sd->now++;
+}
+
+/************************************************************/
+/* Start recording with the given line size, 0 = stop                          */
+/************************************************************/
+void cache_analysis_enable(uint32_t line_size)
+{
+	Stack_Distance *sd;
+	int side, level;
+
+	for (side = SD_ISIDE; side <= SD_DSIDE; side++) {
+		sd = &CACHE_ANALYSIS.stream[side];
+		free(sd->keys);
+		free(sd->times);
+		free(sd->fenwick);
+		free(sd->owner);
+		free(sd->live);
+		for (level = 0; level < SD_SET_LEVELS; level++) {
+			free(sd->ways[level]);
+		}
+		memset(sd, 0, sizeof(Stack_Distance));
+	}
+	CACHE_ANALYSIS.enabled = FALSE;
+	if (line_size == 0) {
+		return;
+	}
+
+	for (CACHE_ANALYSIS.line_shift = 0; (2u << CACHE_ANALYSIS.line_shift) <= line_size; CACHE_ANALYSIS.line_shift++) {
+	}
+	for (side = SD_ISIDE; side <= SD_DSIDE; side++) {
+		sd = &CACHE_ANALYSIS.stream[side];
+		sd->capacity = 1 << 16;
+		sd->fenwick = calloc(sd->capacity, sizeof(uint32_t));
+		sd->owner = malloc(sd->capacity * sizeof(uint32_t));
+		sd->live = calloc(sd->capacity, 1);
+		sd_rehash(sd);
+		for (level = 0; level < SD_SET_LEVELS; level++) {
+			sd->ways[level] = calloc((1u << level) * SD_MAX_WAYS, sizeof(uint32_t));
+		}
+	}
+	CACHE_ANALYSIS.enabled = TRUE;
+}
+
+/************************************************************/
+/* Print miss rates for every size and associativity                         */
+/************************************************************/
+void cache_analysis_report()
+{
+	static const char *name[2] = {"I-side", "D-side"};
+	Stack_Distance *sd;
+	uint32_t line = 1u << CACHE_ANALYSIS.line_shift;
+	uint64_t size, lines, hits, d;
+	uint32_t ways, sets, level, way;
+	int side;
+
+	if (!CACHE_ANALYSIS.enabled) {
+		printf("Cache analysis is not running.\n\n");
+		return;
+	}
+	for (side = SD_ISIDE; side <= SD_DSIDE; side++) {
+		sd = &CACHE_ANALYSIS.stream[side];
+		printf("%s: %llu accesses, %llu distinct %u-byte lines\n", name[side], (unsigned long long)sd->accesses, (unsigned long long)sd->cold, line);
+		if (sd->accesses == 0) {
+			printf("\n");
+			continue;
+		}
+		printf("%10s", "size");
+		for (ways = 1; ways <= SD_MAX_WAYS; ways *= 2) {
+			printf("%7u-way", ways);
+		}
+		printf("%11s\n", "full");
+		for (size = line; size <= (uint64_t)line * SD_MAX_WAYS << (SD_SET_LEVELS - 1); size *= 2) {
+			if (size < 1024) {
+				printf("%9lluB", (unsigned long long)size);
+			}
+			else {
+				printf("%8lluKB", (unsigned long long)(size >> 10));
+			}
+			lines = size / line;
+			for (ways = 1; ways <= SD_MAX_WAYS; ways *= 2) {
+				if (lines < ways || lines / ways > (1u << (SD_SET_LEVELS - 1))) {
+					printf("%11s", "-");
+					continue;
+				}
+				sets = lines / ways;
+				for (level = 0; (1u << level) < sets; level++) {
+				}
+				hits = 0;
+				for (way = 0; way < ways; way++) {
+					hits += sd->way_hits[level][way];
+				}
+				printf("%10.2f%%", 100.0 * (sd->accesses - hits) / sd->accesses);
+			}
+			hits = 0;
+			for (d = 0; d < lines && d < SD_MAX_DISTANCE; d++) {
+				hits += sd->distance[d];
+			}
+			printf("%10.2f%%\n", 100.0 * (sd->accesses - hits) / sd->accesses);
+		}
+		printf("\n");
+	}
+}
+
+/************************************************************/
+/* Start or stop profiling the loaded program                                    */
+/************************************************************/
+void profile_enable(int enable)
+{
+	free(PROFILE.cycles);
+	free(PROFILE.stalls);
+	free(PROFILE.executions);
+	memset(&PROFILE, 0, sizeof(PROFILE));
+	if (!enable) {
+		return;
+	}
+	PROFILE.size = PROGRAM_SIZE;
+	PROFILE.cycles = calloc(PROGRAM_SIZE + 1, sizeof(uint64_t));
+	PROFILE.stalls = calloc(PROGRAM_SIZE + 1, sizeof(uint64_t));
+	PROFILE.executions = calloc(PROGRAM_SIZE + 1, sizeof(uint64_t));
+	PROFILE.start_cycle = CYCLE_COUNT;
+	PROFILE.enabled = TRUE;
+}
+
+/************************************************************/
+/* Charge the WB cycle to the retiring instruction                            */
+/************************************************************/
+void profile_retire(uint32_t pc)
+{
+	uint32_t index = (pc - MEM_TEXT_BEGIN) >> 2;
+
+	if (index < PROFILE.size) {
+		PROFILE.cycles[index]++;
+		PROFILE.executions[index]++;
+	}
+}
+
+/************************************************************/
+/* Charge a bubble to the instruction held in ID; the bubble reaches    */
+/* WB three cycles later, so every cycle is counted exactly once             */
+/************************************************************/
+void profile_stall(uint32_t pc)
+{
+	uint32_t index = (pc - MEM_TEXT_BEGIN) >> 2;
+
+	if (index < PROFILE.size) {
+		PROFILE.cycles[index]++;
+		PROFILE.stalls[index]++;
+	}
+}
+
+/************************************************************/
+/* Does control leave the straight line after this instruction?          */
+/* Sets *target when the destination is known statically                      */
+/************************************************************/
+static int profile_block_end(uint32_t addr, uint32_t *target)
+{
+	uint32_t instruction = mem_read_32(addr);
+	uint32_t flags = isa_flags(instruction);
+
+	*target = 0;
+	if (flags & ISA_BRANCH) {
+		*target = addr + 4 + ((uint32_t)(int16_t)(instruction & 0xFFFF) << 2);
+	}
+	else if (ISA[isa_op(instruction)].format == FMT_JUMP) {
+		*target = ((addr + 4) & 0xF0000000) | ((instruction & 0x3FFFFFF) << 2);
+	}
+	return (flags & (ISA_BRANCH | ISA_JUMP | ISA_SYSCALL)) != 0;
+}
+
+/************************************************************/
+/* Annotated listing: cycles, stalls and executions per instruction,       */
+/* grouped into basic blocks, followed by the hottest blocks                 */
+/************************************************************/
+void profile_report()
+{
+	uint8_t *leader;
+	uint32_t i, j, target, addr, num_blocks = 0, hot;
+	uint32_t *block_start;
+	uint64_t *block_cycles, *block_stalls;
+	uint64_t total = 0, stalls = 0, elapsed;
+
+	if (!PROFILE.enabled) {
+		printf("The profiler is not running.\n\n");
+		return;
+	}
+
+	/*leaders: program entry, branch and jump targets, and whatever follows a control transfer*/
+	leader = calloc(PROFILE.size + 1, 1);
+	leader[0] = TRUE;
+	for (i = 0; i < PROFILE.size; i++) {
+		if (profile_block_end(MEM_TEXT_BEGIN + i * 4, &target)) {
+			leader[i + 1] = TRUE;
+			if (target >= MEM_TEXT_BEGIN && ((target - MEM_TEXT_BEGIN) >> 2) < PROFILE.size) {
+				leader[(target - MEM_TEXT_BEGIN) >> 2] = TRUE;
+			}
+		}
+		total += PROFILE.cycles[i];
+		stalls += PROFILE.stalls[i];
+	}
+	for (i = 0; i < PROFILE.size; i++) {
+		num_blocks += leader[i];
+	}
+	block_start = malloc((num_blocks + 1) * sizeof(uint32_t));
+	block_cycles = calloc(num_blocks, sizeof(uint64_t));
+	block_stalls = calloc(num_blocks, sizeof(uint64_t));
+	for (i = 0, j = 0; i < PROFILE.size; i++) {
+		if (leader[i]) {
+			block_start[j++] = i;
+		}
+		block_cycles[j - 1] += PROFILE.cycles[i];
+		block_stalls[j - 1] += PROFILE.stalls[i];
+	}
+	block_start[num_blocks] = PROFILE.size;
+
+	elapsed = CYCLE_COUNT - PROFILE.start_cycle;
+	printf("Profile: %llu cycles, %llu attributed (%llu stall), %llu pipeline fill and drain\n\n", (unsigned long long)elapsed, (unsigned long long)total, (unsigned long long)stalls, (unsigned long long)(elapsed > total ? elapsed - total : 0));
+	printf("%-12s%10s%8s%10s%8s\n", "address", "cycles", "%", "stalls", "execs");
+	for (j = 0; j < num_blocks; j++) {
+		printf("--- block 0x%x-0x%x: %llu cycles, %llu stalls\n", MEM_TEXT_BEGIN + block_start[j] * 4, MEM_TEXT_BEGIN + block_start[j + 1] * 4 - 4, (unsigned long long)block_cycles[j], (unsigned long long)block_stalls[j]);
+		for (i = block_start[j]; i < block_start[j + 1]; i++) {
+			addr = MEM_TEXT_BEGIN + i * 4;
+			printf("[0x%x]%10llu%7.2f%%%10llu%8llu\t", addr, (unsigned long long)PROFILE.cycles[i], total ? 100.0 * PROFILE.cycles[i] / total : 0.0, (unsigned long long)PROFILE.stalls[i], (unsigned long long)PROFILE.executions[i]);
+			print_instruction(addr);
+		}
+	}
+
+	/*hottest blocks, selection by repeated maximum*/
+	printf("\nHottest blocks:\n");
+	for (i = 0; i < PROFILE_HOT_BLOCKS && i < num_blocks; i++) {
+		hot = 0;
+		for (j = 1; j < num_blocks; j++) {
+			if (block_cycles[j] > block_cycles[hot]) {
+				hot = j;
+			}
+		}
+		if (block_cycles[hot] == 0) {
+			break;
+		}
+		printf("0x%x-0x%x\t%llu cycles (%.2f%%), %llu stalls\n", MEM_TEXT_BEGIN + block_start[hot] * 4, MEM_TEXT_BEGIN + block_start[hot + 1] * 4 - 4, (unsigned long long)block_cycles[hot], 100.0 * block_cycles[hot] / total, (unsigned long long)block_stalls[hot]);
+		block_cycles[hot] = 0;
+	}
+	printf("\n");
+	free(leader);
+	free(block_start);
+	free(block_cycles);
+	free(block_stalls);
+}
+
+/************************************************************/
+/* Interval statistics writer                                                          */
+/************************************************************/
+static pthread_t INTERVAL_WRITER;
+static pthread_mutex_t INTERVAL_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t INTERVAL_COND = PTHREAD_COND_INITIALIZER;
+static int INTERVAL_PENDING = -1;	/* buffer handed to the writer thread */
+static size_t INTERVAL_PENDING_SIZE;
+static int INTERVAL_QUIT;
+
+static void *interval_writer(void *arg)
+{
+	pthread_mutex_lock(&INTERVAL_LOCK);
+	for (;;) {
+		while (INTERVAL_PENDING < 0 && !INTERVAL_QUIT) {
+			pthread_cond_wait(&INTERVAL_COND, &INTERVAL_LOCK);
+		}
+		if (INTERVAL_PENDING < 0) {
+			break;
+		}
+		pthread_mutex_unlock(&INTERVAL_LOCK);
+		fwrite(INTERVAL.buffer[INTERVAL_PENDING], 1, INTERVAL_PENDING_SIZE, INTERVAL.file);
+		pthread_mutex_lock(&INTERVAL_LOCK);
+		INTERVAL_PENDING = -1;
+		pthread_cond_broadcast(&INTERVAL_COND);
+	}
+	pthread_mutex_unlock(&INTERVAL_LOCK);
+	return NULL;
+}
+
+/************************************************************/
+/* Write out the active buffer, or hand it to the writer thread and      */
+/* keep filling the other one                                                          */
+/************************************************************/
+static void interval_flush()
+{
+	if (!INTERVAL.threaded) {
+		fwrite(INTERVAL.buffer[INTERVAL.active], 1, INTERVAL.used, INTERVAL.file);
+		INTERVAL.used = 0;
+		return;
+	}
+	pthread_mutex_lock(&INTERVAL_LOCK);
+	while (INTERVAL_PENDING >= 0) {
+		pthread_cond_wait(&INTERVAL_COND, &INTERVAL_LOCK);
+	}
+	INTERVAL_PENDING = INTERVAL.active;
+	INTERVAL_PENDING_SIZE = INTERVAL.used;
+	pthread_cond_broadcast(&INTERVAL_COND);
+	pthread_mutex_unlock(&INTERVAL_LOCK);
+	INTERVAL.active ^= 1;
+	INTERVAL.used = 0;
+}
+
+/************************************************************/
+/* Start a new interval at the current cycle                                     */
+/************************************************************/
+static void interval_start()
+{
+	INTERVAL.start_cycle = CYCLE_COUNT;
+	INTERVAL.start_instructions = INSTRUCTION_COUNT;
+	INTERVAL.start = STATS;
+	INTERVAL.pc_min = 0xFFFFFFFF;
+	INTERVAL.pc_max = 0;
+	INTERVAL.next_cycle = CYCLE_COUNT + INTERVAL.period;
+}
+
+/************************************************************/
+/* Write a row every period cycles to a CSV file, or a JSON array when */
+/* the file name ends in .json                                                         */
+/************************************************************/
+int interval_stats_open(uint32_t period, const char *file, int threaded)
+{
+	size_t length = strlen(file);
+
+	interval_stats_close();
+	if (period == 0) {
+		return FALSE;
+	}
+	INTERVAL.file = fopen(file, "w");
+	if (INTERVAL.file == NULL) {
+		printf("Error: Can't open stats file %s\n", file);
+		return FALSE;
+	}
+	INTERVAL.json = length > 5 && strcmp(file + length - 5, ".json") == 0;
+	INTERVAL.threaded = threaded ? TRUE : FALSE;
+	INTERVAL.period = period;
+	INTERVAL.rows = 0;
+	INTERVAL.buffer[0] = malloc(INTERVAL_BUFFER_SIZE);
+	INTERVAL.buffer[1] = malloc(INTERVAL_BUFFER_SIZE);
+	INTERVAL.active = 0;
+	INTERVAL.used = 0;
+	if (INTERVAL.threaded) {
+		INTERVAL_QUIT = FALSE;
+		INTERVAL_PENDING = -1;
+		if (pthread_create(&INTERVAL_WRITER, NULL, interval_writer, NULL) != 0) {
+			INTERVAL.threaded = FALSE;
+		}
+	}
+	if (INTERVAL.json) {
+		INTERVAL.used = sprintf(INTERVAL.buffer[0], "[\n");
+	}
+	else {
+		INTERVAL.used = sprintf(INTERVAL.buffer[0], "start_cycle,end_cycle,instructions,ipc,stall_ex_mem,stall_mem_wb,stall_store,stall_fp,stall_tlb,stall_sb_full,forwards,loads,stores,pc_min,pc_max\n");
+	}
+	interval_start();
+	INTERVAL.enabled = TRUE;
+	CYCLE_HOOKS |= HOOK_INTERVAL;
+	return TRUE;
+}
+
+/************************************************************/
+/* Write the interval that just ended                                              */
+/************************************************************/
+void interval_stats_emit()
+{
+	uint32_t cycles = CYCLE_COUNT - INTERVAL.start_cycle;
+	uint32_t instructions = INSTRUCTION_COUNT - INTERVAL.start_instructions;
+	char *row;
+
+	/*reset and back rewind the counters; start over from there*/
+	if (CYCLE_COUNT < INTERVAL.start_cycle || INSTRUCTION_COUNT < INTERVAL.start_instructions) {
+		interval_start();
+		return;
+	}
+	if (cycles == 0) {
+		return;
+	}
+	if (INTERVAL.pc_min > INTERVAL.pc_max) {
+		INTERVAL.pc_min = INTERVAL.pc_max = 0;
+	}
+	row = INTERVAL.buffer[INTERVAL.active] + INTERVAL.used;
+	if (INTERVAL.json) {
+		INTERVAL.used += snprintf(row, INTERVAL_ROW_MAX, "%s{\"start_cycle\": %u, \"end_cycle\": %u, \"instructions\": %u, \"ipc\": %.4f, "
+			"\"stalls\": {\"ex_mem\": %llu, \"mem_wb\": %llu, \"store\": %llu, \"fp\": %llu, \"tlb\": %llu, \"sb_full\": %llu}, \"forwards\": %llu, \"loads\": %llu, \"stores\": %llu, "
+			"\"pc_min\": \"0x%08x\", \"pc_max\": \"0x%08x\"}",
+			INTERVAL.rows ? ",\n" : "", INTERVAL.start_cycle, CYCLE_COUNT, instructions, (double)instructions / cycles,
+			(unsigned long long)(STATS.stalls[0] - INTERVAL.start.stalls[0]), (unsigned long long)(STATS.stalls[1] - INTERVAL.start.stalls[1]),
+			(unsigned long long)(STATS.stalls[2] - INTERVAL.start.stalls[2]), (unsigned long long)(STATS.stalls[3] - INTERVAL.start.stalls[3]),
+			(unsigned long long)(STATS.stalls[4] - INTERVAL.start.stalls[4]),
+			(unsigned long long)(STATS.stalls[5] - INTERVAL.start.stalls[5]),
+			(unsigned long long)(STATS.forwards - INTERVAL.start.forwards),
+			(unsigned long long)(STATS.loads - INTERVAL.start.loads), (unsigned long long)(STATS.stores - INTERVAL.start.stores),
+			INTERVAL.pc_min, INTERVAL.pc_max);
+	}
+	else {
+		INTERVAL.used += snprintf(row, INTERVAL_ROW_MAX, "%u,%u,%u,%.4f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,0x%08x,0x%08x\n",
+			INTERVAL.start_cycle, CYCLE_COUNT, instructions, (double)instructions / cycles,
+			(unsigned long long)(STATS.stalls[0] - INTERVAL.start.stalls[0]), (unsigned long long)(STATS.stalls[1] - INTERVAL.start.stalls[1]),
+			(unsigned long long)(STATS.stalls[2] - INTERVAL.start.stalls[2]), (unsigned long long)(STATS.stalls[3] - INTERVAL.start.stalls[3]),
+			(unsigned long long)(STATS.stalls[4] - INTERVAL.start.stalls[4]),
+			(unsigned long long)(STATS.stalls[5] - INTERVAL.start.stalls[5]),
+			(unsigned long long)(STATS.forwards - INTERVAL.start.forwards),
+			(unsigned long long)(STATS.loads - INTERVAL.start.loads), (unsigned long long)(STATS.stores - INTERVAL.start.stores),
+			INTERVAL.pc_min, INTERVAL.pc_max);
+	}
+	INTERVAL.rows++;
+	if (INTERVAL.used + INTERVAL_ROW_MAX > INTERVAL_BUFFER_SIZE) {
+		interval_flush();
+	}
+	interval_start();
+}
+
+/************************************************************/
+/* Write the last partial interval and close the file                          */
+/************************************************************/
+void interval_stats_close()
+{
+	if (!INTERVAL.enabled) {
+		return;
+	}
+	interval_stats_emit();
+	if (INTERVAL.json) {
+		INTERVAL.used += sprintf(INTERVAL.buffer[INTERVAL.active] + INTERVAL.used, "\n]\n");
+	}
+	interval_flush();
+	if (INTERVAL.threaded) {
+		pthread_mutex_lock(&INTERVAL_LOCK);
+		INTERVAL_QUIT = TRUE;
+		pthread_cond_broadcast(&INTERVAL_COND);
+		pthread_mutex_unlock(&INTERVAL_LOCK);
+		pthread_join(INTERVAL_WRITER, NULL);
+	}
+	fclose(INTERVAL.file);
+	free(INTERVAL.buffer[0]);
+	free(INTERVAL.buffer[1]);
+	printf("%llu interval rows written\n", (unsigned long long)INTERVAL.rows);
+	memset(&INTERVAL, 0, sizeof(INTERVAL));
+	CYCLE_HOOKS &= ~HOOK_INTERVAL;
+}
+
+/************************************************************/
+/* Publish counters to a shared-memory segment every period cycles      */
+/************************************************************/
+int monitor_open(const char *name, uint32_t period)
+{
+	static int registered = FALSE;
+	int fd;
+
+	monitor_close();
+	if (period == 0) {
+		return FALSE;
+	}
+	snprintf(MONITOR.name, sizeof(MONITOR.name), "%s%s", name[0] == '/' ? "" : "/", name);
+	fd = shm_open(MONITOR.name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, sizeof(Monitor_Metrics)) != 0) {
+		printf("Error: Can't create shared memory %s\n", MONITOR.name);
+		if (fd >= 0) {
+			close(fd);
+			shm_unlink(MONITOR.name);
+		}
+		return FALSE;
+	}
+	MONITOR.metrics = mmap(NULL, sizeof(Monitor_Metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MONITOR.metrics == MAP_FAILED) {
+		shm_unlink(MONITOR.name);
+		MONITOR.metrics = NULL;
+		return FALSE;
+	}
+	MONITOR.metrics->version = MONITOR_VERSION;
+	MONITOR.metrics->pid = getpid();
+	snprintf(MONITOR.metrics->program, sizeof(MONITOR.metrics->program), "%s", prog_file);
+	__atomic_store_n(&MONITOR.metrics->magic, MONITOR_MAGIC, __ATOMIC_RELEASE);
+	if (!registered) {
+		atexit(monitor_close);
+		registered = TRUE;
+	}
+	MONITOR.period = period;
+	MONITOR.enabled = TRUE;
+	CYCLE_HOOKS |= HOOK_MONITOR;
+	monitor_publish();
+	return TRUE;
+}
+
+/************************************************************/
+/* Seqlock write: odd sequence while the fields are being updated        */
+/************************************************************/
+void monitor_publish()
+{
+	Monitor_Metrics *m = MONITOR.metrics;
+	uint32_t sequence = m->sequence;
+	int i;
+
+	__atomic_store_n(&m->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	m->running = RUN_FLAG;
+	m->pc = CURRENT_STATE.PC;
+	m->cycles = CYCLE_COUNT;
+	m->instructions = INSTRUCTION_COUNT;
+	for (i = 0; i < NUM_STALL_CAUSES; i++) {
+		m->stalls[i] = STATS.stalls[i];
+	}
+	m->forwards = STATS.forwards;
+	m->loads = STATS.loads;
+	m->stores = STATS.stores;
+	__atomic_store_n(&m->sequence, sequence + 2, __ATOMIC_RELEASE);
+	MONITOR.next_cycle = CYCLE_COUNT + MONITOR.period;
+}
+
+/************************************************************/
+/* Remove the segment; readers see the magic cleared first                  */
+/************************************************************/
+void monitor_close()
+{
+	if (!MONITOR.enabled) {
+		return;
+	}
+	__atomic_store_n(&MONITOR.metrics->magic, 0, __ATOMIC_RELEASE);
+	munmap(MONITOR.metrics, sizeof(Monitor_Metrics));
+	shm_unlink(MONITOR.name);
+	memset(&MONITOR, 0, sizeof(MONITOR));
+	CYCLE_HOOKS &= ~HOOK_MONITOR;
+}
+
+/************************************************************/
+/* Time every Nth cycle's stages on the host (0 = off)                     */
+/************************************************************/
+void host_profile_enable(uint32_t period)
+{
+	static int registered = FALSE;
+
+	memset(&HOST_PROFILE, 0, sizeof(HOST_PROFILE));
+	if (period) {
+		if (!registered) {
+			atexit(host_profile_report);
+			registered = TRUE;
+		}
+		HOST_PROFILE.enabled = TRUE;
+		HOST_PROFILE.period = period;
+		HOST_PROFILE.countdown = period;
+		HOST_PROFILE.start_ticks = host_ticks();
+		HOST_PROFILE.start_seconds = host_seconds();
+		HOST_PROFILE.start_cycle = CYCLE_COUNT;
+	}
+	set_forwarding(ENABLE_FORWARDING);
+}
+
+/************************************************************/
+/* Per-stage share of host time and simulated cycles per host second   */
+/************************************************************/
+void host_profile_report()
+{
+	static const char *names[5] = { "WB", "MEM", "EX", "ID", "IF" };
+	double seconds, ticks_per_second, ticks_per_ns, total = 0;
+	uint64_t cycles;
+	int i;
+
+	if (!HOST_PROFILE.enabled) {
+		return;
+	}
+	seconds = host_seconds() - HOST_PROFILE.start_seconds;
+	cycles = CYCLE_COUNT - HOST_PROFILE.start_cycle;
+	ticks_per_second = seconds > 0 ? (host_ticks() - HOST_PROFILE.start_ticks) / seconds : 0;
+	ticks_per_ns = ticks_per_second > 0 ? ticks_per_second * 1e-9 : 1;
+	for (i = 0; i < 5; i++) {
+		total += HOST_PROFILE.stage[i];
+	}
+
+	printf("\nHost profile: %llu cycles sampled (1 in %u)\n", (unsigned long long)HOST_PROFILE.samples, HOST_PROFILE.period);
+	printf("-------------------------------------------------\n");
+	printf("Stage    ns/cycle    share\n");
+	for (i = 0; i < 5; i++) {
+		printf("%-5s %11.1f %7.1f%%\n", names[i],
+			HOST_PROFILE.samples ? HOST_PROFILE.stage[i] / ticks_per_ns / HOST_PROFILE.samples : 0,
+			total > 0 ? 100.0 * HOST_PROFILE.stage[i] / total : 0);
+	}
+	printf("memory accessors: %.1f%%   trace output: %.1f%%\n",
+		total > 0 ? 100.0 * HOST_PROFILE.memory / total : 0,
+		total > 0 ? 100.0 * HOST_PROFILE.print / total : 0);
+	printf("%llu cycles in %.3f s: %.0f simulated cycles per host second\n",
+		(unsigned long long)cycles, seconds, seconds > 0 ? cycles / seconds : 0);
+	printf("-------------------------------------------------\n");
+}
+
+/************************************************************/
+/* Batch execution: the reference model run over BATCH.width lanes, */
+/* REGS[r][lane], with one decode per step and vector kernels          */
+/************************************************************/
+typedef uint32_t batch_vec __attribute__((vector_size(BATCH_VECTOR * sizeof(uint32_t))));
+typedef int32_t batch_svec __attribute__((vector_size(BATCH_VECTOR * sizeof(uint32_t))));
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define BATCH_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define BATCH_CLONES
+#endif
+
+/* uint32_t lane arrays in BATCH.file, the last two holding the counts */
+#define BATCH_ARRAYS (MIPS_REGS + 2 + MIPS_FP_REGS + 1 + 6 + 2)
+
+/* dst = EXPR in the lanes of the mask, one vector v at a time */
+#define BATCH_LANES(dst, EXPR) \
+	for (v = 0; v < n; v++) { \
+		batch_vec r = (EXPR); \
+		(dst)[v] = ((dst)[v] & ~m[v]) | (r & m[v]); \
+	}
+
+/************************************************************/
+/* Row slot of a word address in the lane-private memory (0 is empty) */
+/************************************************************/
+static uint32_t batch_slot(uint32_t address)
+{
+	uint32_t slot = ((address >> 2) * 2654435761u) & (BATCH.row_capacity - 1);
+
+	while (BATCH.row_address[slot] && BATCH.row_address[slot] != address) {
+		slot = (slot + 1) & (BATCH.row_capacity - 1);
+	}
+	return slot;
+}
+
+static int batch_rehash()
+{
+	uint32_t *old_address = BATCH.row_address, *old_rows = BATCH.rows;
+	uint32_t old_capacity = BATCH.row_capacity, i, slot;
+	uint32_t *row_address = calloc(old_capacity * 2, sizeof(uint32_t));
+	uint32_t *rows = aligned_alloc(32, (size_t)old_capacity * 2 * BATCH.width * sizeof(uint32_t));
+
+	if (row_address == NULL || rows == NULL) {
+		free(row_address);
+		free(rows);
+		return FALSE;
+	}
+	BATCH.row_address = row_address;
+	BATCH.rows = rows;
+	BATCH.row_capacity = old_capacity * 2;
+	for (i = 0; i < old_capacity; i++) {
+		if (old_address[i]) {
+			slot = batch_slot(old_address[i]);
+			BATCH.row_address[slot] = old_address[i];
+			memcpy(BATCH.rows + (size_t)slot * BATCH.width, old_rows + (size_t)i * BATCH.width, BATCH.width * sizeof(uint32_t));
+		}
+	}
+	free(old_address);
+	free(old_rows);
+	return TRUE;
+}
+
+/************************************************************/
+/* The lanes' copies of an aligned word, made from main memory on     */
+/* the first store when create is set; NULL while every lane reads it  */
+/* from main memory                                                                 */
+/************************************************************/
+static uint32_t *batch_row(uint32_t address, int create)
+{
+	uint32_t slot = batch_slot(address), value, l;
+	uint32_t *row;
+
+	if (BATCH.row_address[slot]) {
+		return BATCH.rows + (size_t)slot * BATCH.width;
+	}
+	if (!create) {
+		return NULL;
+	}
+	if ((BATCH.row_count + 1) * 2 > BATCH.row_capacity) {
+		if (!batch_rehash()) {
+			fprintf(stderr, "Out of memory for batch stores\n");
+			exit(1);
+		}
+		slot = batch_slot(address);
+	}
+	BATCH.row_address[slot] = address;
+	BATCH.row_count++;
+	row = BATCH.rows + (size_t)slot * BATCH.width;
+	value = mem_read_32(address);
+	for (l = 0; l < BATCH.width; l++) {
+		row[l] = value;
+	}
+	return row;
+}
+
+static inline uint32_t batch_word(uint32_t lane, uint32_t address)
+{
+	uint32_t *row = batch_row(address, FALSE);
+
+	return row ? row[lane] : mem_read_32(address);
+}
+
+/************************************************************/
+/* One lane's load and store; unaligned words span two rows           */
+/************************************************************/
+static uint32_t batch_load(uint32_t lane, uint32_t address)
+{
+	uint32_t shift = (address & 3) * 8;
+
+	if (!shift) {
+		return batch_word(lane, address);
+	}
+	return (batch_word(lane, address & ~3) >> shift) | (batch_word(lane, (address & ~3) + 4) << (32 - shift));
+}
+
+static void batch_merge(uint32_t lane, uint32_t address, uint32_t value, uint32_t mask)
+{
+	uint32_t *row;
+
+	/*stores to unmapped addresses are dropped, as in the pipeline*/
+	if (!mask || mem_region(address) == NULL) {
+		return;
+	}
+	row = batch_row(address, TRUE);
+	row[lane] = (row[lane] & ~mask) | (value & mask);
+}
+
+static void batch_store(uint32_t lane, uint32_t address, uint32_t value, uint32_t mask)
+{
+	uint32_t shift = (address & 3) * 8;
+
+	batch_merge(lane, address & ~3, value << shift, mask << shift);
+	if (shift) {
+		batch_merge(lane, (address & ~3) + 4, value >> (32 - shift), mask >> (32 - shift));
+	}
+}
+
+/************************************************************/
+/* The address base + offset if every lane of the mask has the same  */
+/* aligned one, else 0 and the lanes go one at a time                  */
+/************************************************************/
+static inline uint32_t batch_uniform(const batch_vec *base, uint32_t offset, const uint32_t *lanes)
+{
+	const batch_vec *m = (const batch_vec *)lanes;
+	uint32_t n = BATCH.width / BATCH_VECTOR, v, l, address;
+	batch_vec diff = { 0 };
+
+	for (l = 0; !lanes[l]; l++) {
+	}
+	address = ((const uint32_t *)base)[l] + offset;
+	if (address & 3) {
+		return 0;
+	}
+	for (v = 0; v < n; v++) {
+		diff |= ((base[v] + offset) ^ address) & m[v];
+	}
+	for (l = 0; l < BATCH_VECTOR; l++) {
+		if (diff[l]) {
+			return 0;
+		}
+	}
+	return address;
+}
+
+/************************************************************/
+/* Words loaded by the lanes of the mask: a row or a broadcast word   */
+/* when the address is uniform, gathered lane by lane otherwise        */
+/************************************************************/
+static inline const batch_vec *batch_gather(const batch_vec *base, uint32_t offset, const uint32_t *lanes)
+{
+	uint32_t address = batch_uniform(base, offset, lanes), value, l;
+	uint32_t *row;
+
+	if (address) {
+		row = batch_row(address, FALSE);
+		if (row) {
+			return (const batch_vec *)row;
+		}
+		value = mem_read_32(address);
+		for (l = 0; l < BATCH.width; l++) {
+			BATCH.word[l] = value;
+		}
+		return (const batch_vec *)BATCH.word;
+	}
+	BATCH.gathers++;
+	for (l = 0; l < BATCH.width; l++) {
+		if (lanes[l]) {
+			BATCH.word[l] = batch_load(l, ((const uint32_t *)base)[l] + offset);
+		}
+	}
+	return (const batch_vec *)BATCH.word;
+}
+
+/************************************************************/
+/* Merge value under mask into memory for the lanes of the mask        */
+/************************************************************/
+static inline void batch_scatter(const batch_vec *base, uint32_t offset, const batch_vec *value, uint32_t mask, const uint32_t *lanes)
+{
+	const batch_vec *m = (const batch_vec *)lanes;
+	uint32_t address = batch_uniform(base, offset, lanes), n = BATCH.width / BATCH_VECTOR, v, l;
+	batch_vec *row;
+
+	if (address) {
+		if (mem_region(address) == NULL) {
+			return;
+		}
+		row = (batch_vec *)batch_row(address, TRUE);
+		for (v = 0; v < n; v++) {
+			row[v] = (row[v] & ~(m[v] & mask)) | (value[v] & m[v] & mask);
+		}
+		return;
+	}
+	BATCH.gathers++;
+	for (l = 0; l < BATCH.width; l++) {
+		if (lanes[l]) {
+			batch_store(l, ((const uint32_t *)base)[l] + offset, ((const uint32_t *)value)[l], mask);
+		}
+	}
+}
+
+static inline uint64_t batch_fp_read(uint32_t reg, uint32_t lane, int pair)
+{
+	return pair ? ((uint64_t)BATCH.fpr[(reg & 0x1E) + 1][lane] << 32) | BATCH.fpr[reg & 0x1E][lane] : BATCH.fpr[reg][lane];
+}
+
+/************************************************************/
+/* Execute one instruction at pc in the lanes of the mask, as ref_step */
+/* does; BC1 leaves each lane's branch target, or 0, in BATCH.taken     */
+/************************************************************/
+static BATCH_CLONES void batch_execute(uint32_t instruction, const uint32_t *lanes, uint32_t pc)
+{
+	const batch_vec *m = (const batch_vec *)lanes;
+	uint32_t code = isa_op(instruction);
+	uint32_t rs = (0x3E00000 & instruction) >> 21;
+	uint32_t rt = (0x1F0000 & instruction) >> 16;
+	uint32_t rd = (0xF800 & instruction) >> 11;
+	uint32_t shamt = (0x7C0 & instruction) >> 6;
+	uint32_t immediate = (0xFFFF & instruction);
+	uint32_t simm = (uint32_t)((int16_t)immediate);
+	uint32_t n = BATCH.width / BATCH_VECTOR, v, l;
+	batch_vec *a = (batch_vec *)BATCH.regs[rs];
+	batch_vec *b = (batch_vec *)BATCH.regs[rt];
+	batch_vec *d = (batch_vec *)BATCH.regs[rd];
+	batch_vec *hi = (batch_vec *)BATCH.hi;
+	batch_vec *lo = (batch_vec *)BATCH.lo;
+	batch_vec zero = { 0 };
+	const batch_vec *w;
+	uint32_t A, B;
+	int64_t product;
+	uint64_t uproduct, result;
+	FP_Op fp_op;
+
+	switch (code) {
+		case OP_SLL:
+			BATCH_LANES(d, b[v] << shamt);
+			break;
+		case OP_SRL:
+			BATCH_LANES(d, b[v] >> shamt);
+			break;
+		case OP_SRA:
+			BATCH_LANES(d, (batch_vec)((batch_svec)b[v] >> (int32_t)shamt));
+			break;
+		case OP_MFHI:
+			BATCH_LANES(d, hi[v]);
+			break;
+		case OP_MTHI:
+			BATCH_LANES(hi, a[v]);
+			break;
+		case OP_MFLO:
+			BATCH_LANES(d, lo[v]);
+			break;
+		case OP_MTLO:
+			BATCH_LANES(lo, a[v]);
+			break;
+		case OP_MULT:
+		case OP_MULTU:
+		case OP_DIV:
+		case OP_DIVU:
+			for (l = 0; l < BATCH.width; l++) {
+				if (!lanes[l]) {
+					continue;
+				}
+				A = BATCH.regs[rs][l];
+				B = BATCH.regs[rt][l];
+				if (code == OP_MULT) {
+					product = (int64_t)(int32_t)A * (int64_t)(int32_t)B;
+					BATCH.hi[l] = (uint32_t)((uint64_t)product >> 32);
+					BATCH.lo[l] = (uint32_t)product;
+				}
+				else if (code == OP_MULTU) {
+					uproduct = (uint64_t)A * (uint64_t)B;
+					BATCH.hi[l] = (uint32_t)(uproduct >> 32);
+					BATCH.lo[l] = (uint32_t)uproduct;
+				}
+				else if (B != 0 && code == OP_DIV) {
+					BATCH.lo[l] = (uint32_t)((int32_t)A / (int32_t)B);
+					BATCH.hi[l] = (uint32_t)((int32_t)A % (int32_t)B);
+				}
+				else if (B != 0) {
+					BATCH.lo[l] = A / B;
+					BATCH.hi[l] = A % B;
+				}
+			}
+			break;
+		case OP_ADD:
+		case OP_ADDU:
+			BATCH_LANES(d, a[v] + b[v]);
+			break;
+		case OP_SUB:
+		case OP_SUBU:
+			BATCH_LANES(d, a[v] - b[v]);
+			break;
+		case OP_AND:
+			BATCH_LANES(d, a[v] & b[v]);
+			break;
+		case OP_OR:
+			BATCH_LANES(d, a[v] | b[v]);
+			break;
+		case OP_XOR:
+			BATCH_LANES(d, a[v] ^ b[v]);
+			break;
+		case OP_NOR:
+			BATCH_LANES(d, ~(a[v] | b[v]));
+			break;
+		case OP_SLT:
+			BATCH_LANES(d, (batch_vec)((batch_svec)a[v] < (batch_svec)b[v]) & 1);
+			break;
+		case OP_ADDI:
+		case OP_ADDIU:
+			BATCH_LANES(b, a[v] + simm);
+			break;
+		case OP_ANDI:
+			BATCH_LANES(b, a[v] & immediate);
+			break;
+		case OP_ORI:
+			BATCH_LANES(b, a[v] | immediate);
+			break;
+		case OP_XORI:
+			BATCH_LANES(b, a[v] ^ immediate);
+			break;
+		case OP_SLTI:
+			BATCH_LANES(b, (batch_vec)((batch_svec)a[v] < (int32_t)simm) & 1);
+			break;
+		case OP_LUI:
+			BATCH_LANES(b, zero + (immediate << 16));
+			break;
+		case OP_LB:
+			w = batch_gather(a, simm, lanes);
+			BATCH_LANES(b, (batch_vec)((batch_svec)(w[v] << 24) >> 24));
+			break;
+		case OP_LH:
+			w = batch_gather(a, simm, lanes);
+			BATCH_LANES(b, (batch_vec)((batch_svec)(w[v] << 16) >> 16));
+			break;
+		case OP_LW:
+			w = batch_gather(a, simm, lanes);
+			BATCH_LANES(b, w[v]);
+			break;
+		case OP_SB:
+			batch_scatter(a, simm, b, 0xFF, lanes);
+			break;
+		case OP_SH:
+			batch_scatter(a, simm, b, 0xFFFF, lanes);
+			break;
+		case OP_SW:
+			batch_scatter(a, simm, b, 0xFFFFFFFF, lanes);
+			break;
+		case OP_LWC1:
+			w = batch_gather(a, simm, lanes);
+			BATCH_LANES((batch_vec *)BATCH.fpr[rt], w[v]);
+			break;
+		case OP_SWC1:
+			batch_scatter(a, simm, (batch_vec *)BATCH.fpr[rt], 0xFFFFFFFF, lanes);
+			break;
+		case OP_MFC1:
+			BATCH_LANES(b, ((batch_vec *)BATCH.fpr[rd])[v]);
+			break;
+		case OP_MTC1:
+			BATCH_LANES((batch_vec *)BATCH.fpr[rd], b[v]);
+			break;
+		case OP_BC1F:
+		case OP_BC1T:
+			for (v = 0; v < n; v++) {
+				batch_vec set = (batch_vec)((((batch_vec *)BATCH.fcsr)[v] & FCSR_COND) != 0);
+				((batch_vec *)BATCH.taken)[v] = (set ^ ((rt & 1) ? 0 : ~0u)) & (pc + 4 + (simm << 2));
+			}
+			break;
+		default:
+			if (ISA[code].unit == FP_UNIT_NONE) {
+				break;
+			}
+			fp_decode(instruction, &fp_op);
+			for (l = 0; l < BATCH.width; l++) {
+				if (!lanes[l]) {
+					continue;
+				}
+				result = fp_compute(instruction, batch_fp_read(rd, l, fp_op.pair_source), batch_fp_read(rt, l, fp_op.pair_source));
+				if (fp_op.writes_cond) {
+					BATCH.fcsr[l] = (BATCH.fcsr[l] & ~FCSR_COND) | (result ? FCSR_COND : 0);
+				}
+				else if (fp_op.writes) {
+					BATCH.fpr[__builtin_ctz(fp_op.writes)][l] = (uint32_t)result;
+					if (fp_op.pair_result) {
+						BATCH.fpr[__builtin_ctz(fp_op.writes) + 1][l] = (uint32_t)(result >> 32);
+					}
+				}
+			}
+			break;
+	}
+}
+
+static inline int batch_is_bc1(uint32_t instruction)
+{
+	return (isa_flags(instruction) & (ISA_BRANCH | ISA_FP)) == (ISA_BRANCH | ISA_FP);
+}
+
+static inline int batch_is_syscall(uint32_t instruction)
+{
+	return isa_op(instruction) == OP_SYSCALL;
+}
+
+/************************************************************/
+/* Take a lane out of the run; it ran every converged step so far      */
+/************************************************************/
+static void batch_stop(uint32_t lane)
+{
+	BATCH.running[lane] = 0;
+	BATCH.instructions[lane] += BATCH.converged_steps;
+	BATCH.active--;
+}
+
+/************************************************************/
+/* After a converged BC1 or SYSCALL: lanes that exit stop, and lanes  */
+/* that branch differently each take their own PC from here on          */
+/************************************************************/
+static void batch_converged_control(uint32_t instruction, uint32_t pc)
+{
+	uint32_t l, first = BATCH.width;
+
+	for (l = 0; l < BATCH.width; l++) {
+		if (!BATCH.running[l]) {
+			continue;
+		}
+		if (batch_is_syscall(instruction)) {
+			if (BATCH.regs[2][l] == 0xA) {
+				BATCH.lane_pc[l] = pc + 4;
+				batch_stop(l);
+			}
+		}
+		else if (first == BATCH.width) {
+			first = l;
+		}
+		else if (BATCH.taken[l] != BATCH.taken[first]) {
+			BATCH.converged = FALSE;
+		}
+	}
+	if (batch_is_bc1(instruction) && first < BATCH.width) {
+		BATCH.branch_target = BATCH.taken[first];
+		if (!BATCH.converged) {
+			for (l = 0; l < BATCH.width; l++) {
+				BATCH.lane_pc[l] = BATCH.running[l] ? BATCH.pc : BATCH.lane_pc[l];
+				BATCH.lane_branch_target[l] = BATCH.taken[l];
+			}
+		}
+	}
+}
+
+/************************************************************/
+/* One step of diverged lanes: the lanes at the lowest PC execute,    */
+/* which lets lanes still in a loop catch up with those past it; lanes */
+/* reconverge once they all share a PC and pending branch                */
+/************************************************************/
+static void batch_divergent_step(uint32_t text_end)
+{
+	uint32_t l, first = BATCH.width, pc = UINT32_MAX, instruction;
+	int same = TRUE;
+
+	for (l = 0; l < BATCH.width; l++) {
+		if (!BATCH.running[l]) {
+			continue;
+		}
+		if (BATCH.lane_pc[l] < MEM_TEXT_BEGIN || BATCH.lane_pc[l] >= text_end) {
+			batch_stop(l);
+			continue;
+		}
+		if (first == BATCH.width) {
+			first = l;
+		}
+		else if (BATCH.lane_pc[l] != BATCH.lane_pc[first] || BATCH.lane_branch_target[l] != BATCH.lane_branch_target[first]) {
+			same = FALSE;
+		}
+		pc = BATCH.lane_pc[l] < pc ? BATCH.lane_pc[l] : pc;
+	}
+	if (!BATCH.active) {
+		return;
+	}
+	if (same) {
+		BATCH.converged = TRUE;
+		BATCH.pc = BATCH.lane_pc[first];
+		BATCH.branch_target = BATCH.lane_branch_target[first];
+		return;
+	}
+
+	for (l = 0; l < BATCH.width; l++) {
+		BATCH.mask[l] = (BATCH.running[l] && BATCH.lane_pc[l] == pc) ? ~0u : 0;
+	}
+	instruction = mem_read_32(pc);
+	batch_execute(instruction, BATCH.mask, pc);
+	BATCH.divergent_steps++;
+	for (l = 0; l < BATCH.width; l++) {
+		if (!BATCH.mask[l]) {
+			continue;
+		}
+		BATCH.instructions[l]++;
+		BATCH.lane_pc[l] = BATCH.lane_branch_target[l] ? BATCH.lane_branch_target[l] : pc + 4;
+		BATCH.lane_branch_target[l] = batch_is_bc1(instruction) ? BATCH.taken[l] : 0;
+		if (batch_is_syscall(instruction) && BATCH.regs[2][l] == 0xA) {
+			BATCH.lane_pc[l] = pc + 4;
+			batch_stop(l);
+		}
+	}
+}
+
+/************************************************************/
+/* Start lanes copies of the current architectural state; memory is  */
+/* shared until a lane stores, and main memory is never written         */
+/************************************************************/
+int batch_open(uint32_t lanes)
+{
+	uint32_t width = (lanes + BATCH_VECTOR - 1) / BATCH_VECTOR * BATCH_VECTOR;
+	uint32_t *p, l, r;
+
+	batch_close();
+	if (lanes == 0) {
+		return FALSE;
+	}
+	BATCH.lanes = lanes;
+	BATCH.width = width;
+	BATCH.row_capacity = 64;
+	BATCH.file = aligned_alloc(32, (size_t)BATCH_ARRAYS * width * sizeof(uint32_t));
+	BATCH.row_address = calloc(BATCH.row_capacity, sizeof(uint32_t));
+	BATCH.rows = aligned_alloc(32, (size_t)BATCH.row_capacity * width * sizeof(uint32_t));
+	if (BATCH.file == NULL || BATCH.row_address == NULL || BATCH.rows == NULL) {
+		batch_close();
+		return FALSE;
+	}
+	memset(BATCH.file, 0, (size_t)BATCH_ARRAYS * width * sizeof(uint32_t));
+
+	p = BATCH.file;
+	for (r = 0; r < MIPS_REGS; r++, p += width) {
+		BATCH.regs[r] = p;
+	}
+	BATCH.hi = p; p += width;
+	BATCH.lo = p; p += width;
+	for (r = 0; r < MIPS_FP_REGS; r++, p += width) {
+		BATCH.fpr[r] = p;
+	}
+	BATCH.fcsr = p; p += width;
+	BATCH.lane_pc = p; p += width;
+	BATCH.lane_branch_target = p; p += width;
+	BATCH.running = p; p += width;
+	BATCH.mask = p; p += width;
+	BATCH.word = p; p += width;
+	BATCH.taken = p; p += width;
+	BATCH.instructions = (uint64_t *)p;
+
+	for (l = 0; l < width; l++) {
+		for (r = 0; r < MIPS_REGS; r++) {
+			BATCH.regs[r][l] = CURRENT_STATE.REGS[r];
+		}
+		for (r = 0; r < MIPS_FP_REGS; r++) {
+			BATCH.fpr[r][l] = CURRENT_STATE.FPR[r];
+		}
+		BATCH.hi[l] = CURRENT_STATE.HI;
+		BATCH.lo[l] = CURRENT_STATE.LO;
+		BATCH.fcsr[l] = CURRENT_STATE.FCSR;
+		BATCH.lane_pc[l] = CURRENT_STATE.PC;
+		BATCH.lane_branch_target[l] = CURRENT_STATE.BRANCH_TARGET;
+		BATCH.running[l] = l < lanes ? ~0u : 0;
+	}
+	BATCH.active = lanes;
+	BATCH.converged = TRUE;
+	BATCH.pc = CURRENT_STATE.PC;
+	BATCH.branch_target = CURRENT_STATE.BRANCH_TARGET;
+	return TRUE;
+}
+
+/************************************************************/
+/* Lane registers: 0-31 the GPRs, then BATCH_REG_HI and BATCH_REG_LO */
+/************************************************************/
+void batch_set_reg(uint32_t lane, uint32_t reg, uint32_t value)
+{
+	if (lane >= BATCH.lanes) {
+		return;
+	}
+	if (reg < MIPS_REGS) {
+		BATCH.regs[reg][lane] = value;
+	}
+	else if (reg == BATCH_REG_HI) {
+		BATCH.hi[lane] = value;
+	}
+	else if (reg == BATCH_REG_LO) {
+		BATCH.lo[lane] = value;
+	}
+}
+
+uint32_t batch_get_reg(uint32_t lane, uint32_t reg)
+{
+	if (lane >= BATCH.lanes) {
+		return 0;
+	}
+	if (reg < MIPS_REGS) {
+		return BATCH.regs[reg][lane];
+	}
+	if (reg == BATCH_REG_HI) {
+		return BATCH.hi[lane];
+	}
+	if (reg == BATCH_REG_LO) {
+		return BATCH.lo[lane];
+	}
+	return 0;
+}
+
+/************************************************************/
+/* Run every lane until it exits through SYSCALL or leaves the text    */
+/************************************************************/
+void batch_run()
+{
+	uint32_t text_end = MEM_TEXT_BEGIN + PROGRAM_SIZE * 4;
+	uint32_t instruction, pc, l;
+	double start = host_seconds();
+
+	while (BATCH.active) {
+		if (!BATCH.converged) {
+			batch_divergent_step(text_end);
+			continue;
+		}
+		pc = BATCH.pc;
+		if (pc < MEM_TEXT_BEGIN || pc >= text_end) {
+			for (l = 0; l < BATCH.width; l++) {
+				if (BATCH.running[l]) {
+					BATCH.lane_pc[l] = pc;
+					batch_stop(l);
+				}
+			}
+			break;
+		}
+		instruction = mem_read_32(pc);
+		batch_execute(instruction, BATCH.running, pc);
+		BATCH.converged_steps++;
+		BATCH.pc = BATCH.branch_target ? BATCH.branch_target : pc + 4;
+		BATCH.branch_target = 0;
+		if (batch_is_bc1(instruction) || batch_is_syscall(instruction)) {
+			batch_converged_control(instruction, pc);
+		}
+	}
+	BATCH.seconds += host_seconds() - start;
 }
 
 /************************************************************/
-/* maintain the pipeline                                                                                           */ 
-/************************************************************/
-void handle_pipeline()
+/* Steps, how many diverged, and lane instructions per host second      */
+/************************************************************/
+void batch_report()
 {
-	/*INSTRUCTION_COUNT should be incremented when instruction is done*/
-	/*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
-	
-	WB();
-	MEM();
-	EX();
-	ID();
-	IF();
+	uint64_t total = 0;
+	uint32_t l;
+
+	if (!BATCH.lanes) {
+		return;
+	}
+	for (l = 0; l < BATCH.lanes; l++) {
+		total += BATCH.instructions[l];
+	}
+	printf("\nBatch: %u lanes in %u-lane vectors (%s kernels)\n", BATCH.lanes, BATCH_VECTOR,
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+		__builtin_cpu_supports("avx2") ? "AVX2" : "SSE2"
+#else
+		"generic"
+#endif
+		);
+	printf("-------------------------------------------------\n");
+	printf("converged steps: %llu   diverged steps: %llu   gathers: %llu\n",
+		(unsigned long long)BATCH.converged_steps, (unsigned long long)BATCH.divergent_steps, (unsigned long long)BATCH.gathers);
+	printf("lanes still running: %u   private memory words: %u\n", BATCH.active, BATCH.row_count);
+	printf("%llu lane instructions in %.3f s: %.0f per host second\n",
+		(unsigned long long)total, BATCH.seconds, BATCH.seconds > 0 ? total / BATCH.seconds : 0);
+	printf("-------------------------------------------------\n");
 }
 
 /************************************************************/
-/* writeback (WB) pipeline stage:                                                                          */ 
+/* Print a register of every lane with its instruction count           */
 /************************************************************/
-void WB()
+void batch_show(uint32_t reg)
 {
-	if(CYCLE_COUNT < 5)
-	{
-		return;
+	uint32_t l;
+
+	printf("Lane    Value       Instructions   PC\n");
+	for (l = 0; l < BATCH.lanes; l++) {
+		printf("%-7u 0x%08x  %-14llu 0x%08x\n", l, batch_get_reg(l, reg),
+			(unsigned long long)(BATCH.instructions[l] + (BATCH.running[l] ? BATCH.converged_steps : 0)),
+			BATCH.converged && BATCH.running[l] ? BATCH.pc : BATCH.lane_pc[l]);
 	}
-	
-	if(WB_MEM.IR == 0 && WB_MEM.PC == 0 && WB_MEM.SYSCALL == 0)
-	{
-		printf("STALL\n");
+}
+
+/************************************************************/
+/* Release the lanes                                                                    */
+/************************************************************/
+void batch_close()
+{
+	free(BATCH.file);
+	free(BATCH.row_address);
+	free(BATCH.rows);
+	memset(&BATCH, 0, sizeof(BATCH));
+}
+
+/************************************************************/
+/* Decoupled simulation: ref_step on a producer thread, a timing model */
+/* over instruction words on this one, joined by a single-producer      */
+/* single-consumer ring                                                             */
+/************************************************************/
+static Trace_Ring TRACE_RING;
+
+/* spin briefly, then give the core away in case the other side shares it */
+static inline void trace_pause(uint32_t *spins)
+{
+	if (++*spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+		_mm_pause();
+#endif
 		return;
 	}
+	*spins = 0;
+	sched_yield();
+}
 
-	print_instruction(WB_MEM.PC);
-	uint32_t opcode = (WB_MEM.IR & 0xFC000000) >> 26;
-	uint32_t function = (WB_MEM.IR & 0x3F);
-	uint32_t rd = (0xF800 & WB_MEM.IR) >> 11;
-	uint32_t rt = (0x1F0000 & WB_MEM.IR) >> 16;
-	
-	INSTRUCTION_COUNT++;
-	
-	if (opcode == 0x00) {
-		switch(function) {
-			case 0x00://SLL
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x02://SRL
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x03://SRA
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x0C://SYSCALL
-				if(WB_MEM.SYSCALL == 0xA)
-				{
-					RUN_FLAG = FALSE;
-				} 
-				break;
-			case 0x10://MFHI
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x11://MTHI
-				NEXT_STATE.HI = WB_MEM.ALUOutput;
-				break;
-			case 0x12://MFLO
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x13://MTLO
-				NEXT_STATE.LO = WB_MEM.ALUOutput;
-				break;
-			case 0x18://MULT
-				NEXT_STATE.HI = WB_MEM.ALUOutput;
-				NEXT_STATE.LO = WB_MEM.ALUOutput2;
-				break;
-			case 0x19://MULT Unsigned
-				NEXT_STATE.HI = WB_MEM.ALUOutput;
-				NEXT_STATE.LO = WB_MEM.ALUOutput2;
-				break;
-			case 0x1A://DIV
-				NEXT_STATE.HI = WB_MEM.ALUOutput;
-				NEXT_STATE.LO = WB_MEM.ALUOutput2;
-				break;
-			case 0x1B://DIVU
-				NEXT_STATE.HI = WB_MEM.ALUOutput;
-				NEXT_STATE.LO = WB_MEM.ALUOutput2;
-				break;
-			case 0x20://ADD
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x21://ADD Unsigned
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x22://SUB
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x23://SUB Unsigned
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x24://AND
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x25://OR
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x26://XOR
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x27://NOR
-				NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				break;
-			case 0x2A://SLT
-				if(EX_ID.A < EX_ID.B)
-				{
-					NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				}
-				else
-				{
-					NEXT_STATE.REGS[rd] = WB_MEM.ALUOutput;
-				}
-				break;
-		}
+/************************************************************/
+/* Describe the instruction at pc before ref_step executes it            */
+/************************************************************/
+static void trace_describe(Trace_Record *rec, const CPU_State *state)
+{
+	uint32_t ir = mem_read_32(state->PC);
+	uint32_t code = isa_op(ir);
+	uint32_t flags = ISA[code].flags;
+	uint32_t rs = (ir >> 21) & 0x1F;
+	uint32_t rt = (ir >> 16) & 0x1F;
+	uint32_t rd = (ir >> 11) & 0x1F;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->pc = state->PC;
+	rec->ir = ir;
+	rec->v0 = state->REGS[2];
+	rec->src[0] = flags & ISA_READS_RS ? rs : 0;
+	rec->src[1] = flags & ISA_READS_RT ? rt : 0;
+	if (flags & ISA_WRITES_RD) {
+		rec->dst = rd;
 	}
-	else {
-		switch(opcode) {
-			case 0x8://ADDI
-				NEXT_STATE.REGS[rt] = WB_MEM.ALUOutput;
-				break;
-			case 0x9://ADDIU
-				NEXT_STATE.REGS[rt] = WB_MEM.ALUOutput;
-				break;
-			case 0xC://ANDI
-				NEXT_STATE.REGS[rt] = WB_MEM.ALUOutput;
-				break;
-			case 0xE://XORI
-				NEXT_STATE.REGS[rt] = WB_MEM.ALUOutput;
-				break;
-			case 0xD://ORI
-				NEXT_STATE.REGS[rt] = WB_MEM.ALUOutput;
-				break;
-			case 0xA://SLTI
-				if(EX_ID.A < EX_ID.imm)
-				{
-					NEXT_STATE.REGS[rt] = WB_MEM.ALUOutput;
-				}
-				else
-				{
-					NEXT_STATE.REGS[rt] = WB_MEM.ALUOutput;
-				}
-				break;
-			case 0x20://LB
-				NEXT_STATE.REGS[rt] = WB_MEM.LMD;
-				break;
-			case 0x21://LH
-				NEXT_STATE.REGS[rt] = WB_MEM.LMD;
-				break;
-			case 0xF://LUI
-				NEXT_STATE.REGS[rt] = WB_MEM.ALUOutput;
-				break;
-			case 0x23://LW
-				NEXT_STATE.REGS[rt] = WB_MEM.LMD;;
-				break;
+	else if (flags & ISA_WRITES_RT) {
+		rec->dst = rt;
+	}
+	else if (flags & ISA_LINK) {
+		rec->dst = code == OP_JAL ? 31 : rd;
+	}
+	rec->flags = flags & ISA_LOAD ? TRACE_LOAD : flags & ISA_STORE ? TRACE_STORE : 0;
+	if (rec->flags) {
+		rec->address = state->REGS[rs] + (uint32_t)(int16_t)(ir & 0xFFFF);
+	}
+}
+
+static inline void trace_push(Trace_Ring *ring, const Trace_Record *rec, uint32_t *head, uint32_t *tail)
+{
+	uint32_t spins = 0;
+
+	if (*head - *tail == TRACE_RING_SIZE) {
+		__atomic_store_n(&ring->head, *head, __ATOMIC_RELEASE);
+		while ((*tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) + TRACE_RING_SIZE == *head) {
+			trace_pause(&spins);
 		}
 	}
-}	
+	ring->records[*head & (TRACE_RING_SIZE - 1)] = *rec;
+	(*head)++;
+	if ((*head & (TRACE_PUBLISH - 1)) == 0) {
+		__atomic_store_n(&ring->head, *head, __ATOMIC_RELEASE);
+	}
+}
 
 /************************************************************/
-/* memory access (MEM) pipeline stage:                                                          */ 
+/* Execute one instruction and describe it; FALSE once it exits        */
 /************************************************************/
-void MEM()
+static inline int trace_step(Trace_Record *rec)
 {
-	if(CYCLE_COUNT < 4 || WB_MEM.SYSCALL == 0xA)
-	{
-		return;
+	Mem_Store_Record store;
+	uint32_t old_value;
+	int alive;
+
+	trace_describe(rec, &CURRENT_STATE);
+	alive = ref_step(&CURRENT_STATE, &store);
+	if (store.valid) {
+		old_value = mem_read_32(store.address);
+		mem_write_32(store.address, (old_value & ~store.mask) | (store.new_value & store.mask));
 	}
-	
-	WB_MEM.IR = MEM_EX.IR;
-	WB_MEM.PC = MEM_EX.PC;
-	WB_MEM.SYSCALL = MEM_EX.SYSCALL;
+	return alive;
+}
 
-	uint32_t opcode = (MEM_EX.IR & 0xFC000000) >> 26;
-	uint32_t WB_RD = (0xF800 & WB_MEM.IR) >> 11;
-	uint32_t MEM_RD = (0xF800 & MEM_EX.IR) >> 11;
-	uint32_t EX_RS = (0x3E00000 & EX_ID.IR) >> 21;
-	uint32_t EX_RT = (0x1F0000 & EX_ID.IR) >> 16;
+/************************************************************/
+/* Functional side: execute to the exiting SYSCALL, then send the word */
+/* IF fetches after it                                                                */
+/************************************************************/
+static void *trace_producer(void *arg)
+{
+	Trace_Ring *ring = arg;
+	Trace_Record rec;
+	uint32_t text_end = MEM_TEXT_BEGIN + PROGRAM_SIZE * 4;
+	uint32_t head = 0, tail = 0;
+	int alive = TRUE;
 
-	if(ENABLE_FORWARDING)
-	{
-		if(opcode == 0x29 || opcode == 0x2B || opcode == 0x28)
-		{
-			
+	while (alive && CURRENT_STATE.PC >= MEM_TEXT_BEGIN && CURRENT_STATE.PC < text_end) {
+		alive = trace_step(&rec);
+		trace_push(ring, &rec, &head, &tail);
+		if (!alive) {
+			trace_describe(&rec, &CURRENT_STATE);
+			rec.flags |= TRACE_WRONG_PATH;
+			trace_push(ring, &rec, &head, &tail);
 		}
-		else
-		{
-			if((WB_RD != 0) && !((MEM_RD != 0) && (MEM_RD == EX_RS)) && (WB_RD == EX_RS))
-			{
-				ForwardA = 01;
-			}
-			
-			if((WB_RD != 0) && !((MEM_RD != 0) && (MEM_RD == EX_RT)) && (WB_RD == EX_RT))
-			{
-				ForwardB = 01;
+	}
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->finished, TRUE, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/************************************************************/
+/* Same as trace_producer, but the whole trace goes to one growing     */
+/* buffer; for when no producer thread can be started. NULL when out  */
+/* of memory                                                                           */
+/************************************************************/
+static Trace_Record *trace_collect(uint64_t *count)
+{
+	Trace_Record *records = NULL, *grown;
+	uint32_t text_end = MEM_TEXT_BEGIN + PROGRAM_SIZE * 4;
+	uint64_t size = 0;
+	int alive = TRUE;
+
+	*count = 0;
+	while (alive && CURRENT_STATE.PC >= MEM_TEXT_BEGIN && CURRENT_STATE.PC < text_end) {
+		if (*count + 2 > size) {
+			size = size ? 2 * size : TRACE_RING_SIZE;
+			grown = realloc(records, size * sizeof(Trace_Record));
+			if (grown == NULL) {
+				free(records);
+				return NULL;
 			}
+			records = grown;
 		}
-	}
-	if (opcode == 0x00) {
-		WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-		WB_MEM.ALUOutput2 = MEM_EX.ALUOutput2;
-	}
-	else {
-		switch(opcode) {
-			case 0x8:
-				WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-				break;
-			case 0x9:
-				WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-				break;
-			case 0xC:
-				WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-				break;
-			case 0xE:
-				WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-				break;
-			case 0xD:
-				WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-				break;
-			case 0xA:
-				if(EX_ID.A < EX_ID.imm)
-				{
-					WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-				}
-				else
-				{
-					WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-				}
-				break;
-			case 0x20:
-				WB_MEM.LMD = mem_read_32(MEM_EX.ALUOutput) >> 24;
-				MEM_EX.ALUOutput = WB_MEM.LMD;
-				break;
-			case 0x21:
-				WB_MEM.LMD = mem_read_32(MEM_EX.ALUOutput) >> 16;
-				MEM_EX.ALUOutput = WB_MEM.LMD;
-				break;
-			case 0xF:
-				WB_MEM.ALUOutput = MEM_EX.ALUOutput;
-				break;
-			case 0x23:
-				WB_MEM.LMD = mem_read_32(MEM_EX.ALUOutput);
-				MEM_EX.ALUOutput = WB_MEM.LMD;
-				break;
-			case 0x29:
-				mem_write_32(MEM_EX.ALUOutput, ((MEM_EX.B & 0xFFFF) << 16) + (0xFFFF & mem_read_32(MEM_EX.ALUOutput)));
-				break;
-			case 0x28:
-				mem_write_32(MEM_EX.ALUOutput, ((MEM_EX.B & 0xFF) << 24) + (0xFFFFFF & mem_read_32(MEM_EX.ALUOutput)));
-				break;
-			case 0x2B:
-				mem_write_32(MEM_EX.ALUOutput, MEM_EX.B);
-				break;
+		alive = trace_step(&records[(*count)++]);
+		if (!alive) {
+			trace_describe(&records[*count], &CURRENT_STATE);
+			records[(*count)++].flags |= TRACE_WRONG_PATH;
 		}
 	}
+	return records;
 }
 
 /************************************************************/
-/* execution (EX) pipeline stage:                                                                          */ 
+/* Next record for IF, from the ring or a saved trace; FALSE at the end */
 /************************************************************/
-void EX()
+static int trace_fetch(Timing_Model *tm, Trace_Record *rec)
 {
-	
-	if(CYCLE_COUNT < 3 || MEM_EX.SYSCALL == 0xA)
-	{
-		return;
-	}
-	MEM_EX.IR = EX_ID.IR;
-	MEM_EX.PC = EX_ID.PC;
-	MEM_EX.SYSCALL = EX_ID.SYSCALL;
+	Trace_Ring *ring = &TRACE_RING;
+	uint32_t spins = 0;
 
-	if(EX_ID.IR == 0 && EX_ID.PC == 0 && EX_ID.SYSCALL == 0)
-	{
-		//printf("Skipping EX()\n");
-		return;
+	if (tm->replay) {
+		if (tm->replay_next == tm->replay_count) {
+			return FALSE;
+		}
+		*rec = tm->replay[tm->replay_next++];
+		return TRUE;
+	}
+	while (ring->next == ring->cached_head) {
+		__atomic_store_n(&ring->tail, ring->next, __ATOMIC_RELEASE);
+		if (__atomic_load_n(&ring->finished, __ATOMIC_ACQUIRE)) {
+			ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+			if (ring->next == ring->cached_head) {
+				return FALSE;
+			}
+			break;
+		}
+		ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (ring->next == ring->cached_head) {
+			trace_pause(&spins);
+		}
+	}
+	*rec = ring->records[ring->next & (TRACE_RING_SIZE - 1)];
+	ring->next++;
+	if ((ring->next & (TRACE_PUBLISH - 1)) == 0) {
+		__atomic_store_n(&ring->tail, ring->next, __ATOMIC_RELEASE);
 	}
+	if (tm->save) {
+		fwrite(rec, sizeof(*rec), 1, tm->save);
+	}
+	return TRUE;
+}
 
-	
-	uint32_t opcode = (EX_ID.IR & 0xFC000000) >> 26;
-	uint32_t function = (EX_ID.IR & 0x3F);
-	uint32_t shamt = (0x7C0 & EX_ID.IR) >> 6;
-	uint32_t MEM_RD = (0xF800 & MEM_EX.IR) >> 11;
-	uint32_t EX_RS = (0x3E00000 & EX_ID.IR) >> 21;
-	uint32_t EX_RT = (0x1F0000 & EX_ID.IR) >> 16;
+#define TIMING_BUBBLE(latch) ((latch).IR == 0 && (latch).PC == 0 && (latch).SYSCALL == 0)
 
-	uint64_t product;
+/************************************************************/
+/* One cycle of the stage gates of handle_pipeline over instruction     */
+/* words only; stalls come from the same ID_hazard and FP scoreboard    */
+/************************************************************/
+static inline __attribute__((always_inline)) void timing_cycle(Timing_Model *tm, const int forwarding)
+{
+	uint32_t cycle = tm->cycles;
+	uint32_t code, prev;
+	int stall, fp;
+	Trace_Record rec;
+	FP_Op fp_op;
 
-	if(ENABLE_FORWARDING)
-	{
-		
-		if (ForwardA == 10)
-		{
-			
-			EX_ID.A = MEM_EX.ALUOutput;
-			ForwardA = 0;
+	/*WB*/
+	if (cycle >= 5 && !TIMING_BUBBLE(tm->WB_MEM)) {
+		tm->instructions++;
+		if ((tm->WB_MEM.IR & 0xFC00003F) == 0x0C && tm->WB_MEM.SYSCALL == 0xA) {
+			tm->done = TRUE;
 		}
-		else if (ForwardA == 01)
-		{
-			EX_ID.A = WB_MEM.ALUOutput;
-			ForwardA = 0;
+	}
+	/*MEM*/
+	if (cycle >= 4 && tm->WB_MEM.SYSCALL != 0xA) {
+		tm->WB_MEM = tm->MEM_EX;
+	}
+	/*EX: with forwarding it looks ahead at IF/ID through the ID/EX latch*/
+	if (cycle >= 3 && tm->MEM_EX.SYSCALL != 0xA) {
+		tm->MEM_EX = tm->EX_ID;
+		if (forwarding && !TIMING_BUBBLE(tm->EX_ID)) {
+			tm->EX_ID = tm->ID_IF;
 		}
-		if (ForwardB == 10)
-		{
-			EX_ID.B = MEM_EX.ALUOutput;
-			ForwardB = 0;
+	}
+	/*ID*/
+	if (cycle >= 2 && tm->EX_ID.SYSCALL != 0xA) {
+		tm->EX_ID = tm->ID_IF;
+		code = isa_op(tm->EX_ID.IR);
+		fp = __builtin_expect((ISA[code].flags & ISA_FP) != 0, 0);
+		stall = ID_hazard(forwarding, tm->EX_ID.IR, tm->MEM_EX.IR, tm->WB_MEM.IR);
+		if (fp) {
+			fp_decode(tm->EX_ID.IR, &fp_op);
+			stall |= fp_hazard(&tm->fp, tm->latency, cycle, &fp_op);
 		}
-		else if (ForwardB == 01)
-		{
-			EX_ID.B = WB_MEM.ALUOutput;
-			ForwardB = 0;
+		if (stall) {
+			tm->EX_ID.IR = 0;
+			tm->EX_ID.PC = 0;
+			tm->EX_ID.SYSCALL = 0;
+			tm->stalls[__builtin_ctz(stall)]++;
+		}
+		else if (fp) {
+			fp_issue(&tm->fp, tm->latency, cycle, &fp_op);
+		}
+		if (code == OP_SYSCALL) {
+			tm->EX_ID.SYSCALL = tm->ID_IF.V0;
 		}
 	}
-
-	if(ENABLE_FORWARDING)
-	{
-		EX_ID.IR = ID_IF.IR;
-		EX_ID.PC = ID_IF.PC;
-		EX_ID.SYSCALL = ID_IF.SYSCALL;
-		MEM_RD = (0xF800 & MEM_EX.IR) >> 11;
-		EX_RS = (0x3E00000 & EX_ID.IR) >> 21;
-		EX_RT = (0x1F0000 & EX_ID.IR) >> 16;
-		if(opcode == 0x29 || opcode == 0x2B || opcode == 0x28)
-		{
-			
+	/*IF*/
+	if (cycle >= 1 && tm->ID_IF.SYSCALL != 0xA && !(TIMING_BUBBLE(tm->EX_ID) && cycle > 4)) {
+		prev = tm->ID_IF.IR;
+		if (!tm->ended && trace_fetch(tm, &rec)) {
+			tm->ID_IF.IR = rec.ir;
+			tm->ID_IF.PC = rec.pc;
+			tm->ID_IF.V0 = rec.v0;
 		}
-		else
-		{
-			if(opcode != 0x00)
-			{
-				MEM_RD = (0x1F0000 & MEM_EX.IR) >> 16;
-
-			}
-
-			if((MEM_RD != 0) && (MEM_RD == EX_RS))
-			{
-				ForwardA = 10;
-			}
-
-			if((MEM_RD != 0) && (MEM_RD == EX_RT))
-			{
-				ForwardB = 10;
-			}
+		else {
+			tm->ended = TRUE;
+			tm->ID_IF.IR = 0;
+			tm->ID_IF.PC = 0;
+		}
+		if ((prev & 0xFC00003F) == 0x0C) {
+			tm->ID_IF.SYSCALL = 0xA;
 		}
 	}
+	tm->cycles++;
+	if (tm->ended && TIMING_BUBBLE(tm->ID_IF) && TIMING_BUBBLE(tm->EX_ID) && TIMING_BUBBLE(tm->MEM_EX) && TIMING_BUBBLE(tm->WB_MEM)) {
+		tm->done = TRUE;
+	}
+}
 
-	if (opcode == 0x00) {
-		switch(function) {
-			case 0x00:
-				MEM_EX.ALUOutput = EX_ID.B << shamt;
-				break;
-			case 0x02:
-				MEM_EX.ALUOutput = EX_ID.B >> shamt;
-				break;
-			case 0x03:
-				MEM_EX.ALUOutput = EX_ID.B >> shamt;
-				break;
-			case 0x0C:
-				if(EX_ID.SYSCALL == 0xA)
-				{
-					MEM_EX.ALUOutput = 0xA;
-				} 
-				break;
-			case 0x10:
-				MEM_EX.ALUOutput = EX_ID.HI;
-				break;
-			case 0x11:
-				MEM_EX.ALUOutput = EX_ID.A;
-				break;
-			case 0x12:
-				MEM_EX.ALUOutput = EX_ID.LO;
-				break;
-			case 0x13:
-				MEM_EX.ALUOutput = EX_ID.A;
-				break;
-			case 0x18:
-				product = EX_ID.A * EX_ID.B;
-				MEM_EX.ALUOutput = product >> 32;
-				MEM_EX.ALUOutput2 = product & 0xFFFFFFFF;
-				break;
-			case 0x19:
-				product = EX_ID.A * EX_ID.B;
-				MEM_EX.ALUOutput = product >> 32;
-				MEM_EX.ALUOutput2 = product & 0xFFFFFFFF;
-				break;
-			case 0x1A:
-				MEM_EX.ALUOutput = EX_ID.A / EX_ID.B;
-				MEM_EX.ALUOutput2 = EX_ID.A % EX_ID.B;
-				break;
-			case 0x1B:
-				MEM_EX.ALUOutput = EX_ID.A / EX_ID.B;
-				MEM_EX.ALUOutput2 = EX_ID.A % EX_ID.B;
-				break;
-			case 0x20:
-				MEM_EX.ALUOutput = EX_ID.A + EX_ID.B;
-				break;
-			case 0x21:
-				MEM_EX.ALUOutput = EX_ID.A + EX_ID.B;
-				break;
-			case 0x22:
-				MEM_EX.ALUOutput = EX_ID.A - EX_ID.B;
-				break;
-			case 0x23:
-				MEM_EX.ALUOutput = EX_ID.A - EX_ID.B;
-				break;
-			case 0x24:
-				MEM_EX.ALUOutput = EX_ID.A & EX_ID.B;
-				break;
-			case 0x25:
-				MEM_EX.ALUOutput = EX_ID.A | EX_ID.B;
-				break;
-			case 0x26:
-				MEM_EX.ALUOutput = EX_ID.A ^ EX_ID.B;
-				break;
-			case 0x27:
-				MEM_EX.ALUOutput = ~(EX_ID.A | EX_ID.B);
-				break;
-			case 0x2A:
-				if(EX_ID.A < EX_ID.B)
-				{
-					MEM_EX.ALUOutput = 0x00000001;
-				}
-				else
-				{
-					MEM_EX.ALUOutput = 0x00000000;
-				}
-				break;
+static void timing_run(Timing_Model *tm)
+{
+	if (tm->forwarding) {
+		while (!tm->done) {
+			timing_cycle(tm, TRUE);
 		}
-	} 
+	}
 	else {
-		switch(opcode) {
-			case 0x8:
-				MEM_EX.ALUOutput = EX_ID.A + EX_ID.imm;
-				break;
-			case 0x9:
-				MEM_EX.ALUOutput = EX_ID.A + EX_ID.imm;
-				break;
-			case 0xC:
-				MEM_EX.ALUOutput = EX_ID.imm & EX_ID.A & 0xFFFF;
-				break;
-			case 0xE:
-				MEM_EX.ALUOutput = EX_ID.A ^ EX_ID.imm;
-				break;
-			case 0xD:
-				MEM_EX.ALUOutput = EX_ID.A | EX_ID.imm;
-				break;
-			case 0xA:
-				if(EX_ID.A < EX_ID.imm)
-				{
-					MEM_EX.ALUOutput = 0x00000001;
-				}
-				else
-				{
-					MEM_EX.ALUOutput = 0x00000000;
-				}
-				break;
-			case 0x20:
-				MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
-				MEM_EX.B = EX_ID.B;
-				break;
-			case 0x21:
-				MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
-				MEM_EX.B = EX_ID.B;
-				break;
-			case 0xF:
-				MEM_EX.ALUOutput = (EX_ID.imm << 16);
-				break;
-			case 0x23:
-				MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
-				MEM_EX.B = EX_ID.B;
-				break;
-			case 0x29:
-				MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
-				MEM_EX.B = EX_ID.B;
-				break;
-			case 0x28:
-				MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
-				MEM_EX.B = EX_ID.B;
-				break;
-			case 0x2B:
-				MEM_EX.ALUOutput = EX_ID.imm + EX_ID.A;
-				MEM_EX.B = EX_ID.B;
-				break;
+		while (!tm->done) {
+			timing_cycle(tm, FALSE);
 		}
 	}
 }
 
+static void timing_report(const char *what, const Timing_Model *tm, double seconds)
+{
+	printf("%s: %u cycles, %u instructions, CPI %.3f\n", what, tm->cycles, tm->instructions,
+		tm->instructions ? (double)tm->cycles / tm->instructions : 0);
+	printf("stalls: EX/MEM %llu  MEM/WB %llu  store %llu  FP %llu\n",
+		(unsigned long long)tm->stalls[0], (unsigned long long)tm->stalls[1],
+		(unsigned long long)tm->stalls[2], (unsigned long long)tm->stalls[3]);
+	printf("%.3f s on the host: %.0f simulated cycles per host second\n\n", seconds, seconds > 0 ? tm->cycles / seconds : 0);
+}
+
 /************************************************************/
-/* instruction decode (ID) pipeline stage:                                                         */ 
+/* Run the program to completion from a reset pipeline with the two    */
+/* halves on separate threads, optionally saving the trace to a file    */
 /************************************************************/
-void ID()
+int decoupled_run(const char *trace_file)
 {
-	if(CYCLE_COUNT < 2 || EX_ID.SYSCALL == 0xA)
-	{
-		return;
+	Timing_Model tm;
+	Trace_File_Header header = { TRACE_MAGIC, TRACE_VERSION, sizeof(Trace_Record), 0 };
+	pthread_t producer;
+	double start;
+	uint32_t spins = 0;
+	int ok = TRUE, i;
+
+	if (RUN_FLAG == FALSE || CYCLE_COUNT != 0) {
+		printf("A decoupled run starts from a reset pipeline\n");
+		return FALSE;
+	}
+	if (engine_unmodelled()) {
+		printf("The decoupled timing model does not model %s; turn it off first\n", engine_unmodelled());
+		return FALSE;
+	}
+	memset(&tm, 0, sizeof(tm));
+	tm.forwarding = ENABLE_FORWARDING;
+	memcpy(tm.latency, FP_LATENCY, sizeof(tm.latency));
+	if (trace_file) {
+		tm.save = fopen(trace_file, "wb");
+		if (tm.save == NULL) {
+			printf("Cannot open %s\n", trace_file);
+			return FALSE;
+		}
+		header.start_pc = CURRENT_STATE.PC;
+		fwrite(&header, sizeof(header), 1, tm.save);
+	}
+	memset(&TRACE_RING, 0, sizeof(TRACE_RING));
+	TRACE_RING.records = malloc(TRACE_RING_SIZE * sizeof(Trace_Record));
+	if (TRACE_RING.records == NULL) {
+		if (tm.save) {
+			fclose(tm.save);
+		}
+		return FALSE;
 	}
 
-	int stallFlag = 0;
-	if(EX_ID.IR == 0 && EX_ID.PC == 0 && EX_ID.SYSCALL == 0)
-	{
-		stallFlag = 1;
+	start = host_seconds();
+	if (pthread_create(&producer, NULL, trace_producer, &TRACE_RING) == 0) {
+		timing_run(&tm);
+		/*a program that never exits leaves records behind; let the producer finish*/
+		while (!__atomic_load_n(&TRACE_RING.finished, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&TRACE_RING.tail, __atomic_load_n(&TRACE_RING.head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+			trace_pause(&spins);
+		}
+		pthread_join(producer, NULL);
+	}
+	else {
+		/*no second thread: execute first, then time the trace as a replay*/
+		printf("Cannot start the producer thread; running both halves inline\n");
+		tm.replay = trace_collect(&tm.replay_count);
+		if (tm.replay) {
+			if (tm.save) {
+				fwrite(tm.replay, sizeof(Trace_Record), tm.replay_count, tm.save);
+			}
+			timing_run(&tm);
+			free((void *)tm.replay);
+		}
+		else {
+			printf("Out of memory for the trace\n");
+			ok = FALSE;
+		}
+	}
+	free(TRACE_RING.records);
+	TRACE_RING.records = NULL;
+	if (tm.save) {
+		fclose(tm.save);
+	}
+	if (!ok) {
+		RUN_FLAG = FALSE;
+		return FALSE;
 	}
 
-	EX_ID.IR = ID_IF.IR;
-	EX_ID.PC = ID_IF.PC;
-	EX_ID.SYSCALL = ID_IF.SYSCALL;
-	uint32_t rs = (0x3E00000 & ID_IF.IR) >> 21;
-	uint32_t rt = (0x1F0000 & ID_IF.IR) >> 16;
-	uint32_t immediate = (0xFFFF & ID_IF.IR);
-	EX_ID.A = CURRENT_STATE.REGS[rs];
-	EX_ID.B = CURRENT_STATE.REGS[rt];
-	EX_ID.HI = CURRENT_STATE.HI;
-	EX_ID.LO = CURRENT_STATE.LO;
-	EX_ID.imm = (uint32_t)((int16_t)immediate);
-	uint32_t opcode = (EX_ID.IR & 0xFC000000) >> 26;
+	CYCLE_COUNT += tm.cycles;
+	INSTRUCTION_COUNT += tm.instructions;
+	for (i = 0; i < NUM_STALL_CAUSES; i++) {
+		STATS.stalls[i] += tm.stalls[i];
+	}
+	RUN_FLAG = FALSE;
+	timing_report("Decoupled run", &tm, host_seconds() - start);
+	return TRUE;
+}
 
+/************************************************************/
+/* Set up a timing model from a configuration such as "f1,mul=3,div=12": */
+/* f0/f1 picks the forwarding mode and unit=cycles an FP latency; the     */
+/* rest keep the current settings. FALSE for a malformed item              */
+/************************************************************/
+static int replay_configure(Replay_Job *job, const char *config)
+{
+	char items[sizeof(job->name)], *item, *save, *equals;
+	int unit;
 
-	if (stallFlag == 1 || (ENABLE_FORWARDING && (opcode == 0x28 || opcode == 0x29 || opcode == 0x2B)))
-	{
-		EX_ID.A = NEXT_STATE.REGS[rs];
-		EX_ID.B = NEXT_STATE.REGS[rt];
+	memset(&job->tm, 0, sizeof(job->tm));
+	job->tm.forwarding = ENABLE_FORWARDING;
+	memcpy(job->tm.latency, FP_LATENCY, sizeof(job->tm.latency));
+	snprintf(job->name, sizeof(job->name), "%s", config ? config : (ENABLE_FORWARDING ? "f1" : "f0"));
+	if (config == NULL) {
+		return TRUE;
+	}
+	snprintf(items, sizeof(items), "%s", config);
+	for (item = strtok_r(items, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+		if (strcmp(item, "f0") == 0 || strcmp(item, "f1") == 0) {
+			job->tm.forwarding = item[1] == '1';
+			continue;
+		}
+		equals = strchr(item, '=');
+		if (equals == NULL) {
+			return FALSE;
+		}
+		*equals = '\0';
+		unit = fp_unit(item);
+		if (unit == FP_UNIT_NONE) {
+			return FALSE;
+		}
+		job->tm.latency[unit] = strtoul(equals + 1, NULL, 0);
 	}
+	return TRUE;
+}
 
+static void *replay_worker(void *arg)
+{
+	Replay_Job *job = arg;
 
-	uint32_t MEM_opcode = (MEM_EX.IR & 0xFC000000) >> 26;
-	uint32_t WB_opcode = (WB_MEM.IR & 0xFC000000) >> 26;
-	uint32_t MEM_RD = (0xF800 & MEM_EX.IR) >> 11;
-	uint32_t WB_RD = (0xF800 & WB_MEM.IR) >> 11;
-	uint32_t EX_RS = (0x3E00000 & EX_ID.IR) >> 21;
-	uint32_t EX_RT = (0x1F0000 & EX_ID.IR) >> 16;
-	uint32_t function = (EX_ID.IR & 0x3F);
-	
-	
+	timing_run(&job->tm);
+	return NULL;
+}
 
-	if((!ENABLE_FORWARDING) && MEM_opcode == 0x00)
-	{
-		if(!(MEM_opcode == 0x28 || MEM_opcode == 0x29 || MEM_opcode == 0x2B))
-		{
-			if((MEM_RD != 0) && (MEM_RD == EX_RS))
-			{
-				EX_ID.IR = 0;
-				EX_ID.PC = 0;
-				EX_ID.SYSCALL = 0;
-			}
-			if((MEM_RD != 0) && (MEM_RD == EX_RT))
-			{
-				EX_ID.IR = 0;
-				EX_ID.PC = 0;
-				EX_ID.SYSCALL = 0;
-			}
-		}
+/************************************************************/
+/* Time a saved trace, mapped read-only, under each whitespace-separated */
+/* configuration at once, one thread apiece; no configurations means the */
+/* current ones. Guest memory and registers are left alone              */
+/************************************************************/
+int trace_replay(const char *trace_file, const char *configs)
+{
+	Replay_Job jobs[REPLAY_MAX_CONFIGS];
+	pthread_t threads[REPLAY_MAX_CONFIGS];
+	const Trace_File_Header *header;
+	char list[256], *config, *save;
+	void *map;
+	size_t size;
+	int fd, count = 0, i;
+	double start;
+
+	if (engine_unmodelled()) {
+		printf("Trace replay does not model %s; turn it off first\n", engine_unmodelled());
+		return FALSE;
 	}
-	else if((!ENABLE_FORWARDING) || (MEM_opcode == 0x20 || MEM_opcode == 0x21 || MEM_opcode == 0x23))
-	{
-		MEM_RD = (0x1F0000 & MEM_EX.IR) >> 16;
-		switch(MEM_opcode) {
-			case 0x8:
-			case 0x9:
-			case 0xC:
-			case 0xE:
-			case 0xD:	
-			case 0xA:
-			case 0x20:
-			case 0x21:
-			case 0xF:
-			case 0x23:
-				if(!(MEM_opcode == 0x28 || MEM_opcode == 0x29 || MEM_opcode == 0x2B))
-				{
-					if((MEM_RD != 0) && (MEM_RD == EX_RS))
-					{
-						EX_ID.IR = 0;
-						EX_ID.PC = 0;
-						EX_ID.SYSCALL = 0;
-					}
-				}
-				break;
-			case 0x29:
-			case 0x28:
-			case 0x2B:
-				if((MEM_RD != 0) && (MEM_RD == EX_RS))
-				{
-					EX_ID.IR = 0;
-					EX_ID.PC = 0;
-					EX_ID.SYSCALL = 0;
-				}
-				if((MEM_RD != 0) && (MEM_RD == EX_RT))
-				{
-					EX_ID.IR = 0;
-					EX_ID.PC = 0;
-					EX_ID.SYSCALL = 0;
-				}
-				break;
+	snprintf(list, sizeof(list), "%s", configs ? configs : "");
+	for (config = strtok_r(list, " \t", &save); config; config = strtok_r(NULL, " \t", &save)) {
+		if (count == REPLAY_MAX_CONFIGS) {
+			printf("At most %d configurations at once\n", REPLAY_MAX_CONFIGS);
+			return FALSE;
+		}
+		if (!replay_configure(&jobs[count++], config)) {
+			printf("Bad configuration %s\n", config);
+			return FALSE;
 		}
 	}
+	if (count == 0) {
+		replay_configure(&jobs[count++], NULL);
+	}
 
-	if(((!ENABLE_FORWARDING) || (WB_opcode == 0xF)) && WB_opcode == 0x00) 
-	{
-		if(!(WB_opcode == 0x28 || WB_opcode == 0x29 || WB_opcode == 0x2B))
-		{
-			if((WB_RD != 0) && (WB_RD == EX_RS))
-			{
-				EX_ID.IR = 0;
-				EX_ID.PC = 0;
-				EX_ID.SYSCALL = 0;
-			}
-
-			if((WB_RD != 0) && (WB_RD == EX_RT))
-			{
-				EX_ID.IR = 0;
-				EX_ID.PC = 0;
-				EX_ID.SYSCALL = 0;
-			}
+	fd = open(trace_file, O_RDONLY);
+	if (fd < 0) {
+		printf("Cannot open %s\n", trace_file);
+		return FALSE;
+	}
+	size = lseek(fd, 0, SEEK_END);
+	map = size >= sizeof(Trace_File_Header) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	header = map;
+	if (map == MAP_FAILED || header->magic != TRACE_MAGIC || header->version != TRACE_VERSION
+		|| header->record_size != sizeof(Trace_Record)) {
+		printf("%s is not a trace\n", trace_file);
+		if (map != MAP_FAILED) {
+			munmap(map, size);
 		}
+		return FALSE;
 	}
-	else if((!ENABLE_FORWARDING) || (WB_opcode == 0xF))
-	{
-		WB_RD = (0x1F0000 & WB_MEM.IR) >> 16;
-		switch(WB_opcode) {
-			case 0x8:
-			case 0x9:
-			case 0xC:
-			case 0xE:
-			case 0xD:
-			case 0xA:
-			case 0x20:
-			case 0x21:
-			case 0xF:
-			case 0x23:
-				if(!(WB_opcode == 0x28 || WB_opcode == 0x29 || WB_opcode == 0x2B))
-				{
-					if((WB_RD != 0) && (WB_RD == EX_RS))
-					{
-						EX_ID.IR = 0;
-						EX_ID.PC = 0;
-						EX_ID.SYSCALL = 0;
-					}
-				}
-				break;
-			case 0x29:
-			case 0x28:
-			case 0x2B:
-				if((WB_RD == EX_RS)&&(WB_RD != 0))
-				{
-					EX_ID.IR = 0;
-					EX_ID.PC = 0;
-					EX_ID.SYSCALL = 0;
-				}
+	madvise(map, size, MADV_SEQUENTIAL);
 
-				if((WB_RD == EX_RT)&&(WB_RD != 0))
-				{
-					EX_ID.IR = 0;
-					EX_ID.PC = 0;
-					EX_ID.SYSCALL = 0;
-				}
-				break;
+	start = host_seconds();
+	for (i = 0; i < count; i++) {
+		jobs[i].tm.replay = (const Trace_Record *)(header + 1);
+		jobs[i].tm.replay_count = (size - sizeof(*header)) / sizeof(Trace_Record);
+		jobs[i].threaded = count > 1 && pthread_create(&threads[i], NULL, replay_worker, &jobs[i]) == 0;
+		if (!jobs[i].threaded) {
+			replay_worker(&jobs[i]);
 		}
 	}
-
-	if(!ENABLE_FORWARDING)
-	{
-		MEM_RD = (0x1F0000 & MEM_EX.IR) >> 16;
-		WB_RD = (0x1F0000 & WB_MEM.IR) >> 16;
-		switch (opcode)
-		{
-			case 0x29:
-			case 0x28:
-			case 0x2B:
-				if((MEM_RD == EX_RS)&&(MEM_RD != 0))
-				{
-					EX_ID.IR = 0;
-					EX_ID.PC = 0;
-					EX_ID.SYSCALL = 0;
-				}
-				if((MEM_RD == EX_RT)&&(MEM_RD != 0))
-				{
-					EX_ID.IR = 0;
-					EX_ID.PC = 0;
-					EX_ID.SYSCALL = 0;
-				}	
-
-				if((WB_RD == EX_RS)&&(WB_RD != 0))
-				{
-					EX_ID.IR = 0;
-					EX_ID.PC = 0;
-					EX_ID.SYSCALL = 0;
-				}
-
-				if((WB_RD == EX_RT)&&(WB_RD != 0))
-				{
-					EX_ID.IR = 0;
-					EX_ID.PC = 0;
-					EX_ID.SYSCALL = 0;
-				}		
-				break;
+	for (i = 0; i < count; i++) {
+		if (jobs[i].threaded) {
+			pthread_join(threads[i], NULL);
 		}
 	}
 
-	if (function == 0x0C && opcode == 0x00)
-	{
-		EX_ID.SYSCALL = CURRENT_STATE.REGS[2];
+	printf("Replay of %llu records, %d configuration%s in %.3f s\n", (unsigned long long)jobs[0].tm.replay_count,
+		count, count == 1 ? "" : "s", host_seconds() - start);
+	printf("-------------------------------------------------------------------------------\n");
+	printf("%-24s %10s %10s %7s %8s %8s %8s %8s\n", "Configuration", "Cycles", "Instrs", "CPI", "EX/MEM", "MEM/WB", "Store", "FP");
+	for (i = 0; i < count; i++) {
+		printf("%-24s %10u %10u %7.3f %8llu %8llu %8llu %8llu\n", jobs[i].name, jobs[i].tm.cycles, jobs[i].tm.instructions,
+			jobs[i].tm.instructions ? (double)jobs[i].tm.cycles / jobs[i].tm.instructions : 0,
+			(unsigned long long)jobs[i].tm.stalls[0], (unsigned long long)jobs[i].tm.stalls[1],
+			(unsigned long long)jobs[i].tm.stalls[2], (unsigned long long)jobs[i].tm.stalls[3]);
 	}
+	printf("-------------------------------------------------------------------------------\n\n");
+	munmap(map, size);
+	return TRUE;
 }
 
 /************************************************************/
-/* instruction fetch (IF) pipeline stage:                                                              */ 
+/* Barrel core: each hardware thread runs the program on its own      */
+/* CPU_State over shared memory, executed as IF picks it, and the     */
+/* latches carry the thread so ID only checks hazards within a thread */
 /************************************************************/
-void IF()
+static Barrel_Core BARREL;
+
+/* Execute a thread's next instruction so that IF can look at it */
+static void barrel_advance(Barrel_Thread *thread, uint32_t text_end)
 {
-	if(CYCLE_COUNT < 1 || ID_IF.SYSCALL == 0xA || ((EX_ID.IR == 0 && EX_ID.PC == 0 && EX_ID.SYSCALL == 0) && CYCLE_COUNT > 4))
-	{
+	Mem_Store_Record store;
+	uint32_t old_value;
+
+	if (thread->next_exits || thread->state.PC < MEM_TEXT_BEGIN || thread->state.PC >= text_end) {
+		thread->fetching = FALSE;
 		return;
 	}
-	
-	uint32_t opcode = (ID_IF.IR & 0xFC000000) >> 26;
-	uint32_t function = (ID_IF.IR & 0x3F);
-	
-	ID_IF.IR = mem_read_32(CURRENT_STATE.PC);
-	ID_IF.PC = CURRENT_STATE.PC;
-	NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-	
-	
-	if (opcode == 0x00 && function == 0x0C)
-		ID_IF.SYSCALL = 0xA;
+	trace_describe(&thread->next, &thread->state);
+	thread->next_exits = !ref_step(&thread->state, &store);
+	if (store.valid) {
+		old_value = mem_read_32(store.address);
+		mem_write_32(store.address, (old_value & ~store.mask) | (store.new_value & store.mask));
+	}
+	thread->fetching = TRUE;
 }
 
+/* Would a thread's next instruction stall in ID next cycle, behind */
+/* what is now in ID/EX and EX/MEM?                                  */
+static inline __attribute__((always_inline)) int barrel_would_stall(Barrel_Core *core, uint32_t tid, const int forwarding)
+{
+	Barrel_Thread *thread = &core->thread[tid];
+	FP_Op fp_op;
 
-/************************************************************/
-/* Initialize Memory                                                                                                    */ 
-/************************************************************/
-void initialize() { 
-	init_memory();
-	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
-	NEXT_STATE = CURRENT_STATE;
-	RUN_FLAG = TRUE;
+	if (ID_hazard(forwarding, thread->next.ir, core->EX_ID.TID == tid ? core->EX_ID.IR : 0,
+		core->MEM_EX.TID == tid ? core->MEM_EX.IR : 0)) {
+		return TRUE;
+	}
+	if (isa_flags(thread->next.ir) & ISA_FP) {
+		fp_decode(thread->next.ir, &fp_op);
+		return fp_hazard(&thread->fp, FP_LATENCY, core->cycles + 1, &fp_op) != 0;
+	}
+	return FALSE;
 }
 
-/************************************************************/
-/* Print the program loaded into memory (in MIPS assembly format)    */ 
-/************************************************************/
-void print_program(){
-	int i;
-	uint32_t addr;
-	
-	for(i=0; i<PROGRAM_SIZE; i++){
-		addr = MEM_TEXT_BEGIN + (i*4);
-		printf("[0x%x]\t", addr);
-		print_instruction(addr);
+/* The thread IF fetches from, round robin after the last one; -1 if */
+/* every thread has run out                                                */
+static inline __attribute__((always_inline)) int barrel_select(Barrel_Core *core, const int forwarding)
+{
+	uint32_t i, tid;
+	int first = -1;
+
+	for (i = 1; i <= core->threads; i++) {
+		tid = (core->last + i) % core->threads;
+		if (!core->thread[tid].fetching) {
+			continue;
+		}
+		if (core->policy == BARREL_ROUND_ROBIN) {
+			return tid;
+		}
+		if (first < 0) {
+			first = tid;
+		}
+		if (!barrel_would_stall(core, tid, forwarding)) {
+			core->avoided += tid != (uint32_t)first;
+			return tid;
+		}
 	}
+	return first;
 }
 
-void print_instruction(uint32_t addr){
-	uint32_t instruction = mem_read_32(addr);
-	uint32_t opcode = (instruction & 0xFC000000) >> 26;
-	uint32_t rs = (0x3E00000 & instruction) >> 21;
-	uint32_t rt = (0x1F0000 & instruction) >> 16;
-	uint32_t immediate = (0xFFFF & instruction);
-	uint32_t rd = (0xF800 & instruction) >> 11;
-	uint32_t shamt = (0x7C & instruction) >> 6;
-	uint32_t function = (0x3F & instruction);
-	uint32_t offset = (0x3FFFFFF & instruction);
+/************************************************************/
+/* One cycle of the barrel core: the stage gates of timing_cycle, with */
+/* a thread's exit ending only that thread                                   */
+/************************************************************/
+static inline __attribute__((always_inline)) void barrel_cycle(Barrel_Core *core, const int forwarding, uint32_t text_end)
+{
+	uint32_t cycle = core->cycles;
+	uint32_t i, mem_ir, wb_ir;
+	int stall, fp, tid, running = FALSE;
+	Barrel_Thread *thread;
+	FP_Op fp_op;
 
-	if (opcode == 0x00) {
-		switch(function) {
-			case 0x00:
-				printf("SLL $%d, $%d, 0x%x\n", rd, rt, shamt);
-				break;
-			case 0x02:
-				printf("SRL $%d, $%d, 0x%x\n", rd, rt, shamt);
-				break;
-			case 0x03:
-				printf("SRA $%d, $%d, 0x%x\n", rd, rt, shamt);
-				break;
-			case 0x08:
-				printf("JR $%d\n", rs);
-				break;
-			case 0x09:
-				printf("JALR $%d, $%d\n", rs, rd);
-				break;
-			case 0x0C:
-				printf("SYSCALL\n");
-				break;
-			case 0x10:
-				printf("MFHI $%d\n", rd);
-				break;
-			case 0x11:
-				printf("MTHI $%d\n", rs);
-				break;
-			case 0x12:
-				printf("MFLO $%d\n", rd);
-				break;
-			case 0x13:
-				printf("MTLO $%d\n", rs);
-				break;
-			case 0x18:
-				printf("MULT $%d, $%d\n", rs, rt);
-				break;
-			case 0x19:
-				printf("MULTU $%d, $%d\n", rs, rt);
-				break;
-			case 0x1A:
-				printf("DIV $%d, $%d\n", rs, rt);
-				break;
-			case 0x1B:
-				printf("DIVU $%d, $%d\n", rs, rt);
-				break;
-			case 0x20:
-				printf("ADD $%d, $%d, $%d\n", rd, rs, rt);
-				break;
-			case 0x21:
-				printf("ADDU $%d, $%d, $%d\n", rd, rs, rt);
-				break;
-			case 0x22:
-				printf("SUB $%d, $%d, $%d\n", rd, rs, rt);
-				break;
-			case 0x23:
-				printf("SUBU $%d, $%d, $%d\n", rd, rs, rt);
-				break;
-			case 0x24:
-				printf("AND $%d, $%d, $%d\n", rd, rs, rt);
-				break;
-			case 0x25:
-				printf("OR $%d, $%d, $%d\n", rd, rs, rt);
-				break;
-			case 0x26:
-				printf("XOR $%d, $%d, $%d\n", rd, rs, rt);
-				break;
-			case 0x27:
-				printf("NOR $%d, $%d, $%d\n", rd, rs, rt);
-				break;
-			case 0x2A:
-				printf("SLT $%d, $%d, $%d\n", rd, rs, rt);
-				break;
+	/*WB*/
+	if (cycle >= 5 && !TIMING_BUBBLE(core->WB_MEM)) {
+		thread = &core->thread[core->WB_MEM.TID];
+		thread->instructions++;
+		core->instructions++;
+		if (core->WB_MEM.SYSCALL == 0xA) {
+			thread->exited = TRUE;
 		}
-	} 
-	else {
-		switch(opcode) {
-			case 0x8:
-				printf("ADDI $%d, $%d, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0x9:
-				printf("ADDIU $%d, $%d, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0xC:
-				printf("ANDI $%d, $%d, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0xE:
-				printf("XORI $%d, $%d, 0x%x\n", rt, rs, immediate);	
-				break;
-			case 0xD:
-				printf("ORI $%d, $%d, 0x%x\n", rt, rs, immediate);	
-				break;
-			case 0xA:
-				printf("SLTI $%d, $%d, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0x4:
-				printf("BEQ $%d, $%d, 0x%x\n", rs, rt, (uint32_t)(immediate * 4));
-				break;
-			case 0x1:
-				if (rt == 1) 
-				{
-					printf("BGEZ $%d, 0x%x\n", rs, (uint32_t)(immediate * 4));
-				} 
-				else if (rt == 0) 
-				{
-					printf("BLTZ $%d, 0x%x\n", rs, (uint32_t)(immediate * 4));
-				}
-				break;
-			case 0x7:
-				printf("BGTZ $%d, 0x%x\n", rs, (uint32_t)(immediate * 4));
-				break;
-			case 0x6:
-				printf("BLEZ $%d, 0x%x\n", rs, (uint32_t)(immediate * 4));
-				break;
-			case 0x5:
-				printf("BNE $%d, $%d, %d\n", rs, rt, (uint32_t)(immediate * 4));
-				break;
-			case 0x2:	
-				printf("J 0x%x\n", offset);
-				break;
-			case 0x3:
-				printf("JAL 0x%x\n", offset);
-				break;
-			case 0x20:
-				printf("LB $%d, 0x%x($%d)\n", rt, immediate, rs);
-				break;
-			case 0x21:
-				printf("LH $%d, 0x%x($%d)\n", rt, immediate, rs);
-				break;
-			case 0xF:
-				printf("LUI $%d, 0x%x\n", rt, immediate);
-				break;
-			case 0x23:
-				printf("LW $%d, 0x%x($%d)\n", rt, immediate, rs);
-				break;
-			case 0x29:
-				printf("SH $%d, 0x%x($%d)\n", rt, immediate, rs);
-				break;
-			case 0x28:
-				printf("SB $%d, 0x%x($%d)\n", rt, immediate, rs);
-				break;
-			case 0x2B:
-				printf("SW $%d, 0x%x($%d)\n", rt, immediate, rs);
-				break;
+	}
+	/*MEM*/
+	if (cycle >= 4) {
+		core->WB_MEM = core->MEM_EX;
+	}
+	/*EX*/
+	if (cycle >= 3) {
+		core->MEM_EX = core->EX_ID;
+	}
+	/*ID: producers of other threads are no hazard*/
+	if (cycle >= 2) {
+		core->EX_ID = core->ID_IF;
+		thread = &core->thread[core->EX_ID.TID];
+		fp = __builtin_expect((isa_flags(core->EX_ID.IR) & ISA_FP) != 0, 0);
+		mem_ir = core->MEM_EX.TID == core->EX_ID.TID ? core->MEM_EX.IR : 0;
+		wb_ir = core->WB_MEM.TID == core->EX_ID.TID ? core->WB_MEM.IR : 0;
+		stall = ID_hazard(forwarding, core->EX_ID.IR, mem_ir, wb_ir);
+		if (fp) {
+			fp_decode(core->EX_ID.IR, &fp_op);
+			stall |= fp_hazard(&thread->fp, FP_LATENCY, cycle, &fp_op);
+		}
+		if (stall) {
+			memset(&core->EX_ID, 0, sizeof(core->EX_ID));
+			core->stalls[__builtin_ctz(stall)]++;
+			thread->stalls[__builtin_ctz(stall)]++;
+		}
+		else if (fp) {
+			fp_issue(&thread->fp, FP_LATENCY, cycle, &fp_op);
+			for (i = 0; i < core->threads; i++) {
+				core->thread[i].fp.divider_free = thread->fp.divider_free;
+			}
+		}
+	}
+	/*IF: hold while ID stalls, else pick a thread*/
+	if (cycle >= 1 && !(TIMING_BUBBLE(core->EX_ID) && cycle > 4)) {
+		tid = barrel_select(core, forwarding);
+		if (tid >= 0) {
+			thread = &core->thread[tid];
+			core->ID_IF.IR = thread->next.ir;
+			core->ID_IF.PC = thread->next.pc;
+			core->ID_IF.V0 = thread->next.v0;
+			core->ID_IF.SYSCALL = thread->next_exits ? 0xA : 0;
+			core->ID_IF.TID = tid;
+			core->last = tid;
+			barrel_advance(thread, text_end);
+		}
+		else {
+			memset(&core->ID_IF, 0, sizeof(core->ID_IF));
+		}
+	}
+	core->cycles++;
+
+	for (i = 0; i < core->threads; i++) {
+		running |= !core->thread[i].exited;
+	}
+	if (!running) {
+		core->done = TRUE;
+	}
+	else if (TIMING_BUBBLE(core->ID_IF) && TIMING_BUBBLE(core->EX_ID) && TIMING_BUBBLE(core->MEM_EX) && TIMING_BUBBLE(core->WB_MEM)) {
+		/*threads that left the text drain without an exit*/
+		for (i = 0; i < core->threads; i++) {
+			running &= !core->thread[i].fetching;
 		}
+		core->done = running;
 	}
 }
 
 /************************************************************/
-/* Print the current pipeline                                                                                    */ 
+/* Run the program on threads hardware contexts from a reset pipeline; */
+/* context t starts as the current state with $a0 = t, so a program can */
+/* split its work. Thread 0's registers are left in CURRENT_STATE      */
 /************************************************************/
-void show_pipeline(){
-	printf("Current PC:\t\t%X\n", CURRENT_STATE.PC);
-	printf("IF/ID.IR\t\t%X  ", ID_IF.IR);
-	print_instruction(ID_IF.PC);
-	printf("IF/ID.PC\t\t%X\n", ID_IF.PC);
-	printf("\n");
-	printf("ID/EX.IR\t\t%X  ", EX_ID.IR);
-	print_instruction(EX_ID.PC);
-	printf("ID/EX.A\t\t%X\n", EX_ID.A);
-	printf("ID/EX.B\t\t%X\n", EX_ID.B);
-	printf("ID/EX.imm\t\t%X\n", EX_ID.imm);
-	printf("\n");
-	printf("EX/MEM.IR\t\t%X ", MEM_EX.IR);
-	print_instruction(MEM_EX.PC);
-	printf("EX/MEM.A\t\t%X\n", MEM_EX.A);
-	printf("EX/MEM.B\t\t%X\n", MEM_EX.B);
-	printf("EX/MEM.ALUOutput\t\t%X\n", MEM_EX.ALUOutput);
-	printf("EX/MEM.ALUOutput2\t\t%X\n", MEM_EX.ALUOutput2);
-	printf("\n");
-	printf("MEM/WEB.IR\t\t%X", WB_MEM.IR);
-	print_instruction(WB_MEM.PC);
-	printf("MEM/WEB.A\t\t%X\n", WB_MEM.IR);
-	printf("MEM/WEB.LMD\t\t%X\n", WB_MEM.IR);
-}
+int barrel_run(uint32_t threads, int policy)
+{
+	Barrel_Core *core = &BARREL;
+	uint32_t text_end = MEM_TEXT_BEGIN + PROGRAM_SIZE * 4;
+	uint32_t t;
+	int i;
+	double start;
 
-/***************************************************************/
-/* main                                                                                                                                   */
-/***************************************************************/
-int main(int argc, char *argv[]) {                              
-	printf("\n**************************\n");
-	printf("Welcome to MU-MIPS SIM...\n");
-	printf("**************************\n\n");
-	
-	if (argc < 2) {
-		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
-		exit(1);
+	if (RUN_FLAG == FALSE || CYCLE_COUNT != 0) {
+		printf("A barrel run starts from a reset pipeline\n");
+		return FALSE;
+	}
+	if (threads == 0 || threads > BARREL_MAX_THREADS) {
+		printf("A barrel core has 1 to %d threads\n", BARREL_MAX_THREADS);
+		return FALSE;
+	}
+	if (engine_unmodelled()) {
+		printf("The barrel core does not model %s; turn it off first\n", engine_unmodelled());
+		return FALSE;
+	}
+	memset(core, 0, sizeof(*core));
+	core->forwarding = ENABLE_FORWARDING;
+	core->policy = policy;
+	core->threads = threads;
+	core->last = threads - 1;
+	for (t = 0; t < threads; t++) {
+		core->thread[t].state = CURRENT_STATE;
+		core->thread[t].state.REGS[4] = t;
 	}
 
-	strcpy(prog_file, argv[1]);
-	initialize();
-	load_program();
-	help();
-	while (1){
-		handle_command();
+	start = host_seconds();
+	for (t = 0; t < threads; t++) {
+		barrel_advance(&core->thread[t], text_end);
 	}
-	return 0;
+	if (core->forwarding) {
+		while (!core->done) {
+			barrel_cycle(core, TRUE, text_end);
+		}
+	}
+	else {
+		while (!core->done) {
+			barrel_cycle(core, FALSE, text_end);
+		}
+	}
+
+	CURRENT_STATE = core->thread[0].state;
+	CYCLE_COUNT += core->cycles;
+	INSTRUCTION_COUNT += core->instructions;
+	for (i = 0; i < NUM_STALL_CAUSES; i++) {
+		STATS.stalls[i] += core->stalls[i];
+	}
+	RUN_FLAG = FALSE;
+
+	printf("Barrel core, %u thread%s, %s fetch, %.3f s on the host\n", threads, threads == 1 ? "" : "s",
+		policy == BARREL_STALL_AWARE ? "stall-aware" : "round-robin", host_seconds() - start);
+	printf("-----------------------------------------------------------------\n");
+	printf("%-8s %10s %7s %8s %8s %8s %8s\n", "Thread", "Instrs", "IPC", "EX/MEM", "MEM/WB", "Store", "FP");
+	for (t = 0; t < threads; t++) {
+		printf("%-8u %10u %7.3f %8llu %8llu %8llu %8llu\n", t, core->thread[t].instructions,
+			core->cycles ? (double)core->thread[t].instructions / core->cycles : 0,
+			(unsigned long long)core->thread[t].stalls[0], (unsigned long long)core->thread[t].stalls[1],
+			(unsigned long long)core->thread[t].stalls[2], (unsigned long long)core->thread[t].stalls[3]);
+	}
+	printf("%-8s %10u %7.3f %8llu %8llu %8llu %8llu\n", "all", core->instructions,
+		core->cycles ? (double)core->instructions / core->cycles : 0,
+		(unsigned long long)core->stalls[0], (unsigned long long)core->stalls[1],
+		(unsigned long long)core->stalls[2], (unsigned long long)core->stalls[3]);
+	printf("-----------------------------------------------------------------\n");
+	printf("%u cycles", core->cycles);
+	if (policy == BARREL_STALL_AWARE) {
+		printf(", %llu fetches passed over a thread that would stall", (unsigned long long)core->avoided);
+	}
+	printf("\n\n");
+	return TRUE;
 }
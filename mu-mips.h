@@ -1,3 +1,7 @@
+#ifndef MU_MIPS_H
+#define MU_MIPS_H
+
+#include <stdio.h>
 #include <stdint.h>
 
 #define FALSE 0
@@ -22,29 +26,60 @@
 #define MEM_STACK_BEGIN 0x7FFFFFFF
 #define MEM_STACK_END  0x10010000
 
+/*memory is tracked in pages so that dumps and resets only visit what was written*/
+#define MEM_PAGE_SHIFT 12
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_SHIFT)
+#define PAGE_DIRTY 0x01	/* written since the last dump or mark */
+#define PAGE_TOUCHED 0x02	/* written since the last reset */
+#define PAGE_WATCHED 0x04	/* holds a memory watchpoint */
+
 typedef struct {
 	uint32_t begin, end;
 	uint8_t *mem;
+	uint8_t *page_flags;
 } mem_region_t;
 
 /* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
-	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
-	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
-	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
-};
+extern mem_region_t MEM_REGIONS[];
+
+/* every page flagged PAGE_TOUCHED, as region << 24 | page */
+extern uint32_t *TOUCHED_PAGES;
+extern uint32_t NUM_TOUCHED_PAGES;
 
 #define NUM_MEM_REGION 4
 #define MIPS_REGS 32
+#define MIPS_FP_REGS 32
+#define FCSR_COND 0x00800000	/* condition bit set by C.cond, tested by BC1T/BC1F */
 
 typedef struct CPU_State_Struct {
 
   uint32_t PC;		                   /* program counter */
   uint32_t REGS[MIPS_REGS]; /* register file. */
   uint32_t HI, LO;                          /* special regs for mult/div. */
+  uint32_t FPR[MIPS_FP_REGS];	/* COP1 registers; a double uses an even/odd pair, low word even */
+  uint32_t FCSR;
+  uint32_t BRANCH_TARGET;	/* taken branch waiting for its delay slot, 0 if none (reference model) */
 } CPU_State;
 
+/* WB writes at most one GPR or the HI/LO pair per cycle; the write is held
+   here and committed at the end of the cycle so that ID still reads the
+   register file as it was at the start of the cycle */
+#define PENDING_REG 0x01
+#define PENDING_HI 0x02
+#define PENDING_LO 0x04
+#define PENDING_FPR 0x08
+#define PENDING_FPR_PAIR 0x10	/* fpr and fpr + 1 */
+#define PENDING_FCSR 0x20
+
+typedef struct Pending_Write_Struct {
+	uint32_t flags;
+	uint32_t reg, value;
+	uint32_t hi, lo;
+	uint32_t fpr;
+	uint64_t fvalue;
+	uint32_t fcsr;
+} Pending_Write;
+
 typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t PC;	
 	uint32_t IR;
@@ -57,50 +92,745 @@ typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t ALUOutput;
 	uint32_t ALUOutput2;
 	uint32_t LMD;
+	uint64_t FS, FT;	/* COP1 operands, a register pair for doubles */
+	uint64_t FPOutput;	/* value for the FPR(s) written in WB */
 	
 } CPU_Pipeline_Reg;
 
+typedef struct Mem_Store_Record_Struct{
+	uint32_t valid;
+	uint32_t address;
+	uint32_t mask;		/* bytes of the word touched by the store */
+	uint32_t old_value;	/* word at address before the store */
+	uint32_t new_value;	/* word at address after the store */
+} Mem_Store_Record;
+
+/* why ID inserted a bubble: the producer is in EX/MEM, in MEM/WB, or a */
+/* store waits for its data without forwarding, or an FP operand or unit */
+/* is not ready yet, or a user load or store is still being translated, */
+/* or a store finds the store buffer full; bit numbers index stalls[] */
+#define STALL_EX_MEM 0x01
+#define STALL_MEM_WB 0x02
+#define STALL_STORE 0x04
+#define STALL_FP 0x08
+#define STALL_TLB 0x10
+#define STALL_SB_FULL 0x20
+#define NUM_STALL_CAUSES 6
+
+/* event counts since the last reset */
+typedef struct Pipeline_Stats_Struct {
+	uint64_t stalls[NUM_STALL_CAUSES];
+	uint64_t forwards;	/* EX operands taken from a later latch */
+	uint64_t loads, stores;
+} Pipeline_Stats;
+
+/* forwarding mux selects for ForwardA/ForwardB */
+#define FWD_NONE 0
+#define FWD_MEM_WB 1	/* operand from the MEM/WB latch */
+#define FWD_EX_MEM 2	/* operand from the EX/MEM latch */
+
+/* FP execution units; each latency is the cycles from leaving ID to the */
+/* result being readable by a later instruction in ID                        */
+#define FP_UNIT_ADD 0	/* add, sub, abs, neg, mov, cvt and c.cond; pipelined */
+#define FP_UNIT_MUL 1	/* pipelined */
+#define FP_UNIT_DIV 2	/* div and sqrt share one unpipelined divider */
+#define FP_UNIT_SQRT 3
+#define NUM_FP_UNITS 4
+#define FP_UNIT_NONE -1	/* moves, loads and stores */
+#define FP_MIN_LATENCY 3	/* FP results are only bypassed from WB */
+
+/* FP RAW and structural hazards, as the cycle each resource frees up */
+typedef struct FP_Scoreboard_Struct {
+	uint32_t ready[MIPS_FP_REGS];	/* a reader of the register may leave ID */
+	uint32_t cond_ready;	/* FCSR condition bit */
+	uint32_t divider_free;
+} FP_Scoreboard;
+
+/* what an FP instruction reads and writes, FPRs as bit masks */
+typedef struct FP_Op_Struct {
+	uint32_t reads, writes;
+	int reads_cond, writes_cond;
+	int pair_source, pair_result;	/* operands or result are doubles */
+	int unit;	/* FP_UNIT_* */
+} FP_Op;
+
+/***************************************************************/
+/* The instruction set, one line per instruction:                      */
+/* X(name, table, key, mnemonic, format, flags, unit)                  */
+/* Decode finds an instruction under key in table; the stages, the     */
+/* hazard checks, the reference model and the disassembler all take    */
+/* their register maps, memory behaviour and FP unit from this list    */
+/***************************************************************/
+#define DECODE_PRIMARY 0	/* by opcode */
+#define DECODE_SPECIAL 1	/* opcode 0, by function */
+#define DECODE_REGIMM 2	/* opcode 1, by rt */
+#define DECODE_COP0 3	/* opcode 0x10, by rs */
+#define DECODE_COP0_CO 4	/* opcode 0x10 with rs = CO, by function */
+#define DECODE_COP1 5	/* opcode 0x11, by rs */
+#define DECODE_COP1_BC 6	/* opcode 0x11 with rs = BC, by the tf bit */
+#define DECODE_COP1_FN 7	/* opcode 0x11 with rs = S, D or W, by function */
+#define DECODE_TABLES 8
+
+/* operand layouts for the disassembler */
+#define FMT_NONE 0
+#define FMT_R3 1	/* $rd, $rs, $rt */
+#define FMT_SHIFT 2	/* $rd, $rt, sa */
+#define FMT_RS 3	/* $rs */
+#define FMT_RD 4	/* $rd */
+#define FMT_RS_RD 5	/* $rs, $rd */
+#define FMT_RS_RT 6	/* $rs, $rt */
+#define FMT_IMM 7	/* $rt, $rs, imm */
+#define FMT_LUI 8	/* $rt, imm */
+#define FMT_BRANCH 9	/* $rs, $rt, offset */
+#define FMT_BRANCH_Z 10	/* $rs, offset */
+#define FMT_JUMP 11	/* target */
+#define FMT_MEM 12	/* $rt, imm($rs) */
+#define FMT_FP_MEM 13	/* $ft, imm($rs) */
+#define FMT_COP0_MOVE 14	/* $rt, $rd */
+#define FMT_COP1_MOVE 15	/* $rt, $fs */
+#define FMT_FP_BRANCH 16	/* offset */
+#define FMT_FP3 17	/* .fmt $fd, $fs, $ft */
+#define FMT_FP2 18	/* .fmt $fd, $fs */
+#define FMT_FP_CMP 19	/* .fmt $fs, $ft */
+
+/* what an instruction does; registers are GPRs unless ISA_FP says */
+#define ISA_READS_RS 0x00001
+#define ISA_READS_RT 0x00002
+#define ISA_WRITES_RD 0x00004
+#define ISA_WRITES_RT 0x00008
+#define ISA_READS_HI 0x00010
+#define ISA_READS_LO 0x00020
+#define ISA_WRITES_HI 0x00040
+#define ISA_WRITES_LO 0x00080
+#define ISA_LINK 0x00100	/* writes the return address to $31, or rd for JALR */
+#define ISA_LOAD 0x00200
+#define ISA_STORE 0x00400
+#define ISA_BRANCH 0x00800	/* PC-relative, with a delay slot */
+#define ISA_JUMP 0x01000	/* absolute or register target */
+#define ISA_SYSCALL 0x02000
+#define ISA_COP 0x04000	/* COP0, COP1 and their loads and stores: no forwarding */
+#define ISA_FP 0x08000	/* goes through the FP scoreboard; rt, rd, sa name FPRs */
+#define ISA_LATE 0x10000	/* MFC0, MFC1: rt is only ready in WB */
+
+#define MIPS_ISA(X) \
+	X(SLL,     DECODE_SPECIAL, 0x00, "SLL",     FMT_SHIFT,     ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(SRL,     DECODE_SPECIAL, 0x02, "SRL",     FMT_SHIFT,     ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(SRA,     DECODE_SPECIAL, 0x03, "SRA",     FMT_SHIFT,     ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(JR,      DECODE_SPECIAL, 0x08, "JR",      FMT_RS,        ISA_READS_RS | ISA_JUMP, FP_UNIT_NONE) \
+	X(JALR,    DECODE_SPECIAL, 0x09, "JALR",    FMT_RS_RD,     ISA_READS_RS | ISA_JUMP | ISA_LINK, FP_UNIT_NONE) \
+	X(SYSCALL, DECODE_SPECIAL, 0x0C, "SYSCALL", FMT_NONE,      ISA_SYSCALL, FP_UNIT_NONE) \
+	X(MFHI,    DECODE_SPECIAL, 0x10, "MFHI",    FMT_RD,        ISA_READS_HI | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(MTHI,    DECODE_SPECIAL, 0x11, "MTHI",    FMT_RS,        ISA_READS_RS | ISA_WRITES_HI, FP_UNIT_NONE) \
+	X(MFLO,    DECODE_SPECIAL, 0x12, "MFLO",    FMT_RD,        ISA_READS_LO | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(MTLO,    DECODE_SPECIAL, 0x13, "MTLO",    FMT_RS,        ISA_READS_RS | ISA_WRITES_LO, FP_UNIT_NONE) \
+	X(MULT,    DECODE_SPECIAL, 0x18, "MULT",    FMT_RS_RT,     ISA_READS_RS | ISA_READS_RT | ISA_WRITES_HI | ISA_WRITES_LO, FP_UNIT_NONE) \
+	X(MULTU,   DECODE_SPECIAL, 0x19, "MULTU",   FMT_RS_RT,     ISA_READS_RS | ISA_READS_RT | ISA_WRITES_HI | ISA_WRITES_LO, FP_UNIT_NONE) \
+	X(DIV,     DECODE_SPECIAL, 0x1A, "DIV",     FMT_RS_RT,     ISA_READS_RS | ISA_READS_RT | ISA_WRITES_HI | ISA_WRITES_LO, FP_UNIT_NONE) \
+	X(DIVU,    DECODE_SPECIAL, 0x1B, "DIVU",    FMT_RS_RT,     ISA_READS_RS | ISA_READS_RT | ISA_WRITES_HI | ISA_WRITES_LO, FP_UNIT_NONE) \
+	X(ADD,     DECODE_SPECIAL, 0x20, "ADD",     FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(ADDU,    DECODE_SPECIAL, 0x21, "ADDU",    FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(SUB,     DECODE_SPECIAL, 0x22, "SUB",     FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(SUBU,    DECODE_SPECIAL, 0x23, "SUBU",    FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(AND,     DECODE_SPECIAL, 0x24, "AND",     FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(OR,      DECODE_SPECIAL, 0x25, "OR",      FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(XOR,     DECODE_SPECIAL, 0x26, "XOR",     FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(NOR,     DECODE_SPECIAL, 0x27, "NOR",     FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(SLT,     DECODE_SPECIAL, 0x2A, "SLT",     FMT_R3,        ISA_READS_RS | ISA_READS_RT | ISA_WRITES_RD, FP_UNIT_NONE) \
+	X(BLTZ,    DECODE_REGIMM,  0x00, "BLTZ",    FMT_BRANCH_Z,  ISA_READS_RS | ISA_BRANCH, FP_UNIT_NONE) \
+	X(BGEZ,    DECODE_REGIMM,  0x01, "BGEZ",    FMT_BRANCH_Z,  ISA_READS_RS | ISA_BRANCH, FP_UNIT_NONE) \
+	X(J,       DECODE_PRIMARY, 0x02, "J",       FMT_JUMP,      ISA_JUMP, FP_UNIT_NONE) \
+	X(JAL,     DECODE_PRIMARY, 0x03, "JAL",     FMT_JUMP,      ISA_JUMP | ISA_LINK, FP_UNIT_NONE) \
+	X(BEQ,     DECODE_PRIMARY, 0x04, "BEQ",     FMT_BRANCH,    ISA_READS_RS | ISA_READS_RT | ISA_BRANCH, FP_UNIT_NONE) \
+	X(BNE,     DECODE_PRIMARY, 0x05, "BNE",     FMT_BRANCH,    ISA_READS_RS | ISA_READS_RT | ISA_BRANCH, FP_UNIT_NONE) \
+	X(BLEZ,    DECODE_PRIMARY, 0x06, "BLEZ",    FMT_BRANCH_Z,  ISA_READS_RS | ISA_BRANCH, FP_UNIT_NONE) \
+	X(BGTZ,    DECODE_PRIMARY, 0x07, "BGTZ",    FMT_BRANCH_Z,  ISA_READS_RS | ISA_BRANCH, FP_UNIT_NONE) \
+	X(ADDI,    DECODE_PRIMARY, 0x08, "ADDI",    FMT_IMM,       ISA_READS_RS | ISA_WRITES_RT, FP_UNIT_NONE) \
+	X(ADDIU,   DECODE_PRIMARY, 0x09, "ADDIU",   FMT_IMM,       ISA_READS_RS | ISA_WRITES_RT, FP_UNIT_NONE) \
+	X(SLTI,    DECODE_PRIMARY, 0x0A, "SLTI",    FMT_IMM,       ISA_READS_RS | ISA_WRITES_RT, FP_UNIT_NONE) \
+	X(ANDI,    DECODE_PRIMARY, 0x0C, "ANDI",    FMT_IMM,       ISA_READS_RS | ISA_WRITES_RT, FP_UNIT_NONE) \
+	X(ORI,     DECODE_PRIMARY, 0x0D, "ORI",     FMT_IMM,       ISA_READS_RS | ISA_WRITES_RT, FP_UNIT_NONE) \
+	X(XORI,    DECODE_PRIMARY, 0x0E, "XORI",    FMT_IMM,       ISA_READS_RS | ISA_WRITES_RT, FP_UNIT_NONE) \
+	X(LUI,     DECODE_PRIMARY, 0x0F, "LUI",     FMT_LUI,       ISA_WRITES_RT, FP_UNIT_NONE) \
+	X(LB,      DECODE_PRIMARY, 0x20, "LB",      FMT_MEM,       ISA_READS_RS | ISA_WRITES_RT | ISA_LOAD, FP_UNIT_NONE) \
+	X(LH,      DECODE_PRIMARY, 0x21, "LH",      FMT_MEM,       ISA_READS_RS | ISA_WRITES_RT | ISA_LOAD, FP_UNIT_NONE) \
+	X(LW,      DECODE_PRIMARY, 0x23, "LW",      FMT_MEM,       ISA_READS_RS | ISA_WRITES_RT | ISA_LOAD, FP_UNIT_NONE) \
+	X(SB,      DECODE_PRIMARY, 0x28, "SB",      FMT_MEM,       ISA_READS_RS | ISA_READS_RT | ISA_STORE, FP_UNIT_NONE) \
+	X(SH,      DECODE_PRIMARY, 0x29, "SH",      FMT_MEM,       ISA_READS_RS | ISA_READS_RT | ISA_STORE, FP_UNIT_NONE) \
+	X(SW,      DECODE_PRIMARY, 0x2B, "SW",      FMT_MEM,       ISA_READS_RS | ISA_READS_RT | ISA_STORE, FP_UNIT_NONE) \
+	X(LWC1,    DECODE_PRIMARY, 0x31, "LWC1",    FMT_FP_MEM,    ISA_READS_RS | ISA_LOAD | ISA_COP | ISA_FP, FP_UNIT_NONE) \
+	X(SWC1,    DECODE_PRIMARY, 0x39, "SWC1",    FMT_FP_MEM,    ISA_READS_RS | ISA_STORE | ISA_COP | ISA_FP, FP_UNIT_NONE) \
+	X(MFC0,    DECODE_COP0,    0x00, "MFC0",    FMT_COP0_MOVE, ISA_WRITES_RT | ISA_COP | ISA_LATE, FP_UNIT_NONE) \
+	X(MTC0,    DECODE_COP0,    0x04, "MTC0",    FMT_COP0_MOVE, ISA_READS_RT | ISA_COP, FP_UNIT_NONE) \
+	X(TLBR,    DECODE_COP0_CO, 0x01, "TLBR",    FMT_NONE,      ISA_COP, FP_UNIT_NONE) \
+	X(TLBWI,   DECODE_COP0_CO, 0x02, "TLBWI",   FMT_NONE,      ISA_COP, FP_UNIT_NONE) \
+	X(TLBWR,   DECODE_COP0_CO, 0x06, "TLBWR",   FMT_NONE,      ISA_COP, FP_UNIT_NONE) \
+	X(TLBP,    DECODE_COP0_CO, 0x08, "TLBP",    FMT_NONE,      ISA_COP, FP_UNIT_NONE) \
+	X(ERET,    DECODE_COP0_CO, 0x18, "ERET",    FMT_NONE,      ISA_COP | ISA_JUMP, FP_UNIT_NONE) \
+	X(MFC1,    DECODE_COP1,    0x00, "MFC1",    FMT_COP1_MOVE, ISA_WRITES_RT | ISA_COP | ISA_FP | ISA_LATE, FP_UNIT_NONE) \
+	X(MTC1,    DECODE_COP1,    0x04, "MTC1",    FMT_COP1_MOVE, ISA_READS_RT | ISA_COP | ISA_FP, FP_UNIT_NONE) \
+	X(BC1F,    DECODE_COP1_BC, 0x00, "BC1F",    FMT_FP_BRANCH, ISA_BRANCH | ISA_COP | ISA_FP, FP_UNIT_NONE) \
+	X(BC1T,    DECODE_COP1_BC, 0x01, "BC1T",    FMT_FP_BRANCH, ISA_BRANCH | ISA_COP | ISA_FP, FP_UNIT_NONE) \
+	X(ADD_FP,  DECODE_COP1_FN, 0x00, "ADD",     FMT_FP3,       ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(SUB_FP,  DECODE_COP1_FN, 0x01, "SUB",     FMT_FP3,       ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(MUL_FP,  DECODE_COP1_FN, 0x02, "MUL",     FMT_FP3,       ISA_COP | ISA_FP, FP_UNIT_MUL) \
+	X(DIV_FP,  DECODE_COP1_FN, 0x03, "DIV",     FMT_FP3,       ISA_COP | ISA_FP, FP_UNIT_DIV) \
+	X(SQRT_FP, DECODE_COP1_FN, 0x04, "SQRT",    FMT_FP2,       ISA_COP | ISA_FP, FP_UNIT_SQRT) \
+	X(ABS_FP,  DECODE_COP1_FN, 0x05, "ABS",     FMT_FP2,       ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(MOV_FP,  DECODE_COP1_FN, 0x06, "MOV",     FMT_FP2,       ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(NEG_FP,  DECODE_COP1_FN, 0x07, "NEG",     FMT_FP2,       ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(CVT_S,   DECODE_COP1_FN, 0x20, "CVT.S",   FMT_FP2,       ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(CVT_D,   DECODE_COP1_FN, 0x21, "CVT.D",   FMT_FP2,       ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(CVT_W,   DECODE_COP1_FN, 0x24, "CVT.W",   FMT_FP2,       ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_F,     DECODE_COP1_FN, 0x30, "C.F",     FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_UN,    DECODE_COP1_FN, 0x31, "C.UN",    FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_EQ,    DECODE_COP1_FN, 0x32, "C.EQ",    FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_UEQ,   DECODE_COP1_FN, 0x33, "C.UEQ",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_OLT,   DECODE_COP1_FN, 0x34, "C.OLT",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_ULT,   DECODE_COP1_FN, 0x35, "C.ULT",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_OLE,   DECODE_COP1_FN, 0x36, "C.OLE",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_ULE,   DECODE_COP1_FN, 0x37, "C.ULE",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_SF,    DECODE_COP1_FN, 0x38, "C.SF",    FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_NGLE,  DECODE_COP1_FN, 0x39, "C.NGLE",  FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_SEQ,   DECODE_COP1_FN, 0x3A, "C.SEQ",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_NGL,   DECODE_COP1_FN, 0x3B, "C.NGL",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_LT,    DECODE_COP1_FN, 0x3C, "C.LT",    FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_NGE,   DECODE_COP1_FN, 0x3D, "C.NGE",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_LE,    DECODE_COP1_FN, 0x3E, "C.LE",    FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD) \
+	X(C_NGT,   DECODE_COP1_FN, 0x3F, "C.NGT",   FMT_FP_CMP,    ISA_COP | ISA_FP, FP_UNIT_ADD)
+
+/* OP_<name> numbers the instructions; OP_UNKNOWN is anything not listed */
+#define ISA_ENUM(name, table, key, mnemonic, format, flags, unit) OP_##name,
+enum { OP_UNKNOWN, MIPS_ISA(ISA_ENUM) NUM_OPS };
+#undef ISA_ENUM
+
+typedef struct ISA_Info_Struct {
+	const char *mnemonic;
+	uint32_t format;	/* FMT_* */
+	uint32_t flags;	/* ISA_* */
+	int unit;	/* FP_UNIT_* */
+} ISA_Info;
+
+extern const ISA_Info ISA[NUM_OPS];
+
+/***************************************************************/
+/* COP0 and a software-managed TLB. User (kuseg) loads and stores are */
+/* translated in MEM; kseg addresses from MEM_KTEXT_BEGIN up are not.   */
+/* One 4 KB page per entry, R3000 style: EntryHi = VPN << 12 | ASID,    */
+/* EntryLo = PFN << 12 | flags, Context = PTEBase | BadVPN << 2          */
+/***************************************************************/
+#define CP0_INDEX 0
+#define CP0_RANDOM 1
+#define CP0_ENTRYLO 2
+#define CP0_CONTEXT 4
+#define CP0_BADVADDR 8
+#define CP0_COUNT 9
+#define CP0_ENTRYHI 10
+#define CP0_STATUS 12
+#define CP0_CAUSE 13
+#define CP0_EPC 14
+#define CP0_REGS 32
+
+#define STATUS_EXL 0x02	/* in the exception handler: kernel mode */
+#define CAUSE_TLBL 2	/* ExcCode of a refill for a load or fetch */
+#define CAUSE_TLBS 3	/* and for a store */
+#define CAUSE_BD 0x80000000	/* EPC is the branch before the faulting delay slot */
+#define ENTRYLO_G 0x100	/* global: matches any ASID */
+#define ENTRYHI_ASID 0xFF
+#define INDEX_PROBE_FAIL 0x80000000
+#define MIPS_ERET 0x42000018
+
+#define MMU_PAGE_SHIFT 12
+#define MMU_KSEG_BEGIN MEM_KTEXT_BEGIN	/* unmapped from here up */
+#define MMU_REFILL_VECTOR MEM_KTEXT_BEGIN
+#define MMU_GENERAL_VECTOR (MEM_KTEXT_BEGIN + 0x180)	/* a miss inside a handler */
+#define TLB_MAX_ENTRIES 64
+#define MICRO_TLB_SIZE 16	/* host-side cache of recent translations, a power of two */
+
+typedef struct TLB_Entry_Struct {
+	uint32_t hi, lo;	/* as EntryHi and EntryLo */
+} TLB_Entry;
+
+typedef struct Micro_TLB_Entry_Struct {
+	uint32_t key;	/* VPN << 8 | ASID, plus one; 0 is empty */
+	uint32_t frame;	/* physical page base */
+} Micro_TLB_Entry;
+
+typedef struct MMU_State_Struct {
+	int enabled;
+	uint32_t entries;	/* TLB entries in use */
+	uint32_t cost;	/* cycles a user load or store waits in ID for its lookup */
+	uint32_t cp0[CP0_REGS];
+	TLB_Entry tlb[TLB_MAX_ENTRIES];
+	uint32_t waited;	/* lookup cycles of the load or store in ID so far */
+	uint32_t delay_slot;	/* PC of the last delay slot fetched behind a taken BC1 */
+	int restart;	/* IF fetches a new PC behind the bubbles of a flush */
+	Micro_TLB_Entry micro[MICRO_TLB_SIZE];
+	uint64_t translations, micro_hits, refills;
+} MMU_State;
+
+/***************************************************************/
+/* Store buffer between MEM and memory: stores retire into it, one    */
+/* entry reaches memory every latency cycles, loads merge its bytes.  */
+/* Entries never overlap; a store to the address of an entry merges   */
+/* into it, a partial overlap drains the buffer up to that entry first */
+/***************************************************************/
+#define STORE_BUFFER_MAX 32
+#define SB_DRAIN_EAGER 0	/* write to memory whenever anything is buffered */
+#define SB_DRAIN_LAZY 1	/* only while a store waits for a free entry */
+
+typedef struct Store_Buffer_Entry_Struct {
+	uint32_t address;	/* of the word mem_write_32 writes */
+	uint32_t value;
+	uint32_t mask;	/* bytes of the word written */
+} Store_Buffer_Entry;
+
+typedef struct Store_Buffer_Struct {
+	int enabled;
+	uint32_t size;	/* entries in use */
+	uint32_t latency;	/* cycles to write the oldest entry to memory */
+	int policy;	/* SB_DRAIN_* */
+	Store_Buffer_Entry entry[STORE_BUFFER_MAX];	/* a ring, oldest at head */
+	uint32_t head, count;
+	uint32_t busy;	/* cycles spent on the oldest entry so far */
+	int waiting;	/* a store in ID found no free entry */
+	uint64_t stores, merged, load_hits, forwards, conflicts, full_stalls, drained, occupancy;
+} Store_Buffer;
+
 /***************************************************************/
 /* CPU State info.                                                                                                               */
 /***************************************************************/
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;
-int ENABLE_FORWARDING;
-int ForwardA;
-int ForwardB;
-uint32_t INSTRUCTION_COUNT;
-uint32_t CYCLE_COUNT;
-uint32_t PROGRAM_SIZE; /*in words*/
+extern CPU_State CURRENT_STATE;
+extern MMU_State MMU;
+extern Store_Buffer STORE_BUFFER;
+extern Pipeline_Stats STATS;
+extern FP_Scoreboard FP_SCOREBOARD;
+extern uint32_t FP_LATENCY[NUM_FP_UNITS];
+extern Pending_Write PENDING; /* WB result not yet visible in CURRENT_STATE */
+extern CPU_State DUMP_STATE; /* register file at the last dump or mark */
+extern int RUN_FLAG;
+extern int ENABLE_FORWARDING;
+extern int ForwardA; /* FWD_* operand select for EX */
+extern int ForwardB;
+extern uint32_t INSTRUCTION_COUNT;
+extern uint32_t CYCLE_COUNT;
+extern uint32_t PROGRAM_SIZE; /*in words*/
 
 
 /***************************************************************/
 /* Pipeline Registers.                                                                                                        */
 /***************************************************************/
-CPU_Pipeline_Reg ID_IF;
-CPU_Pipeline_Reg EX_ID;
-CPU_Pipeline_Reg MEM_EX;
-CPU_Pipeline_Reg WB_MEM;
+extern CPU_Pipeline_Reg ID_IF;
+extern CPU_Pipeline_Reg EX_ID;
+extern CPU_Pipeline_Reg MEM_EX;
+extern CPU_Pipeline_Reg WB_MEM;
+
+extern char prog_file[256];
+extern uint32_t *PROGRAM_IMAGE; /*program words, reloaded on reset*/
 
-char prog_file[32];
+/***************************************************************/
+/* Per-cycle observers: cycle() only tests CYCLE_HOOKS when none armed */
+/***************************************************************/
+#define HOOK_DEBUG 0x01
+#define HOOK_CHECKPOINT 0x02
+#define HOOK_INTERVAL 0x04
+#define HOOK_MONITOR 0x08
+
+extern uint32_t CYCLE_HOOKS;
+
+/***************************************************************/
+/* Breakpoints and watchpoints.                                                                          */
+/***************************************************************/
+#define MAX_BREAKPOINTS 16
+
+typedef struct Debug_State_Struct {
+	uint32_t pc[MAX_BREAKPOINTS];
+	int num_pc;
+	uint32_t cycle[MAX_BREAKPOINTS];
+	int num_cycle;
+	uint32_t reg[MAX_BREAKPOINTS];
+	uint32_t reg_value[MAX_BREAKPOINTS];
+	uint32_t reg_last[MAX_BREAKPOINTS];
+	int num_reg;
+	uint32_t mem[MAX_BREAKPOINTS];
+	int num_mem;
+	int on_stall;
+	uint32_t last_pc;
+	int hit;		/* a breakpoint fired during the last cycle */
+	int paused;		/* the program was still running when it fired */
+} Debug_State;
+
+extern Debug_State DEBUG;
+
+/***************************************************************/
+/* Timing wheel of future events; cycles where the pipeline is frozen     */
+/* until the next one are skipped in bulk                                          */
+/***************************************************************/
+#define EVENT_WHEEL_BITS 6
+#define EVENT_WHEEL_SIZE (1 << EVENT_WHEEL_BITS)	/* cycles ahead held in slots, one bit each */
+
+typedef struct Event_Wheel_Struct {
+	int enabled;
+	uint64_t occupied;	/* slots holding an event */
+	uint32_t due[EVENT_WHEEL_SIZE];	/* cycle of each slot's event */
+	uint32_t far;	/* earliest event past the slots, 0 if none */
+	int frozen;	/* the last cycle left the pipeline waiting on the FP scoreboard alone */
+	uint64_t skips, skipped;	/* jumps taken and the cycles they covered */
+} Event_Wheel;
+
+extern Event_Wheel EVENTS;
+
+/***************************************************************/
+/* Memo of ID stall decisions keyed on the timing state of the cycle:   */
+/* the PC and word in ID, the words in EX/MEM and MEM/WB (0 for a       */
+/* bubble), the forwarding mode and, for an FP instruction, the cycles */
+/* until the scoreboard frees what it needs. No entry can go stale     */
+/***************************************************************/
+#define MEMO_BITS 12
+#define MEMO_SIZE (1 << MEMO_BITS)
+#define MEMO_VALID 0x1	/* state bits of an entry in use */
+#define MEMO_FORWARDING 0x2
+#define MEMO_SLACK_SHIFT 16	/* FP scoreboard slack, capped at 0xFFFF */
+
+typedef struct Memo_Entry_Struct {
+	uint32_t pc, ir, mem_ir, wb_ir;
+	uint32_t state;	/* MEMO_* bits and slack, 0 for an empty slot */
+	uint32_t stall;	/* STALL_* causes recorded for the state */
+} Memo_Entry;
+
+typedef struct Cycle_Memo_Struct {
+	int enabled;
+	Memo_Entry entry[MEMO_SIZE];	/* direct mapped */
+	uint64_t hits, misses;
+} Cycle_Memo;
+
+extern Cycle_Memo CYCLE_MEMO;
+
+/***************************************************************/
+/* LRU stack-distance analysis of the I-side and D-side streams.           */
+/***************************************************************/
+#define SD_ISIDE 0	/* fetches in IF */
+#define SD_DSIDE 1	/* loads and stores in MEM */
+#define SD_MAX_DISTANCE (1 << 16)	/* fully associative distances kept exactly, in lines */
+#define SD_SET_LEVELS 13	/* set-associative caches of 1 to 4096 sets */
+#define SD_MAX_WAYS 16
+
+typedef struct Stack_Distance_Struct {
+	uint64_t accesses, cold;
+	uint64_t distance[SD_MAX_DISTANCE + 1];	/* last bucket: SD_MAX_DISTANCE lines or more */
+	/* line -> time of its last access; live times are marked in a Fenwick tree */
+	uint32_t *keys, *times;
+	uint32_t hash_size, hash_used;
+	uint32_t *fenwick, *owner;	/* owner: hash slot of the line last accessed at each time */
+	uint8_t *live;
+	uint32_t capacity, now, num_live;
+	/* per-set LRU stacks for every power-of-two set count */
+	uint32_t *ways[SD_SET_LEVELS];
+	uint64_t way_hits[SD_SET_LEVELS][SD_MAX_WAYS];	/* hits at each LRU position */
+} Stack_Distance;
+
+typedef struct Cache_Analysis_Struct {
+	int enabled;
+	uint32_t line_shift;
+	Stack_Distance stream[2];	/* SD_ISIDE, SD_DSIDE */
+} Cache_Analysis;
+
+extern Cache_Analysis CACHE_ANALYSIS;
+
+/***************************************************************/
+/* Guest profile, one slot per word of the loaded program.                   */
+/***************************************************************/
+#define PROFILE_HOT_BLOCKS 10
+
+typedef struct Profile_Struct {
+	int enabled;
+	uint32_t size;	/* in words */
+	uint64_t *cycles;	/* retire cycles plus the bubbles the instruction caused */
+	uint64_t *stalls;	/* bubbles inserted while the instruction waited in ID */
+	uint64_t *executions;
+	uint32_t start_cycle;
+} Profile;
+
+extern Profile PROFILE;
+
+/***************************************************************/
+/* Interval statistics written every period cycles.                            */
+/***************************************************************/
+#define INTERVAL_BUFFER_SIZE 65536
+#define INTERVAL_ROW_MAX 512
+
+typedef struct Interval_Stats_Struct {
+	int enabled;
+	int json;
+	int threaded;	/* full buffers are written by a background thread */
+	uint32_t period, next_cycle;
+	FILE *file;
+	uint64_t rows;
+	/* counters at the start of the current interval */
+	uint32_t start_cycle, start_instructions;
+	Pipeline_Stats start;
+	uint32_t pc_min, pc_max;	/* retired PCs in the interval */
+	char *buffer[2];
+	size_t used;
+	int active;	/* buffer being filled */
+} Interval_Stats;
+
+extern Interval_Stats INTERVAL;
+
+/***************************************************************/
+/* Live metrics in a shared-memory segment, read by mumips-top.          */
+/* One writer; readers retry while sequence is odd or has changed.       */
+/***************************************************************/
+#define MONITOR_MAGIC 0x4D554D50	/* "MUMP" */
+#define MONITOR_VERSION 4
+
+typedef struct Monitor_Metrics_Struct {
+	uint32_t magic, version;
+	uint32_t sequence;
+	uint32_t pid;
+	uint32_t running;	/* RUN_FLAG; 0 once the program exits */
+	uint32_t pc;
+	uint64_t cycles, instructions;
+	uint64_t stalls[NUM_STALL_CAUSES];
+	uint64_t forwards, loads, stores;
+	char program[256];
+} Monitor_Metrics;
+
+typedef struct Monitor_State_Struct {
+	int enabled;
+	char name[64];
+	uint32_t period, next_cycle;
+	Monitor_Metrics *metrics;
+} Monitor_State;
+
+extern Monitor_State MONITOR;
+
+/***************************************************************/
+/* Host-side self-profile: every Nth cycle is timed stage by stage.      */
+/***************************************************************/
+typedef struct Host_Profile_Struct {
+	int enabled, sampling;
+	uint32_t period, countdown;
+	uint64_t samples;
+	uint64_t stage[5];	/* WB, MEM, EX, ID, IF */
+	uint64_t memory, print;	/* accessor and trace time inside the stages */
+	uint64_t start_ticks;
+	double start_seconds;
+	uint64_t start_cycle;
+} Host_Profile;
+
+extern Host_Profile HOST_PROFILE;
+
+/***************************************************************/
+/* Batch functional execution of one program over many inputs.          */
+/***************************************************************/
+#define BATCH_VECTOR 8	/* lanes per 256-bit vector */
+#define BATCH_REG_HI MIPS_REGS	/* batch register numbers beyond the GPRs */
+#define BATCH_REG_LO (MIPS_REGS + 1)
+
+typedef struct Batch_State_Struct {
+	uint32_t lanes, width;	/* lanes in use, and rounded up to whole vectors */
+	uint32_t active;	/* lanes still running */
+	int converged;	/* every running lane is at pc with branch_target pending */
+	uint32_t pc, branch_target;
+	uint64_t converged_steps;
+	uint32_t *regs[MIPS_REGS], *hi, *lo;	/* REGS[r][lane] */
+	uint32_t *fpr[MIPS_FP_REGS], *fcsr;
+	uint32_t *lane_pc, *lane_branch_target;	/* per lane while diverged */
+	uint32_t *running, *mask;	/* ~0 for lanes running, and running at the PC stepped */
+	uint32_t *word, *taken;	/* loaded words and BC1 targets of the step */
+	uint64_t *instructions;	/* per lane, converged steps added when it stops */
+	uint32_t *row_address;	/* lane-private memory: a row of lane words per address stored to */
+	uint32_t *rows;
+	uint32_t row_capacity, row_count;
+	uint64_t divergent_steps, gathers;
+	double seconds;
+	uint32_t *file;	/* one allocation behind all the lane arrays */
+} Batch_State;
+
+extern Batch_State BATCH;
+
+/***************************************************************/
+/* Decoupled simulation: a functional thread streams the instructions it */
+/* executes to a timing model on another thread                              */
+/***************************************************************/
+#define TRACE_RING_SIZE 65536	/* records, a power of two */
+#define TRACE_PUBLISH 256	/* records between index updates seen by the other side */
+#define TRACE_MAGIC 0x5254554D	/* "MUTR" */
+#define TRACE_VERSION 1
+
+/* Trace_Record flags */
+#define TRACE_LOAD 1
+#define TRACE_STORE 2
+#define TRACE_WRONG_PATH 4	/* fetched past the exiting SYSCALL, never executed */
+
+typedef struct Trace_Record_Struct {
+	uint32_t pc, ir;
+	uint32_t address;	/* effective address of a load or store */
+	uint32_t v0;	/* $v0 when the instruction executed, which SYSCALL tests */
+	uint8_t src[2], dst;	/* GPRs read and written, 0 for none */
+	uint8_t flags;
+} Trace_Record;
+
+typedef struct Trace_File_Header_Struct {
+	uint32_t magic, version;
+	uint32_t record_size;
+	uint32_t start_pc;
+} Trace_File_Header;
+
+/* the fields of a pipeline latch that decide timing */
+typedef struct Timing_Latch_Struct {
+	uint32_t IR, PC, SYSCALL, V0;
+	uint32_t TID;	/* hardware thread of a barrel core, else 0 */
+} Timing_Latch;
+
+typedef struct Timing_Model_Struct {
+	int forwarding;
+	uint32_t latency[NUM_FP_UNITS];	/* FP unit latencies, as FP_LATENCY */
+	Timing_Latch ID_IF, EX_ID, MEM_EX, WB_MEM;
+	FP_Scoreboard fp;
+	uint32_t cycles, instructions;
+	uint64_t stalls[NUM_STALL_CAUSES];
+	int done;	/* the exiting SYSCALL retired, or the stream ran dry and drained */
+	int ended;	/* no more records to fetch */
+	const Trace_Record *replay;	/* records of a saved trace, else the ring */
+	uint64_t replay_count, replay_next;
+	FILE *save;
+} Timing_Model;
+
+#define REPLAY_MAX_CONFIGS 16	/* timing configurations replayed at once */
+
+typedef struct Replay_Job_Struct {
+	char name[64];	/* the configuration as given */
+	Timing_Model tm;
+	int threaded;	/* FALSE when it ran on the calling thread */
+} Replay_Job;
+
+typedef struct Trace_Ring_Struct {
+	Trace_Record *records;
+	uint32_t head __attribute__((aligned(64)));	/* written by the producer */
+	uint32_t finished;
+	uint32_t tail __attribute__((aligned(64)));	/* written by the consumer */
+	uint32_t cached_head __attribute__((aligned(64)));	/* consumer's copies */
+	uint32_t next;
+} Trace_Ring;
+
+/***************************************************************/
+/* Barrel core: hardware thread contexts interleaved one fetch per      */
+/* cycle through the timing model's pipeline                                  */
+/***************************************************************/
+#define BARREL_MAX_THREADS 8
+#define BARREL_ROUND_ROBIN 0
+#define BARREL_STALL_AWARE 1	/* prefer a thread whose next instruction would issue */
+
+typedef struct Barrel_Thread_Struct {
+	CPU_State state;
+	Trace_Record next;	/* already executed, waiting for IF */
+	int fetching;	/* next is valid */
+	int next_exits;	/* next is the SYSCALL that ends the thread */
+	int exited;	/* that SYSCALL retired */
+	FP_Scoreboard fp;	/* the divider is shared, so divider_free is kept equal */
+	uint32_t instructions;
+	uint64_t stalls[NUM_STALL_CAUSES];
+} Barrel_Thread;
+
+typedef struct Barrel_Core_Struct {
+	int forwarding, policy;
+	uint32_t threads, last;	/* contexts, and the one IF picked last */
+	Timing_Latch ID_IF, EX_ID, MEM_EX, WB_MEM;
+	Barrel_Thread thread[BARREL_MAX_THREADS];
+	uint32_t cycles, instructions;
+	uint64_t stalls[NUM_STALL_CAUSES];
+	uint64_t avoided;	/* fetches that skipped a thread whose next instruction would stall */
+	int done;
+} Barrel_Core;
+
+/***************************************************************/
+/* Sampled simulation.                                                                                    */
+/***************************************************************/
+#define SAMPLE_Z 1.96	/* 95% confidence */
+#define SAMPLE_ERROR 0.03	/* relative error the recommended window count aims for */
+#define SAMPLE_CYCLE_LIMIT 64	/* cycles per instruction before a window is abandoned */
+
+/***************************************************************/
+/* Periodic checkpoints for stepping backwards.                                        */
+/***************************************************************/
+#define MAX_CHECKPOINTS 64
+#define UNDO_LOG_SIZE (1 << 20)	/* memory writes remembered, in words */
+
+typedef struct Checkpoint_Struct {
+	uint32_t cycle;
+	uint64_t log_pos;	/* undo log entries written before the checkpoint */
+	CPU_State state;
+	CPU_Pipeline_Reg id_if, ex_id, mem_ex, wb_mem;
+	FP_Scoreboard fp_scoreboard;
+	uint32_t cp0[CP0_REGS];
+	TLB_Entry tlb[TLB_MAX_ENTRIES];
+	uint32_t mmu_waited, mmu_delay_slot;
+	Store_Buffer_Entry sb[STORE_BUFFER_MAX];
+	uint32_t sb_head, sb_count, sb_busy;
+	int sb_waiting;
+	int forward_a, forward_b;
+	int run_flag;
+	uint32_t instruction_count;
+	Pipeline_Stats stats;	/* so replayed cycles are not counted twice */
+} Checkpoint;
+
+typedef struct Mem_Undo_Entry_Struct {
+	uint32_t address;
+	uint32_t old_value;
+} Mem_Undo_Entry;
+
+typedef struct Time_Travel_Struct {
+	uint32_t interval;	/* cycles between checkpoints, 0 when off */
+	uint32_t next_cycle;
+	Checkpoint ckpt[MAX_CHECKPOINTS];
+	int num_ckpt;
+	Mem_Undo_Entry *log;
+	uint64_t log_head;	/* entries ever logged */
+	uint64_t log_tail;	/* oldest entry still held */
+	int logging;
+} Time_Travel_State;
+
+extern Time_Travel_State TIME_TRAVEL;
+extern int ENABLE_TRACE; /* print program loading, retired instructions and stalls */
+
+/***************************************************************/
+/* Co-simulation reference model.                                                                        */
+/***************************************************************/
+extern int COSIM_FLAG;
+extern int COSIM_SYNC;
+extern uint32_t COSIM_CHECKED;
+extern CPU_State REF_STATE;
+extern Mem_Store_Record PIPE_STORE;
 
 
 /***************************************************************/
 /* Function Declerations.                                                                                                */
 /***************************************************************/
-void help();
-uint32_t mem_read_32(uint32_t address);
-void mem_write_32(uint32_t address, uint32_t value);
+extern uint32_t (*mem_read_32)(uint32_t address); /* timed during sampled cycles */
+extern void (*mem_write_32)(uint32_t address, uint32_t value);
 void cycle();
+uint32_t cycle_skip(uint32_t limit);
+void pending_apply();
 void run(int num_cycles);
 void runAll();
 void mdump(uint32_t start, uint32_t stop) ;
 void rdump();
-void handle_command();
+void rdiff();
+void mdiff(uint32_t start, uint32_t stop);
+void bdiff(uint32_t start, uint32_t stop, const char *file);
+void dump_mark();
+mem_region_t *mem_region(uint32_t address);
+void mem_touch_page(int region, uint32_t page);
 void reset();
+void reset_pipeline();
 void init_memory();
-void load_program();
-void handle_pipeline(); /*IMPLEMENT THIS*/
+void free_memory();
+int load_program();
+void load_image();
+extern void (*handle_pipeline)(); /* specialized for ENABLE_FORWARDING */
+void set_forwarding(int enable);
 void WB();/*IMPLEMENT THIS*/
 void MEM();/*IMPLEMENT THIS*/
 void EX();/*IMPLEMENT THIS*/
@@ -109,4 +839,67 @@ void IF();/*IMPLEMENT THIS*/
 void show_pipeline();/*IMPLEMENT THIS*/
 void initialize();
 void print_program(); /*IMPLEMENT THIS*/
-void print_instruction(uint32_t addr);
\ No newline at end of file
+void print_instruction(uint32_t addr);
+void mem_store(uint32_t address, uint32_t value);
+int ref_step(CPU_State *state, Mem_Store_Record *store);
+int fp_set_latency(const char *unit, uint32_t cycles);
+int mmu_enable(uint32_t entries, uint32_t cost);
+void mmu_disable();
+void mmu_reset();
+void mmu_report();
+int store_buffer_enable(uint32_t entries, uint32_t latency, int policy);
+void store_buffer_drain();
+void store_buffer_reset();
+void store_buffer_report();
+void cycle_hooks();
+void debug_check();
+void debug_mem_write(uint32_t address);
+void debug_break_pc(uint32_t pc);
+void debug_break_cycle(uint32_t cycle);
+void debug_break_stall();
+void debug_watch_reg(uint32_t reg, uint32_t value);
+int debug_watch_mem(uint32_t address);
+void debug_list();
+void debug_clear();
+int debug_resume();
+void checkpoint_enable(uint32_t interval);
+void checkpoint_take();
+void checkpoint_log(uint32_t address, uint32_t old_value);
+void checkpoint_drop(int count);
+int back(uint32_t num_cycles);
+void cosim_enable(int enable);
+void cosim_check();
+void cosim_divergence(const char *what);
+const char *engine_unmodelled();
+int sample(uint32_t period, uint32_t warmup, uint32_t window);
+void event_schedule(uint32_t cycle);
+uint32_t event_next(uint32_t now);
+void event_skip_enable(int enable);
+void memo_enable(int enable);
+void cache_analysis_enable(uint32_t line_size);
+void cache_access(int side, uint32_t address);
+void cache_analysis_report();
+void profile_enable(int enable);
+void profile_retire(uint32_t pc);
+void profile_stall(uint32_t pc);
+void profile_report();
+int interval_stats_open(uint32_t period, const char *file, int threaded);
+void interval_stats_close();
+void interval_stats_emit();
+int monitor_open(const char *name, uint32_t period);
+void monitor_publish();
+void monitor_close();
+void host_profile_enable(uint32_t period);
+void host_profile_report();
+int batch_open(uint32_t lanes);
+void batch_set_reg(uint32_t lane, uint32_t reg, uint32_t value);
+uint32_t batch_get_reg(uint32_t lane, uint32_t reg);
+void batch_run();
+void batch_report();
+void batch_show(uint32_t reg);
+void batch_close();
+int decoupled_run(const char *trace_file);
+int trace_replay(const char *trace_file, const char *configs);
+int barrel_run(uint32_t threads, int policy);
+
+#endif
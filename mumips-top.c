@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "mu-mips.h"
+
+/***************************************************************/
+/* Consistent copy of the metrics; FALSE once the writer is gone          */
+/***************************************************************/
+int read_metrics(const Monitor_Metrics *shared, Monitor_Metrics *copy) {
+	uint32_t before, after;
+
+	do {
+		if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != MONITOR_MAGIC) {
+			return FALSE;
+		}
+		before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+		memcpy(copy, shared, sizeof(Monitor_Metrics));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED);
+	} while ((before & 1) || before != after);
+	return TRUE;
+}
+
+/***************************************************************/
+/* Print the simulator's counters once a second until it goes away     */
+/***************************************************************/
+int main(int argc, char *argv[]) {
+	char name[64];
+	Monitor_Metrics *shared, now, last;
+	uint64_t stalls;
+	double interval = 1.0;
+	int fd, i;
+
+	if (argc < 2) {
+		printf("Usage: %s <shared memory name> [seconds]\n", argv[0]);
+		exit(1);
+	}
+	if (argc > 2) {
+		interval = atof(argv[2]);
+	}
+	snprintf(name, sizeof(name), "%s%s", argv[1][0] == '/' ? "" : "/", argv[1]);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		printf("Error: No simulator publishes %s\n", name);
+		exit(1);
+	}
+	shared = mmap(NULL, sizeof(Monitor_Metrics), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shared == MAP_FAILED || !read_metrics(shared, &last) || last.version != MONITOR_VERSION) {
+		printf("Error: %s is not a MU-MIPS metrics segment\n", name);
+		exit(1);
+	}
+
+	printf("MU-MIPS pid %u running %s\n", last.pid, last.program);
+	printf("%14s%14s%8s%14s%12s%12s%12s\n", "cycles", "instructions", "IPC", "cycles/s", "PC", "stalls", "forwards");
+	for (;;) {
+		struct timespec delay = {(time_t)interval, (long)((interval - (time_t)interval) * 1e9)};
+		nanosleep(&delay, NULL);
+		if (!read_metrics(shared, &now)) {
+			printf("Simulator exited.\n");
+			break;
+		}
+		for (stalls = 0, i = 0; i < NUM_STALL_CAUSES; i++) {
+			stalls += now.stalls[i];
+		}
+		printf("%14llu%14llu%8.3f%14.0f  0x%08x%12llu%12llu\n", (unsigned long long)now.cycles, (unsigned long long)now.instructions,
+			now.cycles ? (double)now.instructions / now.cycles : 0.0, (now.cycles - last.cycles) / interval, now.pc,
+			(unsigned long long)stalls, (unsigned long long)now.forwards);
+		fflush(stdout);
+		if (!now.running && !last.running) {
+			printf("Simulation Finished.\n");
+			break;
+		}
+		last = now;
+	}
+	munmap(shared, sizeof(Monitor_Metrics));
+	return 0;
+}
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../libmumips.h"
+
+/***************************************************************/
+/* Golden-result regression check: every program runs headless with   */
+/* forwarding off and on, and its cycles, instructions, stalls by cause */
+/* and non-zero registers must equal the .expect file next to it. An    */
+/* optional .config file next to it holds one command per line:         */
+/* mmu <entries> <cost> and sb <entries> <latency> [lazy] as in the CLI, */
+/* mem <start> <stop> to add the non-zero memory words in between to  */
+/* the results, and sample <period> <warm-up> <window> to add the       */
+/* sampled estimate, or its refusal. Each mode also runs again with the */
+/* ID memo on, and again stepping back from 3/4 of the way to 3/8; both */
+/* must end with the same results                                          */
+/***************************************************************/
+#define CHECK_MAX_CYCLES 10000000	/* a run still going after this has hung */
+#define CHECK_CHECKPOINT_INTERVAL 8
+#define CHECK_RESULT_SIZE 16384
+
+uint32_t MEM_START, MEM_STOP;	/* words the results include, from mem */
+uint32_t SAMPLE_PERIOD, SAMPLE_WARMUP, SAMPLE_WINDOW;	/* from sample; no window = none */
+
+/***************************************************************/
+/* Run one program in one forwarding mode and append the results;     */
+/* stall causes and registers that stay zero are left out. With        */
+/* back_at, stop there and step back half of it before running on.     */
+/* Returns the cycles, 0 when the program did not finish                 */
+/***************************************************************/
+uint32_t run_mode(mumips_ctx *ctx, int forwarding, uint32_t back_at, char *out, size_t size) {
+	mumips_counters counters;
+	size_t used = strlen(out);
+	const char *name;
+	uint64_t stalls;
+	uint32_t value, address;
+	int i;
+
+	mumips_reset(ctx);
+	mumips_set_forwarding(ctx, forwarding);
+	if (back_at) {
+		mumips_set_checkpoints(ctx, CHECK_CHECKPOINT_INTERVAL);
+		mumips_step(ctx, back_at);
+		if (mumips_back(ctx, back_at / 2) != MUMIPS_OK) {
+			used += snprintf(out + used, size - used, "f%d cannot step back from cycle %u\n", forwarding, back_at);
+		}
+	}
+	mumips_run(ctx, CHECK_MAX_CYCLES);
+	mumips_set_checkpoints(ctx, 0);
+	mumips_get_counters(ctx, &counters);
+	if (counters.running) {
+		used += snprintf(out + used, size - used, "f%d did not finish in %u cycles\n", forwarding, CHECK_MAX_CYCLES);
+		return 0;
+	}
+
+	used += snprintf(out + used, size - used, "f%d cycles %u\n", forwarding, counters.cycles);
+	used += snprintf(out + used, size - used, "f%d instructions %u\n", forwarding, counters.instructions);
+	for (i = 0; (name = mumips_stall_name(i)) != NULL; i++) {
+		stalls = mumips_get_stalls(ctx, i);
+		if (stalls) {
+			used += snprintf(out + used, size - used, "f%d stalls %s %llu\n", forwarding, name, (unsigned long long)stalls);
+		}
+	}
+	used += snprintf(out + used, size - used, "f%d pc 0x%08x\n", forwarding, counters.pc);
+	for (i = 0; i < MUMIPS_REG_HI; i++) {
+		if ((value = mumips_get_reg(ctx, i))) {
+			used += snprintf(out + used, size - used, "f%d R%d 0x%08x\n", forwarding, i, value);
+		}
+	}
+	if ((value = mumips_get_reg(ctx, MUMIPS_REG_HI))) {
+		used += snprintf(out + used, size - used, "f%d HI 0x%08x\n", forwarding, value);
+	}
+	if ((value = mumips_get_reg(ctx, MUMIPS_REG_LO))) {
+		used += snprintf(out + used, size - used, "f%d LO 0x%08x\n", forwarding, value);
+	}
+	for (i = 0; i < MUMIPS_FP_REGS; i++) {
+		if ((value = mumips_get_reg(ctx, MUMIPS_REG_F0 + i))) {
+			used += snprintf(out + used, size - used, "f%d F%d 0x%08x\n", forwarding, i, value);
+		}
+	}
+	if ((value = mumips_get_reg(ctx, MUMIPS_REG_FCSR))) {
+		used += snprintf(out + used, size - used, "f%d FCSR 0x%08x\n", forwarding, value);
+	}
+	for (address = MEM_START; address && address <= MEM_STOP; address += 4) {
+		if ((value = mumips_read_mem(ctx, address))) {
+			used += snprintf(out + used, size - used, "f%d M 0x%08x 0x%08x\n", forwarding, address, value);
+		}
+	}
+	return counters.cycles;
+}
+
+/***************************************************************/
+/* Append the sampled estimate of the program with forwarding off      */
+/***************************************************************/
+void run_sample(mumips_ctx *ctx, char *out, size_t size) {
+	mumips_counters counters;
+	size_t used = strlen(out);
+
+	mumips_reset(ctx);
+	mumips_set_forwarding(ctx, 0);
+	if (mumips_sample(ctx, SAMPLE_PERIOD, SAMPLE_WARMUP, SAMPLE_WINDOW) != MUMIPS_OK) {
+		snprintf(out + used, size - used, "sample refused\n");
+		return;
+	}
+	mumips_get_counters(ctx, &counters);
+	snprintf(out + used, size - used, "sample cycles %u instructions %u\n", counters.cycles, counters.instructions);
+}
+
+/***************************************************************/
+/* Apply a program's .config file, if it has one; 0 for a bad line     */
+/***************************************************************/
+int apply_config(mumips_ctx *ctx, const char *path) {
+	char line[256], lazy[16];
+	unsigned entries, cycles;
+	FILE *file = fopen(path, "r");
+	int ok = 1;
+
+	MEM_START = MEM_STOP = 0;
+	SAMPLE_PERIOD = SAMPLE_WARMUP = SAMPLE_WINDOW = 0;
+	if (file == NULL) {
+		return 1;
+	}
+	while (ok && fgets(line, sizeof(line), file)) {
+		lazy[0] = '\0';
+		if (sscanf(line, "mmu %u %u", &entries, &cycles) == 2) {
+			ok = mumips_set_mmu(ctx, entries, cycles) == MUMIPS_OK;
+		}
+		else if (sscanf(line, "sb %u %u %15s", &entries, &cycles, lazy) >= 2) {
+			ok = mumips_set_store_buffer(ctx, entries, cycles, strcmp(lazy, "lazy") == 0) == MUMIPS_OK;
+		}
+		else if (sscanf(line, "mem %x %x", &MEM_START, &MEM_STOP) == 2) {
+			ok = MEM_START <= MEM_STOP;
+		}
+		else if (sscanf(line, "sample %u %u %u", &SAMPLE_PERIOD, &SAMPLE_WARMUP, &SAMPLE_WINDOW) == 3) {
+			ok = SAMPLE_WINDOW != 0;
+		}
+		else {
+			ok = line[strspn(line, " \t\r\n")] == '\0';
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+/***************************************************************/
+/* Print the first line where the results and the golden file differ   */
+/***************************************************************/
+void report_difference(const char *program, const char *run, const char *got, const char *want) {
+	int line = 1;
+
+	while (*got && *got == *want) {
+		line += *got == '\n';
+		got++;
+		want++;
+	}
+	while (line > 1 && got[-1] != '\n') {
+		got--;
+		want--;
+	}
+	printf("FAIL %s%s, line %d\n  expected: %.*s\n  got:      %.*s\n", program, run, line,
+		(int)strcspn(want, "\n"), want, (int)strcspn(got, "\n"), got);
+}
+
+int main(int argc, char *argv[]) {
+	static char got[CHECK_RESULT_SIZE], want[CHECK_RESULT_SIZE], again[CHECK_RESULT_SIZE], memoized[CHECK_RESULT_SIZE];
+	char expect[512], config[512], sampled[256];
+	uint32_t cycles[2];
+	mumips_ctx *ctx;
+	FILE *file;
+	size_t length;
+	int update = 0, failed = 0, checked = 0, i;
+
+	if (argc > 1 && strcmp(argv[1], "--update") == 0) {
+		update = 1;
+		argv++;
+		argc--;
+	}
+	if (argc < 2) {
+		printf("Usage: %s [--update] <program.in> ...\n", argv[0]);
+		exit(1);
+	}
+
+	for (i = 1; i < argc; i++) {
+		length = strlen(argv[i]);
+		if (length < 3 || strcmp(argv[i] + length - 3, ".in") != 0 || length + 4 > sizeof(expect)) {
+			printf("FAIL %s: not a .in program\n", argv[i]);
+			failed++;
+			continue;
+		}
+		snprintf(expect, sizeof(expect), "%.*s.expect", (int)(length - 3), argv[i]);
+		snprintf(config, sizeof(config), "%.*s.config", (int)(length - 3), argv[i]);
+
+		ctx = mumips_create();
+		mumips_set_trace(ctx, 0);
+		got[0] = '\0';
+		again[0] = '\0';
+		memoized[0] = '\0';
+		sampled[0] = '\0';
+		if (mumips_load_program(ctx, argv[i]) != MUMIPS_OK) {
+			snprintf(got, sizeof(got), "cannot load\n");
+		}
+		else if (!apply_config(ctx, config)) {
+			snprintf(got, sizeof(got), "bad %s\n", config);
+		}
+		else {
+			cycles[0] = run_mode(ctx, 0, 0, got, sizeof(got));
+			cycles[1] = run_mode(ctx, 1, 0, got, sizeof(got));
+			run_mode(ctx, 0, cycles[0] * 3 / 4, again, sizeof(again));
+			run_mode(ctx, 1, cycles[1] * 3 / 4, again, sizeof(again));
+			mumips_set_memo(ctx, 1);
+			run_mode(ctx, 0, 0, memoized, sizeof(memoized));
+			run_mode(ctx, 1, 0, memoized, sizeof(memoized));
+			mumips_set_memo(ctx, 0);
+			if (SAMPLE_WINDOW) {
+				run_sample(ctx, sampled, sizeof(sampled));
+			}
+		}
+		mumips_destroy(ctx);
+		checked++;
+
+		if (again[0] && strcmp(again, got) != 0) {
+			report_difference(argv[i], " after back", again, got);
+			failed++;
+			continue;
+		}
+		if (memoized[0] && strcmp(memoized, got) != 0) {
+			report_difference(argv[i], " with the memo", memoized, got);
+			failed++;
+			continue;
+		}
+		length = strlen(got);
+		snprintf(got + length, sizeof(got) - length, "%s", sampled);
+
+		if (update) {
+			file = fopen(expect, "w");
+			if (file == NULL || fputs(got, file) < 0) {
+				printf("FAIL %s: cannot write %s\n", argv[i], expect);
+				failed++;
+			}
+			if (file) {
+				fclose(file);
+			}
+			continue;
+		}
+		file = fopen(expect, "r");
+		if (file == NULL) {
+			printf("FAIL %s: no %s (run with --update to create it)\n", argv[i], expect);
+			failed++;
+			continue;
+		}
+		length = fread(want, 1, sizeof(want) - 1, file);
+		want[length] = '\0';
+		fclose(file);
+		if (strcmp(got, want) != 0) {
+			report_difference(argv[i], "", got, want);
+			failed++;
+		}
+	}
+
+	if (update) {
+		printf("%d golden file%s written\n", checked - failed, checked - failed == 1 ? "" : "s");
+	}
+	else {
+		printf("%d of %d programs match their golden results\n", checked - failed, checked);
+	}
+	return failed ? 1 : 0;
+}